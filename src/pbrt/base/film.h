@@ -11,6 +11,7 @@
 #include <pbrt/util/pstd.h>
 #include <pbrt/util/taggedptr.h>
 
+#include <cstdio>
 #include <string>
 
 namespace pbrt {
@@ -42,14 +43,22 @@ class FilmHandle : public TaggedPointer<RGBFilm, GBufferFilm> {
 
     PBRT_CPU_GPU
     RGB GetPixelRGB(const Point2i &p, Float splatScale = 1) const;
+    PBRT_CPU_GPU
+    Float GetPixelRelativeError(const Point2i &p) const;
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
+    void FlushSplats();
+    void RequestSplatFlush();
+    void BindRowsToNumaNode(int yStart, int yEnd, int node);
+    bool WriteCheckpoint(FILE *f);
+    bool ReadCheckpoint(FILE *f);
+    bool MergeCheckpoint(FILE *f);
 
     using TaggedPointer::TaggedPointer;
 
     static FilmHandle Create(const std::string &name,
                              const ParameterDictionary &parameters, const FileLoc *loc,
-                             FilterHandle filter, Allocator alloc);
+                             FilterHandle filter, bool storeSplats, Allocator alloc);
 
     PBRT_CPU_GPU inline FilterHandle GetFilter() const;
 
@@ -45,12 +45,21 @@ static void usage(const std::string &msg = {}) {
             R"(usage: pbrt [<options>] <filename.pbrt...>
 
 Rendering options:
+  --adaptive-error <e>         Stop sampling pixels once the estimated relative error
+                               of their value falls below <e> (e.g., 0.01). The
+                               scene's sample count is the per-pixel maximum.
+  --bvh-cache <directory>      Cache BVHs for large meshes in the given directory and
+                               reuse them when the geometry is unchanged.
+  --checkpoint <filename>      Save the film's accumulated samples to the given file
+                               after each wave of pixel samples.
   --cropwindow <x0,x1,y0,y1>   Specify an image crop window w.r.t. [0,1]^2
   --debugstart <values>        Inform the Integrator where to start rendering for
                                faster debugging. (<values> are Integrator-specific
                                and come from error message text.)
   --disable-pixel-jitter       Always sample pixels at their centers.
   --disable-wavelength-jitter  Always sample the same %d wavelengths of light.
+  --display-interval <seconds> Time between updates of the image sent to the display
+                               server and written to the preview file. Default: 0.25.
   --display-server <addr:port> Connect to display server at given address and port
                                to display the image as it's being rendered.
   --force-diffuse              Convert all materials to be diffuse.)"
@@ -61,22 +70,36 @@ Rendering options:
 #endif
             R"(
   --help                       Print this help text.
+  --merge <file0,file1,...>    Merge the given checkpoints of renders of the same scene
+                               with different --sample-range values and write the
+                               final image. Does not render an image.
   --mse-reference-image        Filename for reference image to use for MSE computation.
   --mse-reference-out          File to write MSE error vs spp results.
   --nthreads <num>             Use specified number of threads for rendering.
   --outfile <filename>         Write the final image to the given filename.
+  --pin-threads                Pin each rendering thread to a core and keep per-thread
+                               and film memory on the threads' NUMA nodes.
   --pixel <x,y>                Render just the specified pixel.
   --pixelbounds <x0,x1,y0,y1>  Specify an image crop window w.r.t. pixel coordinates.
   --pixelstats                 Record per-pixel statistics and write additional images
                                with their values.
+  --preview <filename>         Periodically write the image as it's being rendered to
+                               the given memory-mapped file.
   --quick                      Automatically reduce a number of quality settings
                                to render more quickly.
   --quiet                      Suppress all text output other than error messages.
+  --resume                     Continue rendering from the --checkpoint file, if it
+                               exists.
   --render-coord-sys <name>    Coordinate system to use for the scene when rendering,
                                where name is "camera", "cameraworld", or "world".
+  --sample-range <begin,end>   Only take the pixel samples with indices in [begin,end),
+                               so that a render can be split across processes or
+                               machines. Use with --checkpoint and then --merge.
   --seed <n>                   Set random number generator seed. Default: 0.
   --spp <n>                    Override number of pixel samples specified in scene
                                description file.
+  --time-limit <seconds>       Stop taking samples so that rendering finishes within
+                               the given time; the sample count is then a maximum.
 
 Logging options:
   --log-level <level>          Log messages at or above this level, where <level>
@@ -86,6 +109,9 @@ Logging options:
 Reformatting options:
   --format                     Print a reformatted version of the input file(s) to
                                standard output. Does not render an image.
+  --tobinary <filename>        Write a binary version of the input file(s), which
+                               loads faster, to the given file. Does not render an
+                               image.
   --toply                      Print a reformatted version of the input file(s) to
                                standard output and convert all triangle meshes to
                                PLY files. Does not render an image.
@@ -107,6 +133,7 @@ int main(int argc, char *argv[]) {
     std::string logLevel = "error";
     std::string renderCoordSys = "cameraworld";
     bool format = false, toPly = false;
+    std::string toBinary;
 
     // Process command-line arguments
     ++argv;
@@ -122,7 +149,7 @@ int main(int argc, char *argv[]) {
             exit(1);
         };
 
-        std::string cropWindow, pixelBounds, pixel;
+        std::string cropWindow, pixelBounds, pixel, sampleRange, merge;
         if (ParseArg(&argv, "cropwindow", &cropWindow, onError)) {
             pstd::optional<std::vector<Float>> c = SplitStringToFloats(cropWindow, ',');
             if (!c || c->size() != 4) {
@@ -147,16 +174,31 @@ int main(int argc, char *argv[]) {
             }
             options.pixelBounds =
                 Bounds2i(Point2i((*p)[0], (*p)[2]), Point2i((*p)[1], (*p)[3]));
+        } else if (ParseArg(&argv, "sample-range", &sampleRange, onError)) {
+            pstd::optional<std::vector<int>> r = SplitStringToInts(sampleRange, ',');
+            if (!r || r->size() != 2 || (*r)[0] < 0 || (*r)[1] <= (*r)[0]) {
+                usage("Didn't find a valid sample index range after --sample-range");
+                return 1;
+            }
+            options.sampleRangeBegin = (*r)[0];
+            options.sampleRangeEnd = (*r)[1];
+        } else if (ParseArg(&argv, "merge", &merge, onError)) {
+            options.mergeCheckpointFiles = SplitString(merge, ',');
         } else if (
 #ifdef PBRT_BUILD_GPU_RENDERER
             ParseArg(&argv, "gpu", &options.useGPU, onError) ||
             ParseArg(&argv, "gpu-device", &options.gpuDevice, onError) ||
 #endif
+            ParseArg(&argv, "adaptive-error", &options.adaptiveErrorThreshold,
+                     onError) ||
+            ParseArg(&argv, "bvh-cache", &options.bvhCacheDirectory, onError) ||
+            ParseArg(&argv, "checkpoint", &options.checkpointFile, onError) ||
             ParseArg(&argv, "debugstart", &options.debugStart, onError) ||
             ParseArg(&argv, "disable-pixel-jitter", &options.disablePixelJitter,
                      onError) ||
             ParseArg(&argv, "disable-wavelength-jitter", &options.disableWavelengthJitter,
                      onError) ||
+            ParseArg(&argv, "display-interval", &options.displayInterval, onError) ||
             ParseArg(&argv, "display-server", &options.displayServer, onError) ||
             ParseArg(&argv, "force-diffuse", &options.forceDiffuse, onError) ||
             ParseArg(&argv, "format", &format, onError) ||
@@ -165,12 +207,17 @@ int main(int argc, char *argv[]) {
             ParseArg(&argv, "mse-reference-out", &options.mseReferenceOutput, onError) ||
             ParseArg(&argv, "nthreads", &options.nThreads, onError) ||
             ParseArg(&argv, "outfile", &options.imageFile, onError) ||
+            ParseArg(&argv, "pin-threads", &options.pinThreads, onError) ||
             ParseArg(&argv, "pixelstats", &options.recordPixelStatistics, onError) ||
+            ParseArg(&argv, "preview", &options.previewFile, onError) ||
             ParseArg(&argv, "quick", &options.quickRender, onError) ||
             ParseArg(&argv, "quiet", &options.quiet, onError) ||
             ParseArg(&argv, "render-coord-sys", &renderCoordSys, onError) ||
+            ParseArg(&argv, "resume", &options.resume, onError) ||
             ParseArg(&argv, "seed", &options.seed, onError) ||
             ParseArg(&argv, "spp", &options.pixelSamples, onError) ||
+            ParseArg(&argv, "time-limit", &options.timeLimit, onError) ||
+            ParseArg(&argv, "tobinary", &toBinary, onError) ||
             ParseArg(&argv, "toply", &toPly, onError) ||
             ParseArg(&argv, "upgrade", &options.upgrade, onError) ||
             ParseArg(&argv, "vlog-level", &options.logConfig.vlogLevel, onError)) {
@@ -186,7 +233,7 @@ int main(int argc, char *argv[]) {
     }
 
     // Print welcome banner
-    if (!options.quiet && !format && !toPly && !options.upgrade) {
+    if (!options.quiet && !format && !toPly && !options.upgrade && toBinary.empty()) {
         printf("pbrt version 4 (built %s at %s)\n", __DATE__, __TIME__);
 #ifndef NDEBUG
         LOG_VERBOSE("Running debug build");
@@ -213,6 +260,13 @@ int main(int argc, char *argv[]) {
                   "--mse-reference-out");
     if (!options.mseReferenceOutput.empty() && options.mseReferenceImage.empty())
         ErrorExit("Must provide MSE reference image via --mse-reference-image");
+    if (options.displayInterval <= 0)
+        ErrorExit("--display-interval must be greater than zero");
+    if (options.resume && options.checkpointFile.empty())
+        ErrorExit("Must provide checkpoint filename via --checkpoint with --resume");
+    if ((options.sampleRangeEnd || !options.mergeCheckpointFiles.empty()) &&
+        options.useGPU)
+        ErrorExit("--sample-range and --merge are not supported with --gpu");
 
     options.logConfig.level = LogLevelFromString(logLevel);
 
@@ -221,6 +275,9 @@ int main(int argc, char *argv[]) {
     if (format || toPly || options.upgrade) {
         FormattingScene formattingScene(toPly, options.upgrade);
         ParseFiles(&formattingScene, filenames);
+    } else if (!toBinary.empty()) {
+        BinarySceneWriter writer(toBinary);
+        ParseFiles(&writer, filenames);
     } else {
         // Parse provided scene description files
         ParsedScene scene;
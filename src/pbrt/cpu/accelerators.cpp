@@ -5,25 +5,59 @@
 #include <pbrt/cpu/accelerators.h>
 
 #include <pbrt/interaction.h>
+#include <pbrt/options.h>
 #include <pbrt/paramdict.h>
 #include <pbrt/shapes.h>
 #include <pbrt/util/bits.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/log.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
+#include <pbrt/util/progressreporter.h>
 #include <pbrt/util/stats.h>
 
 #include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <tuple>
+#include <unordered_map>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#define PBRT_BVH_SSE
+#endif
+#if defined(__AVX__)
+#define PBRT_BVH_AVX
+#endif
 
 namespace pbrt {
 
 STAT_MEMORY_COUNTER("Memory/BVH tree", treeBytes);
+STAT_MEMORY_COUNTER("Memory/BVH nodes", bvhNodeBytes);
 STAT_RATIO("BVH/Primitives per leaf node", totalPrimitives, totalLeafNodes);
 STAT_COUNTER("BVH/Interior nodes", interiorNodes);
 STAT_COUNTER("BVH/Leaf nodes", leafNodes);
 STAT_PIXEL_COUNTER("BVH/Nodes visited", bvhNodesVisited);
+STAT_COUNTER("BVH/Wide nodes", wideBVHNodes);
+STAT_COUNTER("BVH/Build time (ms)", bvhBuildMilliseconds);
+STAT_COUNTER("BVH/Spatial splits", sbvhSpatialSplits);
+STAT_COUNTER("BVH/Cache hits", bvhCacheHits);
+STAT_COUNTER("BVH/Instances", bvhInstances);
+STAT_MEMORY_COUNTER("Memory/BVH triangle vertices", triangleVertexBytes);
+STAT_COUNTER("BVH/Triangle batch tests", triangleBatchTests);
 
 // MortonPrimitive Definition
 struct MortonPrimitive {
@@ -136,18 +170,970 @@ struct alignas(32) LinearBVHNode {
     uint8_t axis;          // interior node: xyz
 };
 
+// Wide BVH Box Test Functions
+// Tests a ray against _N_ child bounds stored SoA; returns a bitmask of the
+// children that are hit and their entry distances in _tEntry_.
+template <int N>
+inline int IntersectWideBounds(const float (&bounds)[2][3][N], const float o[3],
+                               const float invDir[3], const int dirIsNeg[3], float tMax,
+                               float tEntry[N]) {
+    // Scalar fallback for wide BVH node ray-box tests
+    int hitMask = 0;
+    for (int i = 0; i < N; ++i) {
+        float tNear = 0, tFar = tMax;
+        for (int a = 0; a < 3; ++a) {
+            float t0 = (bounds[dirIsNeg[a]][a][i] - o[a]) * invDir[a];
+            float t1 = (bounds[1 - dirIsNeg[a]][a][i] - o[a]) * invDir[a];
+            t1 *= 1 + 2 * gamma(3);
+            // NaNs from zero direction components leave the interval as is
+            tNear = t0 > tNear ? t0 : tNear;
+            tFar = t1 < tFar ? t1 : tFar;
+        }
+        tEntry[i] = tNear;
+        if (tNear <= tFar)
+            hitMask |= 1 << i;
+    }
+    return hitMask;
+}
+
+#ifdef PBRT_BVH_SSE
+template <>
+inline int IntersectWideBounds<4>(const float (&bounds)[2][3][4], const float o[3],
+                                  const float invDir[3], const int dirIsNeg[3],
+                                  float tMax, float tEntry[4]) {
+    __m128 tNear = _mm_setzero_ps(), tFar = _mm_set1_ps(tMax);
+    const __m128 farScale = _mm_set1_ps(1 + 2 * gamma(3));
+    for (int a = 0; a < 3; ++a) {
+        __m128 org = _mm_set1_ps(o[a]), inv = _mm_set1_ps(invDir[a]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[dirIsNeg[a]][a]), org), inv);
+        __m128 t1 =
+            _mm_mul_ps(_mm_sub_ps(_mm_load_ps(bounds[1 - dirIsNeg[a]][a]), org), inv);
+        t1 = _mm_mul_ps(t1, farScale);
+        // _mm_max_ps() and _mm_min_ps() return their second operand for NaNs
+        tNear = _mm_max_ps(t0, tNear);
+        tFar = _mm_min_ps(t1, tFar);
+    }
+    _mm_storeu_ps(tEntry, tNear);
+    return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+}
+#endif  // PBRT_BVH_SSE
+
+#ifdef PBRT_BVH_AVX
+template <>
+inline int IntersectWideBounds<8>(const float (&bounds)[2][3][8], const float o[3],
+                                  const float invDir[3], const int dirIsNeg[3],
+                                  float tMax, float tEntry[8]) {
+    __m256 tNear = _mm256_setzero_ps(), tFar = _mm256_set1_ps(tMax);
+    const __m256 farScale = _mm256_set1_ps(1 + 2 * gamma(3));
+    for (int a = 0; a < 3; ++a) {
+        __m256 org = _mm256_set1_ps(o[a]), inv = _mm256_set1_ps(invDir[a]);
+        __m256 t0 = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_load_ps(bounds[dirIsNeg[a]][a]), org), inv);
+        __m256 t1 = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_load_ps(bounds[1 - dirIsNeg[a]][a]), org), inv);
+        t1 = _mm256_mul_ps(t1, farScale);
+        tNear = _mm256_max_ps(t0, tNear);
+        tFar = _mm256_min_ps(t1, tFar);
+    }
+    _mm256_storeu_ps(tEntry, tNear);
+    return _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+}
+#endif  // PBRT_BVH_AVX
+
+// WideBVHNode Definition
+template <int N>
+struct alignas(64) WideBVHNode {
+    // WideBVHNode Public Methods
+    static constexpr int Width = N;
+
+    int IntersectP(const float o[3], const float invDir[3], const int dirIsNeg[3],
+                   float tMax, float tEntry[N]) const {
+        return IntersectWideBounds<N>(bounds, o, invDir, dirIsNeg, tMax, tEntry);
+    }
+
+    int ChildOffset(int i) const { return offset[i]; }
+    int ChildPrimitives(int i) const { return nPrimitives[i]; }
+
+    // Child bounds are stored SoA so that all _N_ slabs can be tested at once;
+    // empty slots have inverted bounds and are never hit.
+    float bounds[2][3][N];
+    int32_t offset[N];        // interior: child node index; leaf: first primitive
+    uint16_t nPrimitives[N];  // 0 -> interior child
+};
+
+// QuantizedBVHNode Definition
+template <int N>
+struct alignas(8) QuantizedBVHNode {
+    // QuantizedBVHNode Public Methods
+    static constexpr int Width = N;
+
+    static float Scale(int8_t exponent) {
+        return BitsToFloat(uint32_t(exponent + 127) << 23);
+    }
+
+    int IntersectP(const float o[3], const float invDir[3], const int dirIsNeg[3],
+                   float tMax, float tEntry[N]) const {
+        // Dequantize child bounds and test them like a _WideBVHNode_'s
+        alignas(32) float bounds[2][3][N];
+        for (int a = 0; a < 3; ++a) {
+            float scale = Scale(exponent[a]);
+            for (int i = 0; i < N; ++i) {
+                bounds[0][a][i] = origin[a] + float(qBounds[0][a][i]) * scale;
+                bounds[1][a][i] = origin[a] + float(qBounds[1][a][i]) * scale;
+            }
+        }
+        int hitMask = IntersectWideBounds<N>(bounds, o, invDir, dirIsNeg, tMax, tEntry);
+        return hitMask & ((1 << nChildren) - 1);
+    }
+
+    int ChildOffset(int i) const {
+        return (nPrimitives[i] > 0 ? primitivesOffset : childrenOffset) + offset[i];
+    }
+    int ChildPrimitives(int i) const { return nPrimitives[i]; }
+
+    // Child bounds are quantized to 8 bits on a grid with origin at the node's
+    // lower corner and power-of-two spacing in each dimension. Interior
+    // children are stored contiguously, as are the primitives of leaf
+    // children, so only offsets relative to those are stored per child.
+    float origin[3];
+    int8_t exponent[3];
+    uint8_t nChildren;
+    int32_t childrenOffset, primitivesOffset;
+    uint8_t qBounds[2][3][N];
+    uint16_t nPrimitives[N];  // 0 -> interior child
+    uint16_t offset[N];
+};
+
+// WideBVHStackEntry Definition
+struct WideBVHStackEntry {
+    int offset;
+    int nPrimitives;  // 0 -> interior node
+    float tEntry;
+};
+
+// BVHRayPacket Definition
+struct BVHRayPacket {
+    // BVHRayPacket Public Methods
+    BVHRayPacket(pstd::span<const Ray> rays, pstd::span<const Float> rayTMax,
+                 const int *rayIndex, int nRays)
+        : n(nRays) {
+        DCHECK_LE(n, MaxRays);
+        for (int i = 0; i < n; ++i) {
+            index[i] = rayIndex[i];
+            ray[i] = &rays[index[i]];
+            tMax[i] = rayTMax[index[i]];
+            invDir[i] = Vector3f(1 / ray[i]->d.x, 1 / ray[i]->d.y, 1 / ray[i]->d.z);
+            for (int c = 0; c < 3; ++c)
+                dirIsNeg[i][c] = int(invDir[i][c] < 0);
+        }
+    }
+
+    uint64_t AllRays() const { return (n == 64) ? ~uint64_t(0) : ((uint64_t(1) << n) - 1); }
+
+    // BVHRayPacket Public Members
+    static constexpr int MaxRays = 64;
+    int n;
+    int index[MaxRays];
+    const Ray *ray[MaxRays];
+    Float tMax[MaxRays];
+    Vector3f invDir[MaxRays];
+    int dirIsNeg[MaxRays][3];
+};
+
+// Returns the index of the lowest set bit of _mask_
+static inline int LowestSetBit(uint64_t mask) {
+    return Log2Int(mask & (~mask + 1));
+}
+
+// Triangle Batch Definitions
+// Leaf triangles are first tested _TriangleBatchWidth_ at a time with a
+// conservative SIMD version of the edge function test in
+// Triangle::Intersect(); only triangles that it can't rule out are passed on
+// to the exact watertight test.
+#ifdef PBRT_BVH_AVX
+static constexpr int TriangleBatchWidth = 8;
+#else
+static constexpr int TriangleBatchWidth = 4;
+#endif
+
+// BVHTriangleVertices Definition
+// Vertex positions of a BVH's primitives in SoA layout, indexed like its
+// primitive array. Primitives that aren't triangles have NaN vertices so that
+// they always pass the batch test, and the arrays are padded so that a full
+// batch can be loaded at any leaf.
+struct BVHTriangleVertices {
+    const float *Component(int vertex, int c) const {
+        return p.get() + (3 * vertex + c) * stride;
+    }
+    float *Component(int vertex, int c) { return p.get() + (3 * vertex + c) * stride; }
+
+    std::unique_ptr<float[]> p;
+    size_t stride;
+};
+
+// TriangleBatchRay Definition
+struct TriangleBatchRay {
+    TriangleBatchRay(const Ray &ray) {
+        // Permute and shear as in Triangle::Intersect()
+        k[2] = MaxComponentIndex(Abs(ray.d));
+        k[0] = (k[2] + 1) % 3;
+        k[1] = (k[0] + 1) % 3;
+        Vector3f d = Permute(ray.d, {k[0], k[1], k[2]});
+        Sx = -d.x / d.z;
+        Sy = -d.y / d.z;
+        for (int i = 0; i < 3; ++i)
+            o[i] = ray.o[k[i]];
+    }
+
+    int k[3];
+    float o[3];
+    float Sx, Sy;
+};
+
+// The edge functions are computed without the error-free transformations of
+// Triangle::Intersect(), so a triangle is only ruled out if its edge functions
+// have opposite signs by more than a bound on their error.
+static inline float TriangleBatchTolerance() {
+    return gamma(32);
+}
+
+// Returns a bitmask of the triangles in the batch starting at _offset_ that
+// the ray may intersect.
+template <int N>
+inline int TriangleBatchCandidates(const BVHTriangleVertices &tv,
+                                   const TriangleBatchRay &r, int offset) {
+    // Scalar fallback for triangle batch tests
+    int candidateMask = 0;
+    for (int i = 0; i < N; ++i) {
+        // Compute translated and sheared vertex positions and their magnitudes
+        float X[3], Y[3], absX[3], absY[3];
+        for (int v = 0; v < 3; ++v) {
+            float tx = tv.Component(v, r.k[0])[offset + i] - r.o[0];
+            float ty = tv.Component(v, r.k[1])[offset + i] - r.o[1];
+            float tz = tv.Component(v, r.k[2])[offset + i] - r.o[2];
+            float sx = r.Sx * tz, sy = r.Sy * tz;
+            X[v] = tx + sx;
+            Y[v] = ty + sy;
+            absX[v] = std::abs(tx) + std::abs(sx);
+            absY[v] = std::abs(ty) + std::abs(sy);
+        }
+
+        // Rule out triangle if its edge functions have conflicting signs
+        bool negative = false, positive = false;
+        for (int e = 0; e < 3; ++e) {
+            int a = (e + 1) % 3, b = (e + 2) % 3;
+            float edge = X[a] * Y[b] - Y[a] * X[b];
+            float tolerance =
+                TriangleBatchTolerance() * (absX[a] * absY[b] + absY[a] * absX[b]);
+            negative |= edge < -tolerance;
+            positive |= edge > tolerance;
+        }
+        if (!(negative && positive))
+            candidateMask |= 1 << i;
+    }
+    return candidateMask;
+}
+
+#ifdef PBRT_BVH_SSE
+template <>
+inline int TriangleBatchCandidates<4>(const BVHTriangleVertices &tv,
+                                      const TriangleBatchRay &r, int offset) {
+    const __m128 signMask = _mm_set1_ps(-0.f);
+    const __m128 Sx = _mm_set1_ps(r.Sx), Sy = _mm_set1_ps(r.Sy);
+    __m128 X[3], Y[3], absX[3], absY[3];
+    for (int v = 0; v < 3; ++v) {
+        __m128 tx = _mm_sub_ps(_mm_loadu_ps(tv.Component(v, r.k[0]) + offset),
+                               _mm_set1_ps(r.o[0]));
+        __m128 ty = _mm_sub_ps(_mm_loadu_ps(tv.Component(v, r.k[1]) + offset),
+                               _mm_set1_ps(r.o[1]));
+        __m128 tz = _mm_sub_ps(_mm_loadu_ps(tv.Component(v, r.k[2]) + offset),
+                               _mm_set1_ps(r.o[2]));
+        __m128 sx = _mm_mul_ps(Sx, tz), sy = _mm_mul_ps(Sy, tz);
+        X[v] = _mm_add_ps(tx, sx);
+        Y[v] = _mm_add_ps(ty, sy);
+        absX[v] = _mm_add_ps(_mm_andnot_ps(signMask, tx), _mm_andnot_ps(signMask, sx));
+        absY[v] = _mm_add_ps(_mm_andnot_ps(signMask, ty), _mm_andnot_ps(signMask, sy));
+    }
+
+    const __m128 toleranceScale = _mm_set1_ps(TriangleBatchTolerance());
+    __m128 negative = _mm_setzero_ps(), positive = _mm_setzero_ps();
+    for (int e = 0; e < 3; ++e) {
+        int a = (e + 1) % 3, b = (e + 2) % 3;
+        __m128 edge = _mm_sub_ps(_mm_mul_ps(X[a], Y[b]), _mm_mul_ps(Y[a], X[b]));
+        __m128 tolerance = _mm_mul_ps(
+            toleranceScale,
+            _mm_add_ps(_mm_mul_ps(absX[a], absY[b]), _mm_mul_ps(absY[a], absX[b])));
+        // Comparisons with NaN are false, so NaN lanes remain candidates
+        negative =
+            _mm_or_ps(negative, _mm_cmplt_ps(edge, _mm_xor_ps(tolerance, signMask)));
+        positive = _mm_or_ps(positive, _mm_cmpgt_ps(edge, tolerance));
+    }
+    return ~_mm_movemask_ps(_mm_and_ps(negative, positive)) & 0xf;
+}
+#endif  // PBRT_BVH_SSE
+
+#ifdef PBRT_BVH_AVX
+template <>
+inline int TriangleBatchCandidates<8>(const BVHTriangleVertices &tv,
+                                      const TriangleBatchRay &r, int offset) {
+    const __m256 signMask = _mm256_set1_ps(-0.f);
+    const __m256 Sx = _mm256_set1_ps(r.Sx), Sy = _mm256_set1_ps(r.Sy);
+    __m256 X[3], Y[3], absX[3], absY[3];
+    for (int v = 0; v < 3; ++v) {
+        __m256 tx = _mm256_sub_ps(_mm256_loadu_ps(tv.Component(v, r.k[0]) + offset),
+                                  _mm256_set1_ps(r.o[0]));
+        __m256 ty = _mm256_sub_ps(_mm256_loadu_ps(tv.Component(v, r.k[1]) + offset),
+                                  _mm256_set1_ps(r.o[1]));
+        __m256 tz = _mm256_sub_ps(_mm256_loadu_ps(tv.Component(v, r.k[2]) + offset),
+                                  _mm256_set1_ps(r.o[2]));
+        __m256 sx = _mm256_mul_ps(Sx, tz), sy = _mm256_mul_ps(Sy, tz);
+        X[v] = _mm256_add_ps(tx, sx);
+        Y[v] = _mm256_add_ps(ty, sy);
+        absX[v] = _mm256_add_ps(_mm256_andnot_ps(signMask, tx),
+                                _mm256_andnot_ps(signMask, sx));
+        absY[v] = _mm256_add_ps(_mm256_andnot_ps(signMask, ty),
+                                _mm256_andnot_ps(signMask, sy));
+    }
+
+    const __m256 toleranceScale = _mm256_set1_ps(TriangleBatchTolerance());
+    __m256 negative = _mm256_setzero_ps(), positive = _mm256_setzero_ps();
+    for (int e = 0; e < 3; ++e) {
+        int a = (e + 1) % 3, b = (e + 2) % 3;
+        __m256 edge =
+            _mm256_sub_ps(_mm256_mul_ps(X[a], Y[b]), _mm256_mul_ps(Y[a], X[b]));
+        __m256 tolerance = _mm256_mul_ps(
+            toleranceScale, _mm256_add_ps(_mm256_mul_ps(absX[a], absY[b]),
+                                          _mm256_mul_ps(absY[a], absX[b])));
+        negative = _mm256_or_ps(
+            negative,
+            _mm256_cmp_ps(edge, _mm256_xor_ps(tolerance, signMask), _CMP_LT_OQ));
+        positive = _mm256_or_ps(positive, _mm256_cmp_ps(edge, tolerance, _CMP_GT_OQ));
+    }
+    return ~_mm256_movemask_ps(_mm256_and_ps(negative, positive)) & 0xff;
+}
+#endif  // PBRT_BVH_AVX
+
+// Calls _func_ for the primitives in _[offset, offset+count)_ that may be hit
+// by the ray, in order, until it returns _true_.
+template <typename F>
+static inline bool ForEachLeafCandidate(const BVHTriangleVertices *triangleVertices,
+                                        const TriangleBatchRay *batchRay, int offset,
+                                        int count, F func) {
+    if (triangleVertices == nullptr) {
+        for (int i = 0; i < count; ++i)
+            if (func(offset + i))
+                return true;
+        return false;
+    }
+
+    for (int start = 0; start < count; start += TriangleBatchWidth) {
+        uint64_t candidateMask = TriangleBatchCandidates<TriangleBatchWidth>(
+            *triangleVertices, *batchRay, offset + start);
+        if (count - start < TriangleBatchWidth)
+            candidateMask &= (1u << (count - start)) - 1;
+        ++triangleBatchTests;
+        while (candidateMask) {
+            int i = LowestSetBit(candidateMask);
+            candidateMask &= candidateMask - 1;
+            if (func(offset + start + i))
+                return true;
+        }
+    }
+    return false;
+}
+
+// Wide BVH Utility Functions
+template <int N>
+static int CollapseBVHChildren(BVHBuildNode *node, BVHBuildNode *children[N]) {
+    // Collapse binary BVH below _node_ into at most _N_ children
+    int nChildren = 0;
+    if (node->nPrimitives > 0)
+        children[nChildren++] = node;
+    else {
+        children[nChildren++] = node->children[0];
+        children[nChildren++] = node->children[1];
+        while (nChildren < N) {
+            // Open the interior child with the largest surface area
+            int best = -1;
+            Float bestArea = -1;
+            for (int i = 0; i < nChildren; ++i)
+                if (children[i]->nPrimitives == 0 &&
+                    children[i]->bounds.SurfaceArea() > bestArea) {
+                    best = i;
+                    bestArea = children[i]->bounds.SurfaceArea();
+                }
+            if (best == -1)
+                break;
+            BVHBuildNode *opened = children[best];
+            children[best] = opened->children[0];
+            children[nChildren++] = opened->children[1];
+        }
+    }
+    return nChildren;
+}
+
+// Returns _float_ bounds that conservatively contain _b_ in case _Float_ is a double
+static inline void RoundBoundsOutward(const Bounds3f &b, float lo[3], float hi[3]) {
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = b.pMin[a];
+        hi[a] = b.pMax[a];
+        if (Float(lo[a]) > b.pMin[a])
+            lo[a] = NextFloatDown(lo[a]);
+        if (Float(hi[a]) < b.pMax[a])
+            hi[a] = NextFloatUp(hi[a]);
+    }
+}
+
+template <int N>
+static int FlattenWideBVH(BVHBuildNode *node, std::vector<WideBVHNode<N>> &wideNodes) {
+    int nodeIndex = wideNodes.size();
+    wideNodes.push_back(WideBVHNode<N>());
+    ++wideBVHNodes;
+
+    BVHBuildNode *children[N];
+    int nChildren = CollapseBVHChildren<N>(node, children);
+
+    // Initialize child slots of wide BVH node
+    for (int i = 0; i < N; ++i) {
+        WideBVHNode<N> &wideNode = wideNodes[nodeIndex];
+        if (i >= nChildren) {
+            for (int a = 0; a < 3; ++a) {
+                wideNode.bounds[0][a][i] = Infinity;
+                wideNode.bounds[1][a][i] = -Infinity;
+            }
+            wideNode.offset[i] = 0;
+            wideNode.nPrimitives[i] = 0;
+            continue;
+        }
+        float lo[3], hi[3];
+        RoundBoundsOutward(children[i]->bounds, lo, hi);
+        for (int a = 0; a < 3; ++a) {
+            wideNode.bounds[0][a][i] = lo[a];
+            wideNode.bounds[1][a][i] = hi[a];
+        }
+        if (children[i]->nPrimitives > 0) {
+            CHECK_LT(children[i]->nPrimitives, 65536);
+            wideNode.offset[i] = children[i]->firstPrimOffset;
+            wideNode.nPrimitives[i] = children[i]->nPrimitives;
+        } else {
+            wideNode.nPrimitives[i] = 0;
+            int childIndex = FlattenWideBVH<N>(children[i], wideNodes);
+            // _wideNodes_ may have been reallocated by the recursive call
+            wideNodes[nodeIndex].offset[i] = childIndex;
+        }
+    }
+    return nodeIndex;
+}
+
+template <int N>
+static void FlattenQuantizedBVH(BVHBuildNode *node, int nodeIndex,
+                                std::vector<QuantizedBVHNode<N>> &qNodes,
+                                const std::vector<PrimitiveHandle> &primitives,
+                                std::vector<PrimitiveHandle> &orderedPrims) {
+    ++wideBVHNodes;
+    BVHBuildNode *children[N];
+    int nChildren = CollapseBVHChildren<N>(node, children);
+
+    QuantizedBVHNode<N> qNode;
+    qNode.nChildren = nChildren;
+    float childLo[N][3], childHi[N][3], lo[3], hi[3];
+    for (int a = 0; a < 3; ++a) {
+        lo[a] = Infinity;
+        hi[a] = -Infinity;
+    }
+    for (int i = 0; i < nChildren; ++i) {
+        RoundBoundsOutward(children[i]->bounds, childLo[i], childHi[i]);
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = std::min(lo[a], childLo[i][a]);
+            hi[a] = std::max(hi[a], childHi[i][a]);
+        }
+    }
+
+    // Quantize child bounds conservatively with respect to the node's bounds
+    for (int a = 0; a < 3; ++a) {
+        // Find smallest power-of-two grid spacing that spans the node's extent
+        qNode.origin[a] = lo[a];
+        int exponent = -126;
+        if (hi[a] > lo[a])
+            exponent = Clamp(Exponent((hi[a] - lo[a]) / 255), -126, 127);
+        while (lo[a] + 255 * QuantizedBVHNode<N>::Scale(exponent) < hi[a]) {
+            CHECK_LT(exponent, 127);
+            ++exponent;
+        }
+        qNode.exponent[a] = exponent;
+        float scale = QuantizedBVHNode<N>::Scale(exponent);
+
+        for (int i = 0; i < N; ++i) {
+            if (i >= nChildren) {
+                qNode.qBounds[0][a][i] = 255;
+                qNode.qBounds[1][a][i] = 0;
+                continue;
+            }
+            int qLo = Clamp(int((childLo[i][a] - lo[a]) / scale), 0, 255);
+            while (qLo > 0 && lo[a] + qLo * scale > childLo[i][a])
+                --qLo;
+            int qHi = Clamp(int(std::ceil((childHi[i][a] - lo[a]) / scale)), 0, 255);
+            while (qHi < 255 && lo[a] + qHi * scale < childHi[i][a])
+                ++qHi;
+            DCHECK_GE(lo[a] + qHi * scale, childHi[i][a]);
+            qNode.qBounds[0][a][i] = qLo;
+            qNode.qBounds[1][a][i] = qHi;
+        }
+    }
+
+    // Allocate contiguous interior children and leaf primitives
+    int nInterior = 0;
+    qNode.childrenOffset = qNodes.size();
+    qNode.primitivesOffset = orderedPrims.size();
+    for (int i = 0; i < N; ++i) {
+        qNode.nPrimitives[i] = qNode.offset[i] = 0;
+        if (i >= nChildren)
+            continue;
+        if (children[i]->nPrimitives > 0) {
+            int offset = orderedPrims.size() - qNode.primitivesOffset;
+            CHECK_LT(offset + children[i]->nPrimitives, 65536);
+            qNode.nPrimitives[i] = children[i]->nPrimitives;
+            qNode.offset[i] = offset;
+            for (int j = 0; j < children[i]->nPrimitives; ++j)
+                orderedPrims.push_back(primitives[children[i]->firstPrimOffset + j]);
+        } else
+            qNode.offset[i] = nInterior++;
+    }
+    qNodes.resize(qNodes.size() + nInterior);
+    qNodes[nodeIndex] = qNode;
+
+    // Flatten interior children into their preallocated nodes
+    for (int i = 0; i < nChildren; ++i)
+        if (children[i]->nPrimitives == 0)
+            FlattenQuantizedBVH<N>(children[i], qNode.childrenOffset + qNode.offset[i],
+                                   qNodes, primitives, orderedPrims);
+}
+
+template <int N>
+static QuantizedBVHNode<N> *CreateQuantizedBVHNodes(BVHBuildNode *root,
+                                                    std::vector<PrimitiveHandle> &primitives,
+                                                    int *nNodes) {
+    std::vector<QuantizedBVHNode<N>> qNodes(1);
+    std::vector<PrimitiveHandle> orderedPrims;
+    orderedPrims.reserve(primitives.size());
+    FlattenQuantizedBVH<N>(root, 0, qNodes, primitives, orderedPrims);
+    primitives.swap(orderedPrims);
+    *nNodes = qNodes.size();
+    QuantizedBVHNode<N> *nodes = new QuantizedBVHNode<N>[qNodes.size()];
+    std::copy(qNodes.begin(), qNodes.end(), nodes);
+    return nodes;
+}
+
+template <int N>
+static WideBVHNode<N> *CreateWideBVHNodes(BVHBuildNode *root, int *nNodes) {
+    std::vector<WideBVHNode<N>> wideNodes;
+    FlattenWideBVH<N>(root, wideNodes);
+    *nNodes = wideNodes.size();
+    WideBVHNode<N> *nodes = new WideBVHNode<N>[wideNodes.size()];
+    std::copy(wideNodes.begin(), wideNodes.end(), nodes);
+    return nodes;
+}
+
+template <typename Node>
+static pstd::optional<ShapeIntersection> IntersectWideBVH(
+    const Node *nodes, const std::vector<PrimitiveHandle> &primitives,
+    const BVHTriangleVertices *triangleVertices, const Ray &ray, Float tMax) {
+    constexpr int N = Node::Width;
+    pstd::optional<ShapeIntersection> si;
+    TriangleBatchRay batchRay(ray);
+    float o[3] = {float(ray.o.x), float(ray.o.y), float(ray.o.z)};
+    float invDir[3] = {float(1 / ray.d.x), float(1 / ray.d.y), float(1 / ray.d.z)};
+    int dirIsNeg[3] = {int(invDir[0] < 0), int(invDir[1] < 0), int(invDir[2] < 0)};
+    // Follow ray through wide BVH nodes, nearest children first
+    WideBVHStackEntry nodesToVisit[64 * (N - 1) + 1];
+    int toVisitOffset = 0;
+    nodesToVisit[toVisitOffset++] = {0, 0, 0.f};
+    int nodesVisited = 0;
+    while (toVisitOffset > 0) {
+        WideBVHStackEntry entry = nodesToVisit[--toVisitOffset];
+        if (entry.tEntry > tMax)
+            continue;
+        if (entry.nPrimitives > 0) {
+            // Intersect ray with primitives in leaf child
+            ForEachLeafCandidate(triangleVertices, &batchRay, entry.offset,
+                                 entry.nPrimitives, [&](int index) {
+                                     pstd::optional<ShapeIntersection> primSi =
+                                         primitives[index].Intersect(ray, tMax);
+                                     if (primSi) {
+                                         si = primSi;
+                                         tMax = si->tHit;
+                                     }
+                                     return false;
+                                 });
+            continue;
+        }
+
+        ++nodesVisited;
+        const Node &node = nodes[entry.offset];
+        float tEntry[N];
+        int hitMask = node.IntersectP(o, invDir, dirIsNeg, float(tMax), tEntry);
+        // Push hit children so that the nearest one is visited next
+        int first = toVisitOffset;
+        for (int i = 0; i < N; ++i) {
+            if (!(hitMask & (1 << i)))
+                continue;
+            WideBVHStackEntry child{node.ChildOffset(i), node.ChildPrimitives(i),
+                                    tEntry[i]};
+            int j = toVisitOffset++;
+            while (j > first && nodesToVisit[j - 1].tEntry < child.tEntry) {
+                nodesToVisit[j] = nodesToVisit[j - 1];
+                --j;
+            }
+            nodesToVisit[j] = child;
+        }
+    }
+
+    bvhNodesVisited += nodesVisited;
+    return si;
+}
+
+template <typename Node>
+static bool IntersectPWideBVH(const Node *nodes,
+                              const std::vector<PrimitiveHandle> &primitives,
+                              const BVHTriangleVertices *triangleVertices,
+                              const Ray &ray, Float tMax) {
+    constexpr int N = Node::Width;
+    TriangleBatchRay batchRay(ray);
+    float o[3] = {float(ray.o.x), float(ray.o.y), float(ray.o.z)};
+    float invDir[3] = {float(1 / ray.d.x), float(1 / ray.d.y), float(1 / ray.d.z)};
+    int dirIsNeg[3] = {int(invDir[0] < 0), int(invDir[1] < 0), int(invDir[2] < 0)};
+    WideBVHStackEntry nodesToVisit[64 * (N - 1) + 1];
+    int toVisitOffset = 0;
+    nodesToVisit[toVisitOffset++] = {0, 0, 0.f};
+    int nodesVisited = 0;
+    while (toVisitOffset > 0) {
+        WideBVHStackEntry entry = nodesToVisit[--toVisitOffset];
+        if (entry.nPrimitives > 0) {
+            if (ForEachLeafCandidate(triangleVertices, &batchRay, entry.offset,
+                                     entry.nPrimitives, [&](int index) {
+                                         return primitives[index].IntersectP(ray, tMax);
+                                     })) {
+                bvhNodesVisited += nodesVisited;
+                return true;
+            }
+            continue;
+        }
+
+        ++nodesVisited;
+        const Node &node = nodes[entry.offset];
+        float tEntry[N];
+        int hitMask = node.IntersectP(o, invDir, dirIsNeg, float(tMax), tEntry);
+        for (int i = 0; i < N; ++i)
+            if (hitMask & (1 << i))
+                nodesToVisit[toVisitOffset++] = {node.ChildOffset(i),
+                                                 node.ChildPrimitives(i), tEntry[i]};
+    }
+    bvhNodesVisited += nodesVisited;
+    return false;
+}
+
+// Ray Packet Traversal Functions
+static inline void IntersectLeafPacket(const std::vector<PrimitiveHandle> &primitives,
+                                       const BVHTriangleVertices *triangleVertices,
+                                       int primitivesOffset, int nPrimitives,
+                                       uint64_t rayMask, BVHRayPacket &packet,
+                                       uint64_t *occluded) {
+    for (; rayMask; rayMask &= rayMask - 1) {
+        int r = LowestSetBit(rayMask);
+        const Ray &ray = *packet.ray[r];
+        TriangleBatchRay batchRay(ray);
+        ForEachLeafCandidate(
+            triangleVertices, &batchRay, primitivesOffset, nPrimitives, [&](int index) {
+                if (primitives[index].IntersectP(ray, packet.tMax[r])) {
+                    *occluded |= uint64_t(1) << r;
+                    return true;
+                }
+                return false;
+            });
+    }
+}
+
+static void IntersectPacketBVH(const LinearBVHNode *nodes,
+                               const std::vector<PrimitiveHandle> &primitives,
+                               const BVHTriangleVertices *triangleVertices,
+                               BVHRayPacket &packet, uint64_t *occluded) {
+    struct PacketToVisit {
+        int nodeIndex;
+        uint64_t rayMask;
+    };
+    PacketToVisit nodesToVisit[64];
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    uint64_t rayMask = packet.AllRays();
+    int nodesVisited = 0;
+    while (true) {
+        rayMask &= ~*occluded;
+        // Find the rays in the packet that hit the current node's bounds
+        uint64_t hitMask = 0;
+        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (rayMask) {
+            ++nodesVisited;
+            for (uint64_t m = rayMask; m; m &= m - 1) {
+                int r = LowestSetBit(m);
+                if (node->bounds.IntersectP(packet.ray[r]->o, packet.ray[r]->d,
+                                            packet.tMax[r], packet.invDir[r],
+                                            packet.dirIsNeg[r]))
+                    hitMask |= uint64_t(1) << r;
+            }
+        }
+
+        if (hitMask && node->nPrimitives == 0) {
+            // Order children using the direction of the first active ray
+            int lead = LowestSetBit(hitMask);
+            if (packet.dirIsNeg[lead][node->axis]) {
+                nodesToVisit[toVisitOffset++] = {currentNodeIndex + 1, hitMask};
+                currentNodeIndex = node->secondChildOffset;
+            } else {
+                nodesToVisit[toVisitOffset++] = {node->secondChildOffset, hitMask};
+                currentNodeIndex = currentNodeIndex + 1;
+            }
+            rayMask = hitMask;
+            continue;
+        }
+        if (hitMask) {
+            IntersectLeafPacket(primitives, triangleVertices, node->primitivesOffset,
+                                node->nPrimitives, hitMask, packet, occluded);
+            if ((*occluded & packet.AllRays()) == packet.AllRays())
+                break;
+        }
+
+        if (toVisitOffset == 0)
+            break;
+        --toVisitOffset;
+        currentNodeIndex = nodesToVisit[toVisitOffset].nodeIndex;
+        rayMask = nodesToVisit[toVisitOffset].rayMask;
+    }
+
+    bvhNodesVisited += nodesVisited;
+}
+
+template <typename Node>
+static void IntersectPacketWideBVH(const Node *nodes,
+                                   const std::vector<PrimitiveHandle> &primitives,
+                                   const BVHTriangleVertices *triangleVertices,
+                                   BVHRayPacket &packet, uint64_t *occluded) {
+    constexpr int N = Node::Width;
+    float o[BVHRayPacket::MaxRays][3], invDir[BVHRayPacket::MaxRays][3];
+    for (int r = 0; r < packet.n; ++r)
+        for (int c = 0; c < 3; ++c) {
+            o[r][c] = packet.ray[r]->o[c];
+            invDir[r][c] = packet.invDir[r][c];
+        }
+
+    struct PacketToVisit {
+        int offset;
+        int nPrimitives;  // 0 -> interior node
+        float tLead;
+        uint64_t rayMask;
+    };
+    PacketToVisit nodesToVisit[64 * (N - 1) + 1];
+    int toVisitOffset = 0;
+    nodesToVisit[toVisitOffset++] = {0, 0, 0.f, packet.AllRays()};
+    int nodesVisited = 0;
+    while (toVisitOffset > 0) {
+        PacketToVisit entry = nodesToVisit[--toVisitOffset];
+        entry.rayMask &= ~*occluded;
+        if (!entry.rayMask)
+            continue;
+        if (entry.nPrimitives > 0) {
+            IntersectLeafPacket(primitives, triangleVertices, entry.offset,
+                                entry.nPrimitives, entry.rayMask, packet, occluded);
+            if ((*occluded & packet.AllRays()) == packet.AllRays())
+                break;
+            continue;
+        }
+
+        // Accumulate per-child masks of the rays that hit each child's bounds
+        ++nodesVisited;
+        const Node &node = nodes[entry.offset];
+        uint64_t childMask[N] = {};
+        float tLead[N];
+        for (uint64_t m = entry.rayMask; m; m &= m - 1) {
+            int r = LowestSetBit(m);
+            float tEntry[N];
+            int hitMask = node.IntersectP(o[r], invDir[r], packet.dirIsNeg[r],
+                                          float(packet.tMax[r]), tEntry);
+            for (int c = 0; c < N; ++c)
+                if (hitMask & (1 << c)) {
+                    if (!childMask[c])
+                        tLead[c] = tEntry[c];
+                    childMask[c] |= uint64_t(1) << r;
+                }
+        }
+
+        // Push hit children so that the nearest one for the lead ray is next
+        int first = toVisitOffset;
+        for (int c = 0; c < N; ++c) {
+            if (!childMask[c])
+                continue;
+            PacketToVisit child{node.ChildOffset(c), node.ChildPrimitives(c), tLead[c],
+                                childMask[c]};
+            int j = toVisitOffset++;
+            while (j > first && nodesToVisit[j - 1].tLead < child.tLead) {
+                nodesToVisit[j] = nodesToVisit[j - 1];
+                --j;
+            }
+            nodesToVisit[j] = child;
+        }
+    }
+
+    bvhNodesVisited += nodesVisited;
+}
+
+// Parallel BVH Build Helpers
+// Nodes with at least this many primitives compute their bounds, SAH buckets,
+// and partition in parallel; smaller nodes use the serial code paths.
+static constexpr int ParallelBinningThreshold = 64 * 1024;
+static constexpr int ParallelBinningChunkSize = 16 * 1024;
+// Subtrees with at least this many primitives are built as separate tasks.
+static constexpr int ParallelSubtreeThreshold = 4 * 1024;
+
+template <typename T, typename F, typename C>
+static T ParallelBuildReduce(int start, int end, F func, C combine) {
+    if (end - start < ParallelBinningThreshold)
+        return func(start, end);
+    // Compute partial results in fixed-size chunks and combine them in order
+    // so that the result doesn't depend on thread scheduling
+    int nChunks = (end - start + ParallelBinningChunkSize - 1) / ParallelBinningChunkSize;
+    std::vector<T> partial(nChunks);
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        int chunkStart = start + c * ParallelBinningChunkSize;
+        int chunkEnd = std::min(end, chunkStart + ParallelBinningChunkSize);
+        partial[c] = func(chunkStart, chunkEnd);
+    });
+    T result = partial[0];
+    for (int c = 1; c < nChunks; ++c)
+        result = combine(result, partial[c]);
+    return result;
+}
+
+template <typename P>
+static int ParallelBuildPartition(std::vector<BVHPrimitiveInfo> &primitiveInfo,
+                                  int start, int end, P pred) {
+    if (end - start < ParallelBinningThreshold)
+        return std::partition(&primitiveInfo[start], &primitiveInfo[end - 1] + 1, pred) -
+               &primitiveInfo[0];
+
+    // Count primitives that satisfy _pred_ in each chunk
+    int nChunks = (end - start + ParallelBinningChunkSize - 1) / ParallelBinningChunkSize;
+    std::vector<int> chunkBelow(nChunks);
+    auto chunkRange = [&](int c) {
+        int chunkStart = start + c * ParallelBinningChunkSize;
+        return std::make_pair(chunkStart,
+                              std::min(end, chunkStart + ParallelBinningChunkSize));
+    };
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        int count = 0;
+        for (int i = chunkRange(c).first; i < chunkRange(c).second; ++i)
+            count += pred(primitiveInfo[i]) ? 1 : 0;
+        chunkBelow[c] = count;
+    });
+
+    // Compute each chunk's output offsets and scatter primitives stably
+    std::vector<int> belowOffset(nChunks), aboveOffset(nChunks);
+    int nBelow = 0;
+    for (int c = 0; c < nChunks; ++c) {
+        belowOffset[c] = nBelow;
+        nBelow += chunkBelow[c];
+    }
+    for (int c = 0, nAbove = 0; c < nChunks; ++c) {
+        aboveOffset[c] = nBelow + nAbove;
+        nAbove += (chunkRange(c).second - chunkRange(c).first) - chunkBelow[c];
+    }
+    std::vector<BVHPrimitiveInfo> scattered(end - start);
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        int below = belowOffset[c], above = aboveOffset[c];
+        for (int i = chunkRange(c).first; i < chunkRange(c).second; ++i)
+            scattered[pred(primitiveInfo[i]) ? below++ : above++] = primitiveInfo[i];
+    });
+    ParallelFor(0, nChunks, [&](int64_t c) {
+        std::copy(&scattered[chunkRange(c).first - start],
+                  &scattered[chunkRange(c).second - start - 1] + 1,
+                  &primitiveInfo[chunkRange(c).first]);
+    });
+    return start + nBelow;
+}
+
+// BVH Cache Definitions
+// BVHs with fewer primitives than this are quicker to rebuild than to cache.
+static constexpr size_t MinCachedBVHPrimitives = 64 * 1024;
+static constexpr char BVHCacheMagic[8] = "pbrtbvh";
+static constexpr uint32_t BVHCacheVersion = 2;
+
+struct BVHCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t floatSize;
+    uint64_t key;
+    uint64_t nodeSize, nNodes, nPrimitives;
+    // The ordered primitive indices follow the header; nodes start at a
+    // 64-byte aligned offset so that they can be used in place.
+    uint64_t nodesOffset;
+    Bounds3f bounds;
+    // Hash of everything after the header, to detect corrupt files.
+    uint64_t checksum;
+};
+
+// BVH SAH Cost Constants
+// Costs of visiting a node and of intersecting a primitive, which the SAH
+// and SBVH builds use to decide whether to split a node or make a leaf.
+static constexpr Float BVHTraversalCost = 1;
+static constexpr Float BVHIntersectionCost = 1;
+
+// SBVH Build Constants
+// Spatial splits are only considered where the best object split's children
+// overlap by more than this fraction of the scene's surface area.
+static constexpr Float SpatialSplitOverlapThreshold = 1e-5f;
+static constexpr int nSpatialSplitBins = 16;
+// Spatial splits are only considered for nodes above this depth; below it,
+// nodes are split by object only, so references are no longer duplicated.
+static constexpr int MaxSpatialSplitDepth = 48;
+
 // BVHAccel Method Definitions
 BVHAccel::BVHAccel(std::vector<PrimitiveHandle> p, int maxPrimsInNode,
-                   SplitMethod splitMethod)
+                   SplitMethod splitMethod, int width, Float spatialSplitBudget,
+                   bool compressed)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)),
       splitMethod(splitMethod),
-      primitives(std::move(p)) {
+      primitives(std::move(p)),
+      width(width),
+      compressed(compressed) {
     CHECK(!primitives.empty());
+    CHECK(width == 2 || width == 4 || width == 8);
+    CHECK(!compressed || width > 2);
+    Timer timer;
     // Build BVH from _primitives_
     // Initialize _primitiveInfo_ array for primitives
     std::vector<BVHPrimitiveInfo> primitiveInfo(primitives.size());
-    for (size_t i = 0; i < primitives.size(); ++i)
-        primitiveInfo[i] = {i, primitives[i].Bounds()};
+    ParallelFor(0, primitives.size(), [&](int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; ++i)
+            primitiveInfo[i] = {size_t(i), primitives[i].Bounds()};
+    });
+    double boundsSeconds = timer.ElapsedSeconds();
+
+    // Look for a previously built BVH for these primitives in the BVH cache
+    std::string cacheFilename;
+    uint64_t cacheKey = 0;
+    std::vector<PrimitiveHandle> inputPrimitives;
+    if (!Options->bvhCacheDirectory.empty() && splitMethod != SplitMethod::SBVH &&
+        primitives.size() >= MinCachedBVHPrimitives) {
+        cacheKey = computeCacheKey(primitiveInfo);
+        cacheFilename = StringPrintf("%s/bvh-%016llx.bin", Options->bvhCacheDirectory,
+                                     (unsigned long long)cacheKey);
+        if (readCache(cacheFilename, cacheKey)) {
+            ++bvhCacheHits;
+            LOG_VERBOSE("Loaded BVH for %d primitives from cache file %s",
+                        (int)primitives.size(), cacheFilename);
+            gatherTriangleVertices();
+            reportBuildTime(boundsSeconds, 0, timer.ElapsedSeconds() - boundsSeconds);
+            return;
+        }
+        inputPrimitives = primitives;
+    }
 
     // Build BVH tree for primitives using _primitiveInfo_
     // These need to survive until we've built the compact BVH...
@@ -163,6 +1149,22 @@ BVHAccel::BVHAccel(std::vector<PrimitiveHandle> p, int maxPrimsInNode,
     BVHBuildNode *root;
     if (splitMethod == SplitMethod::HLBVH) {
         root = HLBVHBuild(alloc, primitiveInfo, &totalNodes, orderedPrims);
+    } else if (splitMethod == SplitMethod::SBVH) {
+        // Build SBVH, allowing up to _spatialSplitBudget_ additional references
+        int maxSplitReferences = int(spatialSplitBudget * primitives.size());
+        std::atomic<int> splitBudget{maxSplitReferences};
+        std::atomic<int> orderedPrimsOffset{0};
+        orderedPrims.resize(primitives.size() + maxSplitReferences);
+        Bounds3f rootBounds;
+        for (const BVHPrimitiveInfo &pi : primitiveInfo)
+            rootBounds = Union(rootBounds, pi.bounds);
+        root = sbvhBuild(threadAllocators, std::move(primitiveInfo),
+                         rootBounds.SurfaceArea(), 0, &splitBudget, &totalNodes,
+                         orderedPrims, &orderedPrimsOffset);
+        orderedPrims.resize(orderedPrimsOffset);
+        LOG_VERBOSE("SBVH spatial splits added %d references to %d primitives",
+                    int(orderedPrims.size() - primitives.size()),
+                    (int)primitives.size());
     } else {
         std::atomic<int> orderedPrimsOffset{0};
         root = recursiveBuild(threadAllocators, primitiveInfo, 0, primitives.size(),
@@ -172,22 +1174,275 @@ BVHAccel::BVHAccel(std::vector<PrimitiveHandle> p, int maxPrimsInNode,
 
     primitives.swap(orderedPrims);
     primitiveInfo.resize(0);
-    LOG_VERBOSE("BVH created with %d nodes for %d primitives (%.2f MB)",
-                totalNodes.load(), (int)primitives.size(),
-                float(totalNodes.load() * sizeof(LinearBVHNode)) / (1024.f * 1024.f));
-
-    // Compute representation of depth-first traversal of BVH tree
-    treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
-                 primitives.size() * sizeof(primitives[0]);
-    nodes = new LinearBVHNode[totalNodes];
-    int offset = 0;
-    flattenBVHTree(root, &offset);
-    CHECK_EQ(totalNodes.load(), offset);
+    bounds = root->bounds;
+    double treeSeconds = timer.ElapsedSeconds() - boundsSeconds;
+
+    if (width > 2) {
+        // Collapse binary BVH into wide BVH nodes
+        if (compressed && width == 4)
+            quantizedNodes4 = CreateQuantizedBVHNodes<4>(root, primitives, &nNodes);
+        else if (compressed)
+            quantizedNodes8 = CreateQuantizedBVHNodes<8>(root, primitives, &nNodes);
+        else if (width == 4)
+            nodes4 = CreateWideBVHNodes<4>(root, &nNodes);
+        else
+            nodes8 = CreateWideBVHNodes<8>(root, &nNodes);
+        LOG_VERBOSE("%d-wide %sBVH created with %d nodes for %d primitives (%.2f MB)",
+                    width, compressed ? "compressed " : "", nNodes,
+                    (int)primitives.size(), float(nodeBytes()) / (1024.f * 1024.f));
+    } else {
+        LOG_VERBOSE("BVH created with %d nodes for %d primitives (%.2f MB)",
+                    totalNodes.load(), (int)primitives.size(),
+                    float(totalNodes.load() * sizeof(LinearBVHNode)) / (1024.f * 1024.f));
+
+        // Compute representation of depth-first traversal of BVH tree
+        nNodes = totalNodes;
+        nodes = new LinearBVHNode[totalNodes];
+        int offset = 0;
+        flattenBVHTree(root, &offset);
+        CHECK_EQ(totalNodes.load(), offset);
+    }
+    bvhNodeBytes += nodeBytes();
+    treeBytes +=
+        nodeBytes() + sizeof(*this) + primitives.size() * sizeof(primitives[0]);
+    gatherTriangleVertices();
+
+    if (!cacheFilename.empty())
+        writeCache(cacheFilename, cacheKey, inputPrimitives);
+    reportBuildTime(boundsSeconds, treeSeconds,
+                    timer.ElapsedSeconds() - boundsSeconds - treeSeconds);
+}
+
+void BVHAccel::gatherTriangleVertices() {
+    if (sizeof(Float) != sizeof(float))
+        return;
+    // Find the triangle shape, if any, for each primitive
+    std::vector<const Triangle *> triangles(primitives.size());
+    bool haveTriangles = false;
+    for (size_t i = 0; i < primitives.size(); ++i) {
+        ShapeHandle shape = nullptr;
+        if (primitives[i].Is<SimplePrimitive>())
+            shape = primitives[i].Cast<SimplePrimitive>()->GetShape();
+        else if (primitives[i].Is<GeometricPrimitive>())
+            shape = primitives[i].Cast<GeometricPrimitive>()->GetShape();
+        else if (primitives[i].Is<TrianglePrimitive>()) {
+            triangles[i] = primitives[i].Cast<TrianglePrimitive>()->GetTriangle();
+            haveTriangles = true;
+        }
+        if (shape && shape.Is<Triangle>()) {
+            triangles[i] = shape.Cast<Triangle>();
+            haveTriangles = true;
+        }
+    }
+    if (!haveTriangles)
+        return;
+
+    // Copy triangle vertices to SoA arrays, padded with NaNs
+    triangleVertices = new BVHTriangleVertices;
+    triangleVertices->stride = primitives.size() + TriangleBatchWidth;
+    size_t nFloats = 9 * triangleVertices->stride;
+    triangleVertices->p.reset(new float[nFloats]);
+    std::fill(triangleVertices->p.get(), triangleVertices->p.get() + nFloats,
+              std::numeric_limits<float>::quiet_NaN());
+    ParallelFor(0, primitives.size(), [&](int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; ++i) {
+            if (!triangles[i])
+                continue;
+            pstd::array<Point3f, 3> p = triangles[i]->Vertices();
+            for (int v = 0; v < 3; ++v)
+                for (int c = 0; c < 3; ++c)
+                    triangleVertices->Component(v, c)[i] = p[v][c];
+        }
+    });
+    triangleVertexBytes += nFloats * sizeof(float);
+}
+
+size_t BVHAccel::nodeBytes() const {
+    if (nodes4)
+        return nNodes * sizeof(WideBVHNode<4>);
+    if (nodes8)
+        return nNodes * sizeof(WideBVHNode<8>);
+    if (quantizedNodes4)
+        return nNodes * sizeof(QuantizedBVHNode<4>);
+    if (quantizedNodes8)
+        return nNodes * sizeof(QuantizedBVHNode<8>);
+    return nNodes * sizeof(LinearBVHNode);
+}
+
+const void *BVHAccel::nodeData() const {
+    if (nodes4)
+        return nodes4;
+    if (nodes8)
+        return nodes8;
+    if (quantizedNodes4)
+        return quantizedNodes4;
+    if (quantizedNodes8)
+        return quantizedNodes8;
+    return nodes;
+}
+
+uint64_t BVHAccel::computeCacheKey(
+    const std::vector<BVHPrimitiveInfo> &primitiveInfo) const {
+    // Hash primitive bounds, which fully determine the BVH for non-spatial splits
+    uint64_t boundsHash = ParallelBuildReduce<uint64_t>(
+        0, primitiveInfo.size(),
+        [&](int start, int end) {
+            uint64_t hash = 0;
+            for (int i = start; i < end; ++i)
+                hash = HashBuffer(&primitiveInfo[i].bounds, sizeof(Bounds3f), hash);
+            return hash;
+        },
+        [](uint64_t a, uint64_t b) { return Hash(a, b); });
+    return Hash(boundsHash, uint64_t(primitiveInfo.size()), int(splitMethod),
+                maxPrimsInNode, width, compressed, BVHCacheVersion);
+}
+
+bool BVHAccel::readCache(const std::string &filename, uint64_t key) {
+    // Map BVH cache file into memory
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat stat;
+    if (fstat(fd, &stat) != 0 || size_t(stat.st_size) < sizeof(BVHCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t length = stat.st_size;
+    void *ptr = mmap(nullptr, length, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+    const char *data = (const char *)ptr;
+    auto release = [=]() { munmap(ptr, length); };
+#else
+    // Check that the file exists first, since ReadFileContents() exits on failure
+    if (FILE *f = fopen(filename.c_str(), "rb"))
+        fclose(f);
+    else
+        return false;
+    std::string contents = ReadFileContents(filename);
+    size_t length = contents.size();
+    if (length < sizeof(BVHCacheHeader))
+        return false;
+    // Copy file into memory aligned for the BVH nodes
+    char *data = (char *)::operator new(length, std::align_val_t(64));
+    std::copy(contents.begin(), contents.end(), data);
+    auto release = [=]() { ::operator delete(data, std::align_val_t(64)); };
+#endif
+
+    // Validate BVH cache file header
+    BVHCacheHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    size_t nodeSize = (width == 2)                  ? sizeof(LinearBVHNode)
+                      : (compressed && width == 4) ? sizeof(QuantizedBVHNode<4>)
+                      : compressed                 ? sizeof(QuantizedBVHNode<8>)
+                      : (width == 4)               ? sizeof(WideBVHNode<4>)
+                                                   : sizeof(WideBVHNode<8>);
+    size_t indicesOffset = sizeof(BVHCacheHeader);
+    if (std::memcmp(header.magic, BVHCacheMagic, sizeof(header.magic)) != 0 ||
+        header.version != BVHCacheVersion || header.key != key ||
+        header.floatSize != sizeof(Float) || header.nodeSize != nodeSize ||
+        header.nPrimitives != primitives.size() || header.nodesOffset % 64 != 0 ||
+        header.nodesOffset < indicesOffset + header.nPrimitives * sizeof(int32_t) ||
+        header.nodesOffset + header.nNodes * nodeSize != length ||
+        header.checksum != HashBuffer(data + indicesOffset, length - indicesOffset)) {
+        Warning("%s: ignoring stale or corrupt BVH cache file.", filename);
+        release();
+        return false;
+    }
+
+    // Reorder primitives and point to the node array in the mapped file
+    const int32_t *primitiveIndices = (const int32_t *)(data + indicesOffset);
+    std::vector<PrimitiveHandle> orderedPrims(primitives.size());
+    for (size_t i = 0; i < orderedPrims.size(); ++i) {
+        int32_t index = primitiveIndices[i];
+        if (index < 0 || size_t(index) >= primitives.size()) {
+            Warning("%s: ignoring corrupt BVH cache file.", filename);
+            release();
+            return false;
+        }
+        orderedPrims[i] = primitives[index];
+    }
+    primitives.swap(orderedPrims);
+
+    bounds = header.bounds;
+    nNodes = header.nNodes;
+    void *nodeData = const_cast<char *>(data) + header.nodesOffset;
+    if (width == 2)
+        nodes = (LinearBVHNode *)nodeData;
+    else if (compressed && width == 4)
+        quantizedNodes4 = (QuantizedBVHNode<4> *)nodeData;
+    else if (compressed)
+        quantizedNodes8 = (QuantizedBVHNode<8> *)nodeData;
+    else if (width == 4)
+        nodes4 = (WideBVHNode<4> *)nodeData;
+    else
+        nodes8 = (WideBVHNode<8> *)nodeData;
+    bvhNodeBytes += nodeBytes();
+    treeBytes +=
+        nodeBytes() + sizeof(*this) + primitives.size() * sizeof(primitives[0]);
+    return true;
+}
+
+void BVHAccel::writeCache(const std::string &filename, uint64_t key,
+                          const std::vector<PrimitiveHandle> &inputPrimitives) const {
+    // Initialize BVH cache file header
+    BVHCacheHeader header;
+    std::memcpy(header.magic, BVHCacheMagic, sizeof(header.magic));
+    header.version = BVHCacheVersion;
+    header.floatSize = sizeof(Float);
+    header.key = key;
+    header.nodeSize = nodeBytes() / nNodes;
+    header.nNodes = nNodes;
+    header.nPrimitives = primitives.size();
+    header.bounds = bounds;
+    size_t indicesOffset = sizeof(BVHCacheHeader);
+    header.nodesOffset =
+        (indicesOffset + primitives.size() * sizeof(int32_t) + 63) & ~size_t(63);
+
+    // Record the order of _primitives_ as indices into _inputPrimitives_
+    std::unordered_map<const void *, int32_t> inputIndex;
+    for (size_t i = 0; i < inputPrimitives.size(); ++i)
+        inputIndex[inputPrimitives[i].ptr()] = i;
+    std::string contents(header.nodesOffset + nodeBytes(), '\0');
+    int32_t *primitiveIndices = (int32_t *)&contents[indicesOffset];
+    for (size_t i = 0; i < primitives.size(); ++i)
+        primitiveIndices[i] = inputIndex[primitives[i].ptr()];
+    std::memcpy(&contents[header.nodesOffset], nodeData(), nodeBytes());
+    header.checksum =
+        HashBuffer(&contents[indicesOffset], contents.size() - indicesOffset);
+    std::memcpy(&contents[0], &header, sizeof(header));
+
+    // Write to a temporary file and rename it so readers never see partial
+    // files. The temporary file's name is unique so that processes and
+    // threads that share the cache directory don't write to the same one.
+    static std::atomic<uint64_t> tempFileCounter{0};
+    uint64_t nonce = Hash(std::random_device()(), std::random_device()(),
+                          tempFileCounter++, &header);
+    std::string tempFilename =
+        StringPrintf("%s.%016llx.tmp", filename, (unsigned long long)nonce);
+    if (!WriteFile(tempFilename, contents) ||
+        std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to write BVH cache file: %s", filename, ErrorString());
+        std::remove(tempFilename.c_str());
+    } else
+        LOG_VERBOSE("Wrote BVH cache file %s (%.2f MB)", filename,
+                    float(contents.size()) / (1024.f * 1024.f));
+}
+
+void BVHAccel::reportBuildTime(double boundsSeconds, double treeSeconds,
+                               double flattenSeconds) const {
+    double totalSeconds = boundsSeconds + treeSeconds + flattenSeconds;
+    bvhBuildMilliseconds += int64_t(1000 * totalSeconds);
+    LOG_VERBOSE("BVH build for %d primitives took %.3fs on %d threads (primitive "
+                "bounds %.3fs, tree %.3fs, flattening %.3fs)",
+                (int)primitives.size(), totalSeconds, RunningThreads(), boundsSeconds,
+                treeSeconds, flattenSeconds);
 }
 
 Bounds3f BVHAccel::Bounds() const {
-    CHECK(nodes != nullptr);
-    return nodes[0].bounds;
+    return bounds;
 }
 
 BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Allocator> &threadAllocators,
@@ -199,10 +1454,23 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Allocator> &threadAllocators,
     Allocator alloc = threadAllocators[ThreadIndex];
     BVHBuildNode *node = alloc.new_object<BVHBuildNode>();
     (*totalNodes)++;
-    // Compute bounds of all primitives in BVH node
-    Bounds3f bounds;
-    for (int i = start; i < end; ++i)
-        bounds = Union(bounds, primitiveInfo[i].bounds);
+    // Compute bounds of all primitives and their centroids in BVH node
+    Bounds3f bounds, centroidBounds;
+    std::tie(bounds, centroidBounds) =
+        ParallelBuildReduce<std::pair<Bounds3f, Bounds3f>>(
+            start, end,
+            [&](int s, int e) {
+                std::pair<Bounds3f, Bounds3f> b;
+                for (int i = s; i < e; ++i) {
+                    b.first = Union(b.first, primitiveInfo[i].bounds);
+                    b.second = Union(b.second, primitiveInfo[i].centroid);
+                }
+                return b;
+            },
+            [](const std::pair<Bounds3f, Bounds3f> &a,
+               const std::pair<Bounds3f, Bounds3f> &b) {
+                return std::make_pair(Union(a.first, b.first), Union(a.second, b.second));
+            });
 
     int nPrimitives = end - start;
     if (bounds.SurfaceArea() == 0 || nPrimitives == 1) {
@@ -216,10 +1484,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Allocator> &threadAllocators,
         return node;
 
     } else {
-        // Compute bound of primitive centroids, choose split dimension _dim_
-        Bounds3f centroidBounds;
-        for (int i = start; i < end; ++i)
-            centroidBounds = Union(centroidBounds, primitiveInfo[i].centroid);
+        // Choose split dimension _dim_
         int dim = centroidBounds.MaxDimension();
 
         // Partition primitives into two sets and build children
@@ -240,12 +1505,10 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Allocator> &threadAllocators,
             case SplitMethod::Middle: {
                 // Partition primitives through node's midpoint
                 Float pmid = (centroidBounds.pMin[dim] + centroidBounds.pMax[dim]) / 2;
-                BVHPrimitiveInfo *midPtr =
-                    std::partition(&primitiveInfo[start], &primitiveInfo[end - 1] + 1,
-                                   [dim, pmid](const BVHPrimitiveInfo &pi) {
-                                       return pi.centroid[dim] < pmid;
-                                   });
-                mid = midPtr - &primitiveInfo[0];
+                mid = ParallelBuildPartition(primitiveInfo, start, end,
+                                             [dim, pmid](const BVHPrimitiveInfo &pi) {
+                                                 return pi.centroid[dim] < pmid;
+                                             });
                 // For lots of prims with large overlapping bounding boxes, this
                 // may fail to partition; in that case don't break and fall through
                 // to EqualCounts.
@@ -280,20 +1543,36 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Allocator> &threadAllocators,
                 } else {
                     // Allocate _BucketInfo_ for SAH partition buckets
                     constexpr int nBuckets = 12;
-                    BucketInfo buckets[nBuckets];
-
-                    // Initialize _BucketInfo_ for SAH partition buckets
-                    for (int i = start; i < end; ++i) {
-                        int b = nBuckets *
-                                centroidBounds.Offset(primitiveInfo[i].centroid)[dim];
+                    using Buckets = std::array<BucketInfo, nBuckets>;
+                    auto bucketIndex = [=](const BVHPrimitiveInfo &pi) {
+                        int b = nBuckets * centroidBounds.Offset(pi.centroid)[dim];
                         if (b == nBuckets)
                             b = nBuckets - 1;
                         DCHECK_GE(b, 0);
                         DCHECK_LT(b, nBuckets);
-                        buckets[b].count++;
-                        buckets[b].bounds =
-                            Union(buckets[b].bounds, primitiveInfo[i].bounds);
-                    }
+                        return b;
+                    };
+
+                    // Initialize _BucketInfo_ for SAH partition buckets
+                    Buckets buckets = ParallelBuildReduce<Buckets>(
+                        start, end,
+                        [&](int s, int e) {
+                            Buckets b;
+                            for (int i = s; i < e; ++i) {
+                                BucketInfo &bucket = b[bucketIndex(primitiveInfo[i])];
+                                bucket.count++;
+                                bucket.bounds = Union(bucket.bounds, primitiveInfo[i].bounds);
+                            }
+                            return b;
+                        },
+                        [](const Buckets &a, const Buckets &b) {
+                            Buckets sum;
+                            for (int i = 0; i < nBuckets; ++i) {
+                                sum[i].count = a[i].count + b[i].count;
+                                sum[i].bounds = Union(a[i].bounds, b[i].bounds);
+                            }
+                            return sum;
+                        });
 
                     // Compute costs for splitting after each bucket
                     int minCostSplitBucket = -1;
@@ -328,21 +1607,16 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Allocator> &threadAllocators,
                             minCostSplitBucket = i;
                         }
                     }
-                    minCost = 1 + minCost / bounds.SurfaceArea();
+                    minCost = BVHTraversalCost +
+                              BVHIntersectionCost * minCost / bounds.SurfaceArea();
 
                     // Either create leaf or split primitives at selected SAH bucket
-                    Float leafCost = nPrimitives;
+                    Float leafCost = BVHIntersectionCost * nPrimitives;
                     if (nPrimitives > maxPrimsInNode || minCost < leafCost) {
-                        BVHPrimitiveInfo *pmid = std::partition(
-                            &primitiveInfo[start], &primitiveInfo[end - 1] + 1,
-                            [=](const BVHPrimitiveInfo &pi) {
-                                int b =
-                                    nBuckets * centroidBounds.Offset(pi.centroid)[dim];
-                                if (b == nBuckets)
-                                    b = nBuckets - 1;
-                                return b <= minCostSplitBucket;
+                        mid = ParallelBuildPartition(
+                            primitiveInfo, start, end, [=](const BVHPrimitiveInfo &pi) {
+                                return bucketIndex(pi) <= minCostSplitBucket;
                             });
-                        mid = pmid - &primitiveInfo[0];
                     } else {
                         // Create leaf _BVHBuildNode_
                         int firstPrimOffset = orderedPrimsOffset->fetch_add(nPrimitives);
@@ -361,7 +1635,7 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Allocator> &threadAllocators,
             }
 
             BVHBuildNode *children[2];
-            if (end - start > 1024 * 1024) {
+            if (end - start >= ParallelSubtreeThreshold) {
                 ParallelFor(0, 2, [&](int i) {
                     if (i == 0)
                         children[0] =
@@ -386,6 +1660,272 @@ BVHBuildNode *BVHAccel::recursiveBuild(std::vector<Allocator> &threadAllocators,
     return node;
 }
 
+Bounds3f BVHAccel::clipReference(const BVHPrimitiveInfo &ref, const Bounds3f &slab) const {
+    Bounds3f clip = pbrt::Intersect(ref.bounds, slab);
+    if (clip.IsDegenerate())
+        return {};
+    // Clip triangles exactly; bound other primitives by their clipped bounds
+    PrimitiveHandle prim = primitives[ref.primitiveNumber];
+    ShapeHandle shape = nullptr;
+    if (prim.Is<SimplePrimitive>())
+        shape = prim.Cast<SimplePrimitive>()->GetShape();
+    else if (prim.Is<GeometricPrimitive>())
+        shape = prim.Cast<GeometricPrimitive>()->GetShape();
+    else if (prim.Is<TrianglePrimitive>())
+        return prim.Cast<TrianglePrimitive>()->GetTriangle()->ClippedBounds(clip);
+    if (shape && shape.Is<Triangle>())
+        return shape.Cast<Triangle>()->ClippedBounds(clip);
+    return clip;
+}
+
+BVHBuildNode *BVHAccel::sbvhBuild(std::vector<Allocator> &threadAllocators,
+                                  std::vector<BVHPrimitiveInfo> refs,
+                                  Float rootSurfaceArea, int depth,
+                                  std::atomic<int> *splitBudget,
+                                  std::atomic<int> *totalNodes,
+                                  std::vector<PrimitiveHandle> &orderedPrims,
+                                  std::atomic<int> *orderedPrimsOffset) {
+    DCHECK(!refs.empty());
+    Allocator alloc = threadAllocators[ThreadIndex];
+    BVHBuildNode *node = alloc.new_object<BVHBuildNode>();
+    (*totalNodes)++;
+    // Compute bounds of all references and their centroids in SBVH node
+    Bounds3f bounds, centroidBounds;
+    for (const BVHPrimitiveInfo &ref : refs) {
+        bounds = Union(bounds, ref.bounds);
+        centroidBounds = Union(centroidBounds, ref.centroid);
+    }
+
+    int nPrimitives = refs.size();
+    auto createLeaf = [&]() {
+        int firstPrimOffset = orderedPrimsOffset->fetch_add(nPrimitives);
+        for (int i = 0; i < nPrimitives; ++i)
+            orderedPrims[firstPrimOffset + i] = primitives[refs[i].primitiveNumber];
+        node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
+        return node;
+    };
+    if (bounds.SurfaceArea() == 0 || nPrimitives == 1)
+        return createLeaf();
+
+    // Find best object split using binned SAH over reference centroids
+    constexpr int nBuckets = 12;
+    int objectDim = centroidBounds.MaxDimension();
+    auto bucketIndex = [&](const BVHPrimitiveInfo &ref) {
+        int b = nBuckets * centroidBounds.Offset(ref.centroid)[objectDim];
+        return std::min(b, nBuckets - 1);
+    };
+    int objectSplitBucket = -1;
+    Float objectCost = Infinity;
+    Bounds3f objectOverlap;
+    if (centroidBounds.pMax[objectDim] > centroidBounds.pMin[objectDim]) {
+        BucketInfo buckets[nBuckets];
+        for (const BVHPrimitiveInfo &ref : refs) {
+            BucketInfo &bucket = buckets[bucketIndex(ref)];
+            bucket.count++;
+            bucket.bounds = Union(bucket.bounds, ref.bounds);
+        }
+
+        int countAbove[nBuckets - 1];
+        Bounds3f boundsAbove[nBuckets - 1];
+        countAbove[nBuckets - 2] = buckets[nBuckets - 1].count;
+        boundsAbove[nBuckets - 2] = buckets[nBuckets - 1].bounds;
+        for (int i = nBuckets - 3; i >= 0; --i) {
+            countAbove[i] = countAbove[i + 1] + buckets[i + 1].count;
+            boundsAbove[i] = Union(boundsAbove[i + 1], buckets[i + 1].bounds);
+        }
+        int countBelow = 0;
+        Bounds3f boundsBelow;
+        for (int i = 0; i < nBuckets - 1; ++i) {
+            countBelow += buckets[i].count;
+            boundsBelow = Union(boundsBelow, buckets[i].bounds);
+            if (countBelow == 0 || countAbove[i] == 0)
+                continue;
+            Float cost = countBelow * boundsBelow.SurfaceArea() +
+                         countAbove[i] * boundsAbove[i].SurfaceArea();
+            if (cost < objectCost) {
+                objectCost = cost;
+                objectSplitBucket = i;
+                objectOverlap = pbrt::Intersect(boundsBelow, boundsAbove[i]);
+            }
+        }
+    }
+
+    // Find best spatial split if object split children overlap significantly
+    int spatialDim = -1;
+    Float spatialPosition = 0, spatialCost = Infinity;
+    bool overlapping = objectSplitBucket == -1 ||
+                       (!objectOverlap.IsDegenerate() &&
+                        objectOverlap.SurfaceArea() >
+                            SpatialSplitOverlapThreshold * rootSurfaceArea);
+    if (overlapping && depth < MaxSpatialSplitDepth && splitBudget->load() > 0) {
+        for (int dim = 0; dim < 3; ++dim) {
+            Float lo = bounds.pMin[dim], hi = bounds.pMax[dim];
+            if (hi <= lo)
+                continue;
+            // Compute bin bounds and entry and exit counts for spatial split bins
+            constexpr int nBins = nSpatialSplitBins;
+            Float binWidth = (hi - lo) / nBins;
+            auto binIndex = [=](Float x) {
+                return Clamp(int((x - lo) / binWidth), 0, nBins - 1);
+            };
+            auto binPlane = [=](int b) { return b == nBins ? hi : lo + b * binWidth; };
+            Bounds3f binBounds[nBins];
+            int entry[nBins] = {}, exit[nBins] = {};
+            for (const BVHPrimitiveInfo &ref : refs) {
+                int b0 = binIndex(ref.bounds.pMin[dim]), b1 = binIndex(ref.bounds.pMax[dim]);
+                entry[b0]++;
+                exit[b1]++;
+                if (b0 == b1) {
+                    binBounds[b0] = Union(binBounds[b0], ref.bounds);
+                    continue;
+                }
+                // Clip reference against each bin it overlaps
+                for (int b = b0; b <= b1; ++b) {
+                    Bounds3f slab = bounds;
+                    slab.pMin[dim] = binPlane(b);
+                    slab.pMax[dim] = binPlane(b + 1);
+                    Bounds3f clipped = clipReference(ref, slab);
+                    if (!clipped.IsDegenerate())
+                        binBounds[b] = Union(binBounds[b], clipped);
+                }
+            }
+
+            // Compute costs for splitting after each bin
+            int countAbove[nBins - 1];
+            Bounds3f boundsAbove[nBins - 1];
+            countAbove[nBins - 2] = exit[nBins - 1];
+            boundsAbove[nBins - 2] = binBounds[nBins - 1];
+            for (int i = nBins - 3; i >= 0; --i) {
+                countAbove[i] = countAbove[i + 1] + exit[i + 1];
+                boundsAbove[i] = Union(boundsAbove[i + 1], binBounds[i + 1]);
+            }
+            int countBelow = 0;
+            Bounds3f boundsBelow;
+            for (int i = 0; i < nBins - 1; ++i) {
+                countBelow += entry[i];
+                boundsBelow = Union(boundsBelow, binBounds[i]);
+                if (countBelow == 0 || countAbove[i] == 0)
+                    continue;
+                Float cost = countBelow * boundsBelow.SurfaceArea() +
+                             countAbove[i] * boundsAbove[i].SurfaceArea();
+                if (cost < spatialCost) {
+                    spatialCost = cost;
+                    spatialDim = dim;
+                    spatialPosition = binPlane(i + 1);
+                }
+            }
+        }
+    }
+
+    // Either create leaf or choose between object and spatial split
+    Float minCost = std::min(objectCost, spatialCost);
+    if (minCost == Infinity)
+        return createLeaf();
+    Float sahCost =
+        BVHTraversalCost + BVHIntersectionCost * minCost / bounds.SurfaceArea();
+    Float leafCost = BVHIntersectionCost * nPrimitives;
+    if (nPrimitives <= maxPrimsInNode && sahCost >= leafCost)
+        return createLeaf();
+
+    std::vector<BVHPrimitiveInfo> left, right;
+    int dim = objectDim;
+    if (spatialCost < objectCost) {
+        // Partition references at _spatialPosition_, duplicating straddling ones
+        Bounds3f leftBounds, rightBounds;
+        std::vector<int> straddling;
+        for (int i = 0; i < nPrimitives; ++i) {
+            if (refs[i].bounds.pMax[spatialDim] <= spatialPosition) {
+                left.push_back(refs[i]);
+                leftBounds = Union(leftBounds, refs[i].bounds);
+            } else if (refs[i].bounds.pMin[spatialDim] >= spatialPosition) {
+                right.push_back(refs[i]);
+                rightBounds = Union(rightBounds, refs[i].bounds);
+            } else
+                straddling.push_back(i);
+        }
+
+        // Reserve references for duplicates from the split budget
+        int nStraddling = straddling.size();
+        int nDuplicated = 0;
+        bool reserved = splitBudget->fetch_sub(nStraddling) >= nStraddling;
+        if (reserved) {
+            Bounds3f leftSlab = bounds, rightSlab = bounds;
+            leftSlab.pMax[spatialDim] = rightSlab.pMin[spatialDim] = spatialPosition;
+            for (int i : straddling) {
+                const BVHPrimitiveInfo &ref = refs[i];
+                Bounds3f lb = clipReference(ref, leftSlab);
+                Bounds3f rb = clipReference(ref, rightSlab);
+                // Put whole reference on one side if clipping leaves nothing on the other
+                if (lb.IsDegenerate() || rb.IsDegenerate()) {
+                    std::vector<BVHPrimitiveInfo> &side = lb.IsDegenerate() ? right : left;
+                    Bounds3f &sideBounds = lb.IsDegenerate() ? rightBounds : leftBounds;
+                    side.push_back(ref);
+                    sideBounds = Union(sideBounds, ref.bounds);
+                    continue;
+                }
+
+                // Unsplit reference if keeping it whole on one side is cheaper
+                int nLeft = left.size(), nRight = right.size();
+                Float splitCost = Union(leftBounds, lb).SurfaceArea() * (nLeft + 1) +
+                                  Union(rightBounds, rb).SurfaceArea() * (nRight + 1);
+                Float leftCost = Union(leftBounds, ref.bounds).SurfaceArea() * (nLeft + 1) +
+                                 (nRight ? rightBounds.SurfaceArea() * nRight : 0);
+                Float rightCost = (nLeft ? leftBounds.SurfaceArea() * nLeft : 0) +
+                                  Union(rightBounds, ref.bounds).SurfaceArea() * (nRight + 1);
+                if (leftCost <= splitCost && leftCost <= rightCost) {
+                    left.push_back(ref);
+                    leftBounds = Union(leftBounds, ref.bounds);
+                } else if (rightCost <= splitCost) {
+                    right.push_back(ref);
+                    rightBounds = Union(rightBounds, ref.bounds);
+                } else {
+                    left.push_back(BVHPrimitiveInfo(ref.primitiveNumber, lb));
+                    right.push_back(BVHPrimitiveInfo(ref.primitiveNumber, rb));
+                    leftBounds = Union(leftBounds, lb);
+                    rightBounds = Union(rightBounds, rb);
+                    ++nDuplicated;
+                }
+            }
+        }
+        // Return unused references to the budget; fall back to the object
+        // split if the spatial split couldn't be made
+        if (reserved && !left.empty() && !right.empty()) {
+            splitBudget->fetch_add(nStraddling - nDuplicated);
+            ++sbvhSpatialSplits;
+            dim = spatialDim;
+        } else {
+            splitBudget->fetch_add(nStraddling);
+            left.clear();
+            right.clear();
+        }
+    }
+    if (left.empty()) {
+        // Partition references using the object split
+        if (objectSplitBucket == -1)
+            return createLeaf();
+        for (const BVHPrimitiveInfo &ref : refs)
+            (bucketIndex(ref) <= objectSplitBucket ? left : right).push_back(ref);
+    }
+    refs.clear();
+    refs.shrink_to_fit();
+
+    // Build children of SBVH node
+    BVHBuildNode *children[2];
+    auto buildChild = [&](int i) {
+        children[i] = sbvhBuild(threadAllocators, std::move(i == 0 ? left : right),
+                                rootSurfaceArea, depth + 1, splitBudget, totalNodes,
+                                orderedPrims, orderedPrimsOffset);
+    };
+    if (nPrimitives >= ParallelSubtreeThreshold)
+        ParallelFor(0, 2, buildChild);
+    else {
+        buildChild(0);
+        buildChild(1);
+    }
+    node->InitInterior(dim, children[0], children[1]);
+    return node;
+}
+
 BVHBuildNode *BVHAccel::HLBVHBuild(Allocator alloc,
                                    const std::vector<BVHPrimitiveInfo> &primitiveInfo,
                                    std::atomic<int> *totalNodes,
@@ -524,10 +2064,21 @@ int BVHAccel::flattenBVHTree(BVHBuildNode *node, int *offset) {
 }
 
 pstd::optional<ShapeIntersection> BVHAccel::Intersect(const Ray &ray, Float tMax) const {
+    if (nodes4)
+        return IntersectWideBVH(nodes4, primitives, triangleVertices, ray, tMax);
+    if (nodes8)
+        return IntersectWideBVH(nodes8, primitives, triangleVertices, ray, tMax);
+    if (quantizedNodes4)
+        return IntersectWideBVH(quantizedNodes4, primitives, triangleVertices, ray,
+                                tMax);
+    if (quantizedNodes8)
+        return IntersectWideBVH(quantizedNodes8, primitives, triangleVertices, ray,
+                                tMax);
     if (nodes == nullptr)
         return {};
     pstd::optional<ShapeIntersection> si;
     Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    TriangleBatchRay batchRay(ray);
     int dirIsNeg[3] = {static_cast<int>(invDir.x < 0), static_cast<int>(invDir.y < 0),
                        static_cast<int>(invDir.z < 0)};
     // Follow ray through BVH nodes to find primitive intersections
@@ -541,14 +2092,17 @@ pstd::optional<ShapeIntersection> BVHAccel::Intersect(const Ray &ray, Float tMax
         if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
             if (node->nPrimitives > 0) {
                 // Intersect ray with primitives in leaf BVH node
-                for (int i = 0; i < node->nPrimitives; ++i) {
-                    pstd::optional<ShapeIntersection> primSi =
-                        primitives[node->primitivesOffset + i].Intersect(ray, tMax);
-                    if (primSi) {
-                        si = primSi;
-                        tMax = si->tHit;
-                    }
-                }
+                ForEachLeafCandidate(triangleVertices, &batchRay,
+                                     node->primitivesOffset, node->nPrimitives,
+                                     [&](int index) {
+                                         pstd::optional<ShapeIntersection> primSi =
+                                             primitives[index].Intersect(ray, tMax);
+                                         if (primSi) {
+                                             si = primSi;
+                                             tMax = si->tHit;
+                                         }
+                                         return false;
+                                     });
                 if (toVisitOffset == 0)
                     break;
                 currentNodeIndex = nodesToVisit[--toVisitOffset];
@@ -575,9 +2129,20 @@ pstd::optional<ShapeIntersection> BVHAccel::Intersect(const Ray &ray, Float tMax
 }
 
 bool BVHAccel::IntersectP(const Ray &ray, Float tMax) const {
+    if (nodes4)
+        return IntersectPWideBVH(nodes4, primitives, triangleVertices, ray, tMax);
+    if (nodes8)
+        return IntersectPWideBVH(nodes8, primitives, triangleVertices, ray, tMax);
+    if (quantizedNodes4)
+        return IntersectPWideBVH(quantizedNodes4, primitives, triangleVertices, ray,
+                                 tMax);
+    if (quantizedNodes8)
+        return IntersectPWideBVH(quantizedNodes8, primitives, triangleVertices, ray,
+                                 tMax);
     if (nodes == nullptr)
         return false;
     Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+    TriangleBatchRay batchRay(ray);
     int dirIsNeg[3] = {static_cast<int>(invDir.x < 0), static_cast<int>(invDir.y < 0),
                        static_cast<int>(invDir.z < 0)};
     int nodesToVisit[64];
@@ -590,11 +2155,14 @@ bool BVHAccel::IntersectP(const Ray &ray, Float tMax) const {
         if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
             // Process BVH node _node_ for traversal
             if (node->nPrimitives > 0) {
-                for (int i = 0; i < node->nPrimitives; ++i) {
-                    if (primitives[node->primitivesOffset + i].IntersectP(ray, tMax)) {
-                        bvhNodesVisited += nodesVisited;
-                        return true;
-                    }
+                if (ForEachLeafCandidate(triangleVertices, &batchRay,
+                                         node->primitivesOffset, node->nPrimitives,
+                                         [&](int index) {
+                                             return primitives[index].IntersectP(ray,
+                                                                                 tMax);
+                                         })) {
+                    bvhNodesVisited += nodesVisited;
+                    return true;
                 }
                 if (toVisitOffset == 0)
                     break;
@@ -619,6 +2187,60 @@ bool BVHAccel::IntersectP(const Ray &ray, Float tMax) const {
     return false;
 }
 
+void BVHAccel::IntersectPN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                           pstd::span<bool> occluded) const {
+    CHECK_EQ(rays.size(), tMax.size());
+    CHECK_EQ(rays.size(), occluded.size());
+    // Process the stream in blocks, grouping rays by direction octant so that
+    // each packet's rays share a traversal order
+    constexpr int BlockSize = 4 * BVHRayPacket::MaxRays;
+    for (size_t blockStart = 0; blockStart < rays.size(); blockStart += BlockSize) {
+        int blockRays = std::min<size_t>(BlockSize, rays.size() - blockStart);
+        int octantCount[8] = {}, octantStart[8];
+        auto octant = [&](int i) {
+            const Vector3f &d = rays[blockStart + i].d;
+            return int(d.x < 0) | (int(d.y < 0) << 1) | (int(d.z < 0) << 2);
+        };
+        for (int i = 0; i < blockRays; ++i)
+            ++octantCount[octant(i)];
+        for (int o = 0, sum = 0; o < 8; ++o) {
+            octantStart[o] = sum;
+            sum += octantCount[o];
+        }
+        int sorted[BlockSize];
+        int octantOffset[8];
+        std::copy(octantStart, octantStart + 8, octantOffset);
+        for (int i = 0; i < blockRays; ++i)
+            sorted[octantOffset[octant(i)]++] = blockStart + i;
+
+        for (int o = 0; o < 8; ++o)
+            for (int start = octantStart[o]; start < octantStart[o] + octantCount[o];
+                 start += BVHRayPacket::MaxRays) {
+                int n = std::min(BVHRayPacket::MaxRays,
+                                 octantStart[o] + octantCount[o] - start);
+                BVHRayPacket packet(rays, tMax, &sorted[start], n);
+                uint64_t occludedMask = 0;
+                if (nodes4)
+                    IntersectPacketWideBVH(nodes4, primitives, triangleVertices, packet,
+                                           &occludedMask);
+                else if (nodes8)
+                    IntersectPacketWideBVH(nodes8, primitives, triangleVertices, packet,
+                                           &occludedMask);
+                else if (quantizedNodes4)
+                    IntersectPacketWideBVH(quantizedNodes4, primitives, triangleVertices,
+                                           packet, &occludedMask);
+                else if (quantizedNodes8)
+                    IntersectPacketWideBVH(quantizedNodes8, primitives, triangleVertices,
+                                           packet, &occludedMask);
+                else if (nodes)
+                    IntersectPacketBVH(nodes, primitives, triangleVertices, packet,
+                                       &occludedMask);
+                for (int r = 0; r < n; ++r)
+                    occluded[packet.index[r]] = (occludedMask >> r) & 1;
+            }
+    }
+}
+
 BVHBuildNode *BVHAccel::buildUpperSAH(Allocator alloc,
                                       std::vector<BVHBuildNode *> &treeletRoots,
                                       int start, int end,
@@ -719,7 +2341,7 @@ BVHBuildNode *BVHAccel::buildUpperSAH(Allocator alloc,
 }
 
 BVHAccel *BVHAccel::Create(std::vector<PrimitiveHandle> prims,
-                           const ParameterDictionary &parameters) {
+                           const ParameterDictionary &parameters, int width) {
     std::string splitMethodName = parameters.GetOneString("splitmethod", "sah");
     BVHAccel::SplitMethod splitMethod;
     if (splitMethodName == "sah")
@@ -730,13 +2352,25 @@ BVHAccel *BVHAccel::Create(std::vector<PrimitiveHandle> prims,
         splitMethod = BVHAccel::SplitMethod::Middle;
     else if (splitMethodName == "equal")
         splitMethod = BVHAccel::SplitMethod::EqualCounts;
+    else if (splitMethodName == "sbvh")
+        splitMethod = BVHAccel::SplitMethod::SBVH;
     else {
         Warning(R"(BVH split method "%s" unknown.  Using "sah".)", splitMethodName);
         splitMethod = BVHAccel::SplitMethod::SAH;
     }
 
     int maxPrimsInNode = parameters.GetOneInt("maxnodeprims", 4);
-    return new BVHAccel(std::move(prims), maxPrimsInNode, splitMethod);
+    bool compressed = parameters.GetOneBool("compressed", false);
+    if (compressed && width == 2) {
+        Warning(R"("compressed" BVH nodes are only available with "bvh4" and "bvh8". )"
+                "Using 4-wide nodes.");
+        width = 4;
+    }
+    Float spatialSplitBudget = parameters.GetOneFloat("spatialsplitbudget", 0.3f);
+    if (spatialSplitBudget < 0)
+        ErrorExit("%f: \"spatialsplitbudget\" must be non-negative.", spatialSplitBudget);
+    return new BVHAccel(std::move(prims), maxPrimsInNode, splitMethod, width,
+                        spatialSplitBudget, compressed);
 }
 
 // KdToDo Definition
@@ -1164,12 +2798,324 @@ KdTreeAccel *KdTreeAccel::Create(std::vector<PrimitiveHandle> prims,
                            maxDepth);
 }
 
+// Instance BVH Build Constants
+static constexpr int MaxInstancesInNode = 4;
+
+// Builds a binned SAH BVH over _instanceInfo_[start, end), reordering it so
+// that leaves cover contiguous ranges, and returns the root node's index.
+static int BuildInstanceBVH(std::vector<BVHPrimitiveInfo> &instanceInfo, int start,
+                            int end, std::vector<LinearBVHNode> &nodes) {
+    int nodeIndex = nodes.size();
+    nodes.push_back(LinearBVHNode());
+    Bounds3f bounds, centroidBounds;
+    for (int i = start; i < end; ++i) {
+        bounds = Union(bounds, instanceInfo[i].bounds);
+        centroidBounds = Union(centroidBounds, instanceInfo[i].centroid);
+    }
+    int nInstances = end - start;
+    int dim = centroidBounds.MaxDimension();
+
+    // Choose instance partition, or create a leaf
+    int mid = (start + end) / 2;
+    if (nInstances == 1 ||
+        (nInstances <= MaxInstancesInNode &&
+         centroidBounds.pMax[dim] == centroidBounds.pMin[dim])) {
+        nodes[nodeIndex].bounds = bounds;
+        nodes[nodeIndex].primitivesOffset = start;
+        nodes[nodeIndex].nPrimitives = nInstances;
+        return nodeIndex;
+    }
+    if (centroidBounds.pMax[dim] != centroidBounds.pMin[dim]) {
+        // Bin instance centroids and find the lowest-cost split
+        constexpr int nBuckets = 12;
+        BucketInfo buckets[nBuckets];
+        auto bucketIndex = [&](const BVHPrimitiveInfo &info) {
+            int b = nBuckets * centroidBounds.Offset(info.centroid)[dim];
+            return std::min(b, nBuckets - 1);
+        };
+        for (int i = start; i < end; ++i) {
+            int b = bucketIndex(instanceInfo[i]);
+            ++buckets[b].count;
+            buckets[b].bounds = Union(buckets[b].bounds, instanceInfo[i].bounds);
+        }
+        int minCostSplitBucket = -1;
+        Float minCost = Infinity;
+        for (int split = 0; split < nBuckets - 1; ++split) {
+            Bounds3f b0, b1;
+            int count0 = 0, count1 = 0;
+            for (int i = 0; i <= split; ++i) {
+                b0 = Union(b0, buckets[i].bounds);
+                count0 += buckets[i].count;
+            }
+            for (int i = split + 1; i < nBuckets; ++i) {
+                b1 = Union(b1, buckets[i].bounds);
+                count1 += buckets[i].count;
+            }
+            Float cost = count0 * b0.SurfaceArea() + count1 * b1.SurfaceArea();
+            if (count0 > 0 && count1 > 0 && cost < minCost) {
+                minCost = cost;
+                minCostSplitBucket = split;
+            }
+        }
+
+        // Create leaf if splitting doesn't pay off
+        Float leafCost = nInstances;
+        minCost = 1.f / 2.f + minCost / bounds.SurfaceArea();
+        if (nInstances <= MaxInstancesInNode && minCost >= leafCost) {
+            nodes[nodeIndex].bounds = bounds;
+            nodes[nodeIndex].primitivesOffset = start;
+            nodes[nodeIndex].nPrimitives = nInstances;
+            return nodeIndex;
+        }
+        mid = std::partition(&instanceInfo[start], &instanceInfo[end - 1] + 1,
+                             [=](const BVHPrimitiveInfo &info) {
+                                 return bucketIndex(info) <= minCostSplitBucket;
+                             }) -
+              &instanceInfo[0];
+    }
+
+    // Build children; the first child immediately follows its parent
+    BuildInstanceBVH(instanceInfo, start, mid, nodes);
+    int secondChild = BuildInstanceBVH(instanceInfo, mid, end, nodes);
+    nodes[nodeIndex].bounds = bounds;
+    nodes[nodeIndex].secondChildOffset = secondChild;
+    nodes[nodeIndex].nPrimitives = 0;
+    nodes[nodeIndex].axis = dim;
+    return nodeIndex;
+}
+
+// InstanceBVHAccel Method Definitions
+InstanceBVHAccel::InstanceBVHAccel(pstd::span<const Instance> instances) {
+    // Initialize instance records and their transformations
+    std::vector<InstanceRecord> inputRecords(instances.size());
+    for (size_t i = 0; i < instances.size(); ++i) {
+        const Instance &instance = instances[i];
+        CHECK(instance.blas != nullptr);
+        CHECK((instance.renderFromInstance == nullptr) !=
+              (instance.renderFromInstanceAnim == nullptr));
+        inputRecords[i].blas = instance.blas;
+        if (instance.renderFromInstanceAnim) {
+            inputRecords[i].animated = 1;
+            inputRecords[i].transformIndex = animatedTransforms.size();
+            animatedTransforms.push_back(*instance.renderFromInstanceAnim);
+        } else {
+            inputRecords[i].animated = 0;
+            inputRecords[i].transformIndex = transforms.size();
+            transforms.push_back(*instance.renderFromInstance);
+        }
+    }
+    bvhInstances += instances.size();
+    if (instances.empty())
+        return;
+
+    // Build top-level BVH over instance bounds
+    std::vector<BVHPrimitiveInfo> instanceInfo(instances.size());
+    ParallelFor(0, instances.size(), [&](int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; ++i)
+            instanceInfo[i] = {size_t(i), instanceBounds(inputRecords[i])};
+    });
+    std::vector<LinearBVHNode> linearNodes;
+    BuildInstanceBVH(instanceInfo, 0, instanceInfo.size(), linearNodes);
+    nNodes = linearNodes.size();
+    nodes = new LinearBVHNode[nNodes];
+    std::copy(linearNodes.begin(), linearNodes.end(), nodes);
+
+    // Store instance records in leaf order
+    records.resize(instances.size());
+    recordIndex.resize(instances.size());
+    for (size_t i = 0; i < instanceInfo.size(); ++i) {
+        records[i] = inputRecords[instanceInfo[i].primitiveNumber];
+        recordIndex[instanceInfo[i].primitiveNumber] = i;
+    }
+
+    treeBytes += nNodes * sizeof(LinearBVHNode) + records.size() * sizeof(records[0]) +
+                 recordIndex.size() * sizeof(int) +
+                 transforms.size() * sizeof(Transform) +
+                 animatedTransforms.size() * sizeof(AnimatedTransform);
+    LOG_VERBOSE("Instance BVH created with %d nodes for %d instances", nNodes,
+                (int)records.size());
+}
+
+Bounds3f InstanceBVHAccel::Bounds() const {
+    return nodes ? nodes[0].bounds : Bounds3f();
+}
+
+Bounds3f InstanceBVHAccel::instanceBounds(const InstanceRecord &record) const {
+    if (record.animated)
+        return animatedTransforms[record.transformIndex].MotionBounds(
+            record.blas->Bounds());
+    return transforms[record.transformIndex](record.blas->Bounds());
+}
+
+void InstanceBVHAccel::SetInstanceTransform(int instance,
+                                            const Transform &renderFromInstance) {
+    InstanceRecord &record = records[recordIndex[instance]];
+    if (record.animated) {
+        record.animated = 0;
+        record.transformIndex = transforms.size();
+        transforms.push_back(renderFromInstance);
+    } else
+        transforms[record.transformIndex] = renderFromInstance;
+}
+
+void InstanceBVHAccel::SetInstanceTransform(int instance,
+                                            const AnimatedTransform &renderFromInstance) {
+    InstanceRecord &record = records[recordIndex[instance]];
+    if (!record.animated) {
+        record.animated = 1;
+        record.transformIndex = animatedTransforms.size();
+        animatedTransforms.push_back(renderFromInstance);
+    } else
+        animatedTransforms[record.transformIndex] = renderFromInstance;
+}
+
+void InstanceBVHAccel::Refit() {
+    // Recompute leaf bounds from the current instance transformations
+    ParallelFor(0, nNodes, [&](int64_t start, int64_t end) {
+        for (int64_t i = start; i < end; ++i) {
+            LinearBVHNode &node = nodes[i];
+            if (node.nPrimitives == 0)
+                continue;
+            node.bounds = Bounds3f();
+            for (int j = 0; j < node.nPrimitives; ++j)
+                node.bounds = Union(node.bounds,
+                                    instanceBounds(records[node.primitivesOffset + j]));
+        }
+    });
+
+    // Propagate bounds to interior nodes; children always follow their parent
+    for (int i = nNodes - 1; i >= 0; --i)
+        if (nodes[i].nPrimitives == 0)
+            nodes[i].bounds =
+                Union(nodes[i + 1].bounds, nodes[nodes[i].secondChildOffset].bounds);
+}
+
+pstd::optional<ShapeIntersection> InstanceBVHAccel::Intersect(const Ray &ray,
+                                                              Float tMax) const {
+    if (nodes == nullptr)
+        return {};
+    pstd::optional<ShapeIntersection> si;
+    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
+    int dirIsNeg[3] = {static_cast<int>(invDir.x < 0), static_cast<int>(invDir.y < 0),
+                       static_cast<int>(invDir.z < 0)};
+    // Follow ray through top-level BVH nodes to find instance intersections
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesToVisit[64];
+    int nodesVisited = 0;
+    while (true) {
+        ++nodesVisited;
+        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
+            if (node->nPrimitives > 0) {
+                // Intersect ray with instances in leaf node
+                for (int i = 0; i < node->nPrimitives; ++i) {
+                    const InstanceRecord &record = records[node->primitivesOffset + i];
+                    // Transform ray to instance space and intersect with BLAS
+                    Transform interpRenderFromInstance;
+                    const Transform *renderFromInstance;
+                    if (record.animated) {
+                        interpRenderFromInstance =
+                            animatedTransforms[record.transformIndex].Interpolate(
+                                ray.time);
+                        renderFromInstance = &interpRenderFromInstance;
+                    } else
+                        renderFromInstance = &transforms[record.transformIndex];
+                    Float tInstance = tMax;
+                    Ray instanceRay = renderFromInstance->ApplyInverse(ray, &tInstance);
+                    pstd::optional<ShapeIntersection> instanceSi =
+                        record.blas->Intersect(instanceRay, tInstance);
+                    if (instanceSi) {
+                        // Return transformed instance's intersection information
+                        instanceSi->intr = (*renderFromInstance)(instanceSi->intr);
+                        si = instanceSi;
+                        tMax = si->tHit;
+                    }
+                }
+                if (toVisitOffset == 0)
+                    break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+
+            } else {
+                // Put far node on _nodesToVisit_ stack, advance to near node
+                if (dirIsNeg[node->axis]) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->secondChildOffset;
+                } else {
+                    nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        } else {
+            if (toVisitOffset == 0)
+                break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+
+    bvhNodesVisited += nodesVisited;
+    return si;
+}
+
+bool InstanceBVHAccel::IntersectP(const Ray &ray, Float tMax) const {
+    if (nodes == nullptr)
+        return false;
+    Vector3f invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+    int dirIsNeg[3] = {static_cast<int>(invDir.x < 0), static_cast<int>(invDir.y < 0),
+                       static_cast<int>(invDir.z < 0)};
+    int nodesToVisit[64];
+    int toVisitOffset = 0, currentNodeIndex = 0;
+    int nodesVisited = 0;
+    while (true) {
+        ++nodesVisited;
+        const LinearBVHNode *node = &nodes[currentNodeIndex];
+        if (node->bounds.IntersectP(ray.o, ray.d, tMax, invDir, dirIsNeg)) {
+            if (node->nPrimitives > 0) {
+                for (int i = 0; i < node->nPrimitives; ++i) {
+                    const InstanceRecord &record = records[node->primitivesOffset + i];
+                    Float tInstance = tMax;
+                    Ray instanceRay =
+                        record.animated
+                            ? animatedTransforms[record.transformIndex].ApplyInverse(
+                                  ray, &tInstance)
+                            : transforms[record.transformIndex].ApplyInverse(ray,
+                                                                             &tInstance);
+                    if (record.blas->IntersectP(instanceRay, tInstance)) {
+                        bvhNodesVisited += nodesVisited;
+                        return true;
+                    }
+                }
+                if (toVisitOffset == 0)
+                    break;
+                currentNodeIndex = nodesToVisit[--toVisitOffset];
+            } else {
+                if (dirIsNeg[node->axis] != 0) {
+                    nodesToVisit[toVisitOffset++] = currentNodeIndex + 1;
+                    currentNodeIndex = node->secondChildOffset;
+                } else {
+                    nodesToVisit[toVisitOffset++] = node->secondChildOffset;
+                    currentNodeIndex = currentNodeIndex + 1;
+                }
+            }
+        } else {
+            if (toVisitOffset == 0)
+                break;
+            currentNodeIndex = nodesToVisit[--toVisitOffset];
+        }
+    }
+    bvhNodesVisited += nodesVisited;
+    return false;
+}
+
 PrimitiveHandle CreateAccelerator(const std::string &name,
                                   std::vector<PrimitiveHandle> prims,
                                   const ParameterDictionary &parameters) {
     PrimitiveHandle accel = nullptr;
     if (name == "bvh")
         accel = BVHAccel::Create(std::move(prims), parameters);
+    else if (name == "bvh4")
+        accel = BVHAccel::Create(std::move(prims), parameters, 4);
+    else if (name == "bvh8")
+        accel = BVHAccel::Create(std::move(prims), parameters, 8);
     else if (name == "kdtree")
         accel = KdTreeAccel::Create(std::move(prims), parameters);
     else
@@ -23,24 +23,33 @@ struct BVHBuildNode;
 struct BVHPrimitiveInfo;
 struct LinearBVHNode;
 struct MortonPrimitive;
+template <int N>
+struct WideBVHNode;
+template <int N>
+struct QuantizedBVHNode;
+struct BVHTriangleVertices;
 
 // BVHAccel Definition
 class BVHAccel {
   public:
     // BVHAccel Public Types
-    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts };
+    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts, SBVH };
 
     // BVHAccel Public Methods
     BVHAccel(std::vector<PrimitiveHandle> p, int maxPrimsInNode = 1,
-             SplitMethod splitMethod = SplitMethod::SAH);
+             SplitMethod splitMethod = SplitMethod::SAH, int width = 2,
+             Float spatialSplitBudget = 0.3f, bool compressed = false);
 
     static BVHAccel *Create(std::vector<PrimitiveHandle> prims,
-                            const ParameterDictionary &parameters);
+                            const ParameterDictionary &parameters, int width = 2);
 
     Bounds3f Bounds() const;
     pstd::optional<ShapeIntersection> Intersect(const Ray &ray, Float tMax) const;
     bool IntersectP(const Ray &ray, Float tMax) const;
 
+    void IntersectPN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                     pstd::span<bool> occluded) const;
+
   private:
     // BVHAccel Private Methods
     BVHBuildNode *recursiveBuild(std::vector<Allocator> &threadAllocators,
@@ -48,6 +57,22 @@ class BVHAccel {
                                  int end, std::atomic<int> *totalNodes,
                                  std::vector<PrimitiveHandle> &orderedPrims,
                                  std::atomic<int> *orderedPrimsOffset);
+    Bounds3f clipReference(const BVHPrimitiveInfo &ref, const Bounds3f &slab) const;
+    BVHBuildNode *sbvhBuild(std::vector<Allocator> &threadAllocators,
+                            std::vector<BVHPrimitiveInfo> refs, Float rootSurfaceArea,
+                            int depth, std::atomic<int> *splitBudget,
+                            std::atomic<int> *totalNodes,
+                            std::vector<PrimitiveHandle> &orderedPrims,
+                            std::atomic<int> *orderedPrimsOffset);
+    void gatherTriangleVertices();
+    size_t nodeBytes() const;
+    const void *nodeData() const;
+    uint64_t computeCacheKey(const std::vector<BVHPrimitiveInfo> &primitiveInfo) const;
+    bool readCache(const std::string &filename, uint64_t key);
+    void writeCache(const std::string &filename, uint64_t key,
+                    const std::vector<PrimitiveHandle> &inputPrimitives) const;
+    void reportBuildTime(double boundsSeconds, double treeSeconds,
+                         double flattenSeconds) const;
     BVHBuildNode *HLBVHBuild(Allocator alloc,
                              const std::vector<BVHPrimitiveInfo> &primitiveInfo,
                              std::atomic<int> *totalNodes,
@@ -66,7 +91,16 @@ class BVHAccel {
     int maxPrimsInNode;
     SplitMethod splitMethod;
     std::vector<PrimitiveHandle> primitives;
+    int width;
+    bool compressed;
+    Bounds3f bounds;
+    int nNodes = 0;
     LinearBVHNode *nodes = nullptr;
+    WideBVHNode<4> *nodes4 = nullptr;
+    WideBVHNode<8> *nodes8 = nullptr;
+    QuantizedBVHNode<4> *quantizedNodes4 = nullptr;
+    QuantizedBVHNode<8> *quantizedNodes8 = nullptr;
+    BVHTriangleVertices *triangleVertices = nullptr;
 };
 
 struct KdAccelNode;
@@ -103,6 +137,52 @@ class KdTreeAccel {
     Bounds3f bounds;
 };
 
+// InstanceBVHAccel Definition
+// Top-level BVH over object instances; each instance refers to a bottom-level
+// _BVHAccel_ that may be shared with any number of other instances.
+class InstanceBVHAccel {
+  public:
+    // InstanceBVHAccel Public Types
+    struct Instance {
+        const BVHAccel *blas;
+        // Exactly one of the transformations should be provided
+        const Transform *renderFromInstance = nullptr;
+        const AnimatedTransform *renderFromInstanceAnim = nullptr;
+    };
+
+    // InstanceBVHAccel Public Methods
+    InstanceBVHAccel(pstd::span<const Instance> instances);
+
+    Bounds3f Bounds() const;
+    pstd::optional<ShapeIntersection> Intersect(const Ray &ray, Float tMax) const;
+    bool IntersectP(const Ray &ray, Float tMax) const;
+
+    // Updating transformations leaves the tree stale until _Refit()_ is called
+    void SetInstanceTransform(int instance, const Transform &renderFromInstance);
+    void SetInstanceTransform(int instance, const AnimatedTransform &renderFromInstance);
+    void Refit();
+
+  private:
+    // InstanceBVHAccel Private Types
+    struct InstanceRecord {
+        const BVHAccel *blas;
+        // Index into _transforms_, or into _animatedTransforms_ if _animated_
+        uint32_t transformIndex : 31;
+        uint32_t animated : 1;
+    };
+
+    // InstanceBVHAccel Private Methods
+    Bounds3f instanceBounds(const InstanceRecord &record) const;
+
+    // InstanceBVHAccel Private Members
+    std::vector<InstanceRecord> records;
+    std::vector<int> recordIndex;
+    std::vector<Transform> transforms;
+    std::vector<AnimatedTransform> animatedTransforms;
+    LinearBVHNode *nodes = nullptr;
+    int nNodes = 0;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_CPU_ACCELERATORS_H
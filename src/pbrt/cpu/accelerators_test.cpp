@@ -0,0 +1,369 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+
+#include <pbrt/cpu/accelerators.h>
+#include <pbrt/cpu/primitive.h>
+#include <pbrt/interaction.h>
+#include <pbrt/options.h>
+#include <pbrt/shapes.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/rng.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#ifndef PBRT_IS_WINDOWS
+#include <dirent.h>
+#endif
+
+using namespace pbrt;
+
+static std::vector<PrimitiveHandle> RandomTrianglePrimitives(int nTriangles, RNG &rng) {
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    for (int i = 0; i < nTriangles; ++i) {
+        // Small triangles scattered through a cube, with a few long thin ones
+        Point3f base(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        Float scale = (i % 17 == 0) ? 0.5f : 0.05f;
+        for (int j = 0; j < 3; ++j) {
+            indices.push_back(p.size());
+            p.push_back(base + scale * Vector3f(rng.Uniform<Float>() - .5f,
+                                                rng.Uniform<Float>() - .5f,
+                                                rng.Uniform<Float>() - .5f));
+        }
+    }
+
+    TriangleMesh *mesh =
+        new TriangleMesh(Transform(), false, indices, p, {}, {}, {}, {});
+    std::vector<PrimitiveHandle> prims;
+    for (ShapeHandle tri : Triangle::CreateTriangles(mesh, Allocator()))
+        prims.push_back(new SimplePrimitive(tri, nullptr));
+    return prims;
+}
+
+static void CheckAgainstBruteForce(const std::vector<PrimitiveHandle> &prims,
+                                   PrimitiveHandle accel, RNG &rng, int nRays = 2000,
+                                   Float time = 0) {
+    for (int i = 0; i < nRays; ++i) {
+        Point3f o(rng.Uniform<Float>() * 3 - 1, rng.Uniform<Float>() * 3 - 1,
+                  rng.Uniform<Float>() * 3 - 1);
+        Point3f target(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        Ray ray(o, target - o, time);
+        Float tMax = (i & 1) ? Infinity : 1;
+
+        pstd::optional<ShapeIntersection> expected;
+        Float tClosest = tMax;
+        for (PrimitiveHandle prim : prims)
+            if (pstd::optional<ShapeIntersection> si = prim.Intersect(ray, tClosest)) {
+                expected = si;
+                tClosest = si->tHit;
+            }
+
+        pstd::optional<ShapeIntersection> si = accel.Intersect(ray, tMax);
+        ASSERT_EQ(expected.has_value(), si.has_value());
+        if (expected) {
+            EXPECT_EQ(expected->tHit, si->tHit);
+        }
+        EXPECT_EQ(expected.has_value(), accel.IntersectP(ray, tMax));
+    }
+}
+
+TEST(BVHAccel, WideMatchesBruteForce) {
+    RNG rng;
+    std::vector<PrimitiveHandle> prims = RandomTrianglePrimitives(5000, rng);
+
+    for (int width : {2, 4, 8})
+        for (BVHAccel::SplitMethod splitMethod :
+             {BVHAccel::SplitMethod::SAH, BVHAccel::SplitMethod::HLBVH,
+              BVHAccel::SplitMethod::Middle, BVHAccel::SplitMethod::EqualCounts,
+              BVHAccel::SplitMethod::SBVH}) {
+            BVHAccel *bvh = new BVHAccel(prims, 4, splitMethod, width);
+            CheckAgainstBruteForce(prims, bvh, rng);
+        }
+}
+
+TEST(BVHAccel, TrianglePrimitives) {
+    // Mesh-level triangle primitives must give the same hits as per-triangle ones
+    RNG rng;
+    std::vector<PrimitiveHandle> prims = RandomTrianglePrimitives(5000, rng);
+    TriangleMeshPrimitive *meshPrimitive =
+        new TriangleMeshPrimitive(nullptr, MediumInterface(), nullptr, nullptr);
+    std::vector<PrimitiveHandle> triPrims;
+    for (PrimitiveHandle prim : prims) {
+        const Triangle *tri = prim.Cast<SimplePrimitive>()->GetShape().Cast<Triangle>();
+        if (triPrims.empty())
+            TrianglePrimitive::AddMesh(tri->MeshIndex(), meshPrimitive);
+        triPrims.push_back(new TrianglePrimitive(*tri));
+    }
+
+    for (BVHAccel::SplitMethod splitMethod :
+         {BVHAccel::SplitMethod::SAH, BVHAccel::SplitMethod::SBVH}) {
+        BVHAccel *bvh = new BVHAccel(triPrims, 4, splitMethod, 8);
+        CheckAgainstBruteForce(prims, bvh, rng);
+    }
+}
+
+TEST(BVHAccel, CompressedMatchesBruteForce) {
+    RNG rng;
+    std::vector<PrimitiveHandle> prims = RandomTrianglePrimitives(5000, rng);
+
+    for (int width : {4, 8})
+        for (BVHAccel::SplitMethod splitMethod :
+             {BVHAccel::SplitMethod::SAH, BVHAccel::SplitMethod::HLBVH,
+              BVHAccel::SplitMethod::SBVH}) {
+            BVHAccel *bvh = new BVHAccel(prims, 4, splitMethod, width, 0.3f, true);
+            CheckAgainstBruteForce(prims, bvh, rng);
+        }
+}
+
+TEST(BVHAccel, ParallelBuildMatchesBruteForce) {
+    // Enough primitives that the upper levels of the tree are binned and
+    // partitioned in parallel
+    RNG rng;
+    std::vector<PrimitiveHandle> prims = RandomTrianglePrimitives(200000, rng);
+
+    for (BVHAccel::SplitMethod splitMethod :
+         {BVHAccel::SplitMethod::SAH, BVHAccel::SplitMethod::Middle}) {
+        BVHAccel *bvh = new BVHAccel(prims, 4, splitMethod);
+        CheckAgainstBruteForce(prims, bvh, rng, 100);
+    }
+}
+
+TEST(BVHAccel, SpatialSplitBudget) {
+    // Long diagonal triangles that spatial splits should clip
+    RNG rng;
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    for (int i = 0; i < 2000; ++i) {
+        Point3f base(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        Vector3f d(rng.Uniform<Float>() - .5f, rng.Uniform<Float>() - .5f,
+                   rng.Uniform<Float>() - .5f);
+        Vector3f offset(.01f * rng.Uniform<Float>(), .01f * rng.Uniform<Float>(), 0);
+        for (Point3f v : {base - d, base + d, base + d + offset}) {
+            indices.push_back(p.size());
+            p.push_back(v);
+        }
+    }
+    TriangleMesh *mesh = new TriangleMesh(Transform(), false, indices, p, {}, {}, {}, {});
+    std::vector<PrimitiveHandle> prims;
+    for (ShapeHandle tri : Triangle::CreateTriangles(mesh, Allocator()))
+        prims.push_back(new SimplePrimitive(tri, nullptr));
+
+    for (Float budget : {0.f, .1f, 1.f})
+        for (int width : {2, 8}) {
+            BVHAccel *bvh =
+                new BVHAccel(prims, 4, BVHAccel::SplitMethod::SBVH, width, budget);
+            CheckAgainstBruteForce(prims, bvh, rng, 500);
+        }
+}
+
+TEST(BVHAccel, TriangleBatchEdges) {
+    // A tessellated grid, tested with rays through its vertices and edges,
+    // where the conservative batch test must not reject any hits
+    constexpr int n = 16;
+    std::vector<int> indices;
+    std::vector<Point3f> p;
+    RNG rng;
+    for (int y = 0; y <= n; ++y)
+        for (int x = 0; x <= n; ++x)
+            p.push_back(Point3f(Float(x) / n, Float(y) / n, .1f * rng.Uniform<Float>()));
+    for (int y = 0; y < n; ++y)
+        for (int x = 0; x < n; ++x) {
+            int v00 = y * (n + 1) + x, v10 = v00 + 1, v01 = v00 + n + 1, v11 = v01 + 1;
+            for (int v : {v00, v10, v11, v00, v11, v01})
+                indices.push_back(v);
+        }
+    TriangleMesh *mesh = new TriangleMesh(Transform(), false, indices, p, {}, {}, {}, {});
+    std::vector<PrimitiveHandle> prims;
+    for (ShapeHandle tri : Triangle::CreateTriangles(mesh, Allocator()))
+        prims.push_back(new SimplePrimitive(tri, nullptr));
+
+    for (int width : {2, 8}) {
+        PrimitiveHandle bvh = new BVHAccel(prims, 8, BVHAccel::SplitMethod::SAH, width);
+        for (int i = 0; i < 2000; ++i) {
+            // Aim at a vertex or at the midpoint of an edge
+            int v0 = indices[rng.Uniform<uint32_t>(indices.size())];
+            int v1 = indices[rng.Uniform<uint32_t>(indices.size())];
+            Point3f target = (i & 1) ? p[v0] : (p[v0] + p[v1]) / 2;
+            Point3f o(rng.Uniform<Float>() * 3 - 1, rng.Uniform<Float>() * 3 - 1, 2);
+            Ray ray(o, target - o);
+
+            pstd::optional<ShapeIntersection> expected;
+            Float tClosest = Infinity;
+            for (PrimitiveHandle prim : prims) {
+                pstd::optional<ShapeIntersection> si = prim.Intersect(ray, tClosest);
+                if (si) {
+                    expected = si;
+                    tClosest = si->tHit;
+                }
+            }
+            pstd::optional<ShapeIntersection> si = bvh.Intersect(ray);
+            ASSERT_EQ(expected.has_value(), si.has_value());
+            if (expected) {
+                EXPECT_EQ(expected->tHit, si->tHit);
+            }
+            EXPECT_EQ(expected.has_value(), bvh.IntersectP(ray));
+        }
+    }
+}
+
+#ifndef PBRT_IS_WINDOWS
+TEST(BVHAccel, CacheRoundTrip) {
+    char dir[] = "/tmp/pbrt-bvh-cache-XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != nullptr);
+    std::string savedDirectory = Options->bvhCacheDirectory;
+    Options->bvhCacheDirectory = dir;
+
+    // Enough primitives for the BVH to be cached
+    RNG rng;
+    std::vector<PrimitiveHandle> prims = RandomTrianglePrimitives(70000, rng);
+    for (int width : {2, 8, -4}) {
+        // The first BVH is built and written to the cache; the second is
+        // loaded from it.
+        for (int pass = 0; pass < 2; ++pass) {
+            BVHAccel *bvh = new BVHAccel(prims, 4, BVHAccel::SplitMethod::SAH,
+                                         std::abs(width), 0.3f, width < 0);
+            CheckAgainstBruteForce(prims, bvh, rng, 100);
+        }
+    }
+
+    // Corrupt the end of each cache file's node array; the BVHs should be
+    // rebuilt rather than loaded.
+    std::vector<std::string> cacheFiles;
+    DIR *d = opendir(dir);
+    ASSERT_TRUE(d != nullptr);
+    while (struct dirent *entry = readdir(d))
+        if (entry->d_name[0] != '.')
+            cacheFiles.push_back(std::string(dir) + "/" + entry->d_name);
+    closedir(d);
+    EXPECT_EQ(3, cacheFiles.size());
+    std::vector<std::string> corruptedContents;
+    for (const std::string &filename : cacheFiles) {
+        corruptedContents.push_back(ReadFileContents(filename));
+        corruptedContents.back().back() ^= 1;
+        ASSERT_TRUE(WriteFile(filename, corruptedContents.back()));
+    }
+    for (int width : {2, 8, -4}) {
+        BVHAccel *bvh = new BVHAccel(prims, 4, BVHAccel::SplitMethod::SAH,
+                                     std::abs(width), 0.3f, width < 0);
+        CheckAgainstBruteForce(prims, bvh, rng, 100);
+    }
+    // The rebuilt BVHs replace the corrupt files
+    for (size_t i = 0; i < cacheFiles.size(); ++i)
+        EXPECT_NE(corruptedContents[i], ReadFileContents(cacheFiles[i]));
+
+    Options->bvhCacheDirectory = savedDirectory;
+    std::string removeCommand = std::string("rm -rf ") + dir;
+    EXPECT_EQ(0, system(removeCommand.c_str()));
+}
+#endif  // !PBRT_IS_WINDOWS
+
+TEST(BVHAccel, WideSinglePrimitive) {
+    RNG rng;
+    std::vector<PrimitiveHandle> prims = RandomTrianglePrimitives(1, rng);
+    for (int width : {4, 8}) {
+        BVHAccel *bvh = new BVHAccel(prims, 4, BVHAccel::SplitMethod::SAH, width);
+        CheckAgainstBruteForce(prims, bvh, rng);
+    }
+}
+
+TEST(BVHAccel, RayStreamMatchesSingleRays) {
+    RNG rng;
+    std::vector<PrimitiveHandle> prims = RandomTrianglePrimitives(3000, rng);
+
+    // Mix of coherent rays from a common origin and incoherent random rays,
+    // with a ray count that doesn't divide evenly into packets
+    std::vector<Ray> rays;
+    std::vector<Float> tMax;
+    for (int i = 0; i < 1000; ++i) {
+        Point3f o = (i < 500) ? Point3f(-1, .5, .5)
+                              : Point3f(rng.Uniform<Float>() * 3 - 1,
+                                        rng.Uniform<Float>() * 3 - 1,
+                                        rng.Uniform<Float>() * 3 - 1);
+        Point3f target(rng.Uniform<Float>(), rng.Uniform<Float>(), rng.Uniform<Float>());
+        rays.push_back(Ray(o, target - o));
+        tMax.push_back((i % 3 == 0) ? Infinity : rng.Uniform<Float>() * 2);
+    }
+
+    for (int width : {2, 4, 8, -4, -8}) {
+        // Negative widths select compressed nodes
+        PrimitiveHandle bvh = new BVHAccel(prims, 4, BVHAccel::SplitMethod::SAH,
+                                           std::abs(width), 0.3f, width < 0);
+
+        std::unique_ptr<bool[]> occluded(new bool[rays.size()]);
+        bvh.IntersectPN(rays, tMax, pstd::MakeSpan(occluded.get(), rays.size()));
+
+        for (size_t i = 0; i < rays.size(); ++i)
+            EXPECT_EQ(bvh.IntersectP(rays[i], tMax[i]), occluded[i]);
+    }
+}
+
+TEST(InstanceBVHAccel, MatchesTransformedPrimitives) {
+    RNG rng;
+    // Two shared BLASes instanced many times, some with motion
+    std::vector<PrimitiveHandle> prims0 = RandomTrianglePrimitives(200, rng);
+    std::vector<PrimitiveHandle> prims1 = RandomTrianglePrimitives(50, rng);
+    const BVHAccel *blas[2] = {new BVHAccel(prims0), new BVHAccel(prims1)};
+
+    std::vector<Transform> transforms;
+    std::vector<AnimatedTransform> animatedTransforms;
+    for (int i = 0; i < 500; ++i) {
+        Transform t = Translate(Vector3f(rng.Uniform<Float>() * 2, rng.Uniform<Float>(),
+                                         rng.Uniform<Float>())) *
+                      Scale(.3f, .3f, .3f);
+        transforms.push_back(t);
+        animatedTransforms.push_back(
+            AnimatedTransform(t, 0, Translate(Vector3f(0, .2f, 0)) * t, 1));
+    }
+
+    std::vector<InstanceBVHAccel::Instance> instances;
+    std::vector<PrimitiveHandle> reference;
+    for (int i = 0; i < 500; ++i) {
+        const BVHAccel *b = blas[i % 2];
+        if (i % 5 == 0) {
+            instances.push_back({b, nullptr, &animatedTransforms[i]});
+            reference.push_back(new AnimatedPrimitive(const_cast<BVHAccel *>(b),
+                                                      animatedTransforms[i]));
+        } else {
+            instances.push_back({b, &transforms[i], nullptr});
+            reference.push_back(
+                new TransformedPrimitive(const_cast<BVHAccel *>(b), &transforms[i]));
+        }
+    }
+    InstanceBVHAccel *tlas = new InstanceBVHAccel(instances);
+    CheckAgainstBruteForce(reference, tlas, rng, 500);
+
+    // Move every instance, refit, and compare against the moved references
+    std::vector<PrimitiveHandle> movedReference;
+    for (int i = 0; i < 500; ++i) {
+        transforms[i] = Translate(Vector3f(0, 0, .5f)) * transforms[i];
+        tlas->SetInstanceTransform(i, transforms[i]);
+        movedReference.push_back(new TransformedPrimitive(
+            const_cast<BVHAccel *>(blas[i % 2]), &transforms[i]));
+    }
+    tlas->Refit();
+    CheckAgainstBruteForce(movedReference, tlas, rng, 500);
+
+    // Give every third instance motion, refit, and check along the shutter
+    std::vector<PrimitiveHandle> animatedReference;
+    for (int i = 0; i < 500; ++i) {
+        const BVHAccel *b = blas[i % 2];
+        if (i % 3 == 0) {
+            animatedTransforms[i] = AnimatedTransform(
+                transforms[i], 0, Translate(Vector3f(.5f, 0, 0)) * transforms[i], 1);
+            tlas->SetInstanceTransform(i, animatedTransforms[i]);
+            animatedReference.push_back(
+                new AnimatedPrimitive(const_cast<BVHAccel *>(b), animatedTransforms[i]));
+        } else
+            animatedReference.push_back(
+                new TransformedPrimitive(const_cast<BVHAccel *>(b), &transforms[i]));
+    }
+    tlas->Refit();
+    for (Float time : {Float(0), Float(.5), Float(1)})
+        CheckAgainstBruteForce(animatedReference, tlas, rng, 500, time);
+}
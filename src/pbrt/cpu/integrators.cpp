@@ -38,17 +38,23 @@
 #include <pbrt/util/stats.h>
 #include <pbrt/util/string.h>
 
+#include <cstdio>
+#include <cstring>
+
 namespace pbrt {
 
 STAT_COUNTER("Integrator/Camera rays traced", nCameraRays);
+STAT_PERCENT("Integrator/Pixel samples skipped adaptively", nAdaptiveSkippedSamples,
+             nAdaptivePixelSamples);
 
 // RandomWalkIntegrator Method Definitions
 std::unique_ptr<RandomWalkIntegrator> RandomWalkIntegrator::Create(
     const ParameterDictionary &parameters, CameraHandle camera, SamplerHandle sampler,
     PrimitiveHandle aggregate, std::vector<LightHandle> lights, const FileLoc *loc) {
     int maxDepth = parameters.GetOneInt("maxdepth", 5);
+    TileSettings tiles = TileSettings::Create(parameters, loc);
     return std::make_unique<RandomWalkIntegrator>(maxDepth, camera, sampler, aggregate,
-                                                  lights);
+                                                  lights, tiles);
 }
 
 std::string RandomWalkIntegrator::ToString() const {
@@ -108,6 +114,158 @@ SampledSpectrum RandomWalkIntegrator::RandomWalk(RayDifferential ray,
 // Integrator Method Definitions
 Integrator::~Integrator() {}
 
+// Render Checkpoint Definitions
+// A render checkpoint stores the film's raw pixel accumulators along with
+// the sample wave state of ImageTileIntegrator::Render(), so that an
+// interrupted render can continue where it left off. Checkpoints of renders
+// of disjoint ranges of sample indices can also be merged to give the image
+// that a single render of all of the samples would have.
+struct RenderCheckpointHeader {
+    char magic[8];
+    int32_t version;
+    uint32_t filmType;
+    Bounds2i pixelBounds;
+    int32_t samplesPerPixel, seed;
+    int32_t firstSample;
+    int32_t startWave, endWave, waveDelta;
+};
+
+static constexpr char RenderCheckpointMagic[8] = "pbrtckp";
+static constexpr int32_t RenderCheckpointVersion = 4;
+
+static void WriteRenderCheckpoint(const std::string &filename, FilmHandle film,
+                                  int firstSample, int spp, int startWave, int endWave,
+                                  int waveDelta) {
+    RenderCheckpointHeader header;
+    memcpy(header.magic, RenderCheckpointMagic, sizeof(header.magic));
+    header.version = RenderCheckpointVersion;
+    header.filmType = film.Tag();
+    header.pixelBounds = film.PixelBounds();
+    header.samplesPerPixel = spp;
+    header.seed = Options->seed;
+    header.firstSample = firstSample;
+    header.startWave = startWave;
+    header.endWave = endWave;
+    header.waveDelta = waveDelta;
+
+    // Write to a temporary file and then rename it so that an interruption
+    // never leaves a partially-written checkpoint behind
+    std::string tmpFilename = filename + ".tmp";
+    FILE *f = fopen(tmpFilename.c_str(), "wb");
+    if (!f) {
+        Warning("%s: %s", tmpFilename, ErrorString());
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, f) == 1 && film.WriteCheckpoint(f);
+    if (fclose(f) != 0)
+        written = false;
+    if (!written || rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to write render checkpoint: %s", filename, ErrorString());
+        remove(tmpFilename.c_str());
+        return;
+    }
+    LOG_VERBOSE("Wrote render checkpoint with spp = %d to %s", startWave, filename);
+}
+
+static void ReadRenderCheckpointHeader(const std::string &filename, FILE *f,
+                                       FilmHandle film, RenderCheckpointHeader *header) {
+    if (fread(header, sizeof(*header), 1, f) != 1 ||
+        memcmp(header->magic, RenderCheckpointMagic, sizeof(header->magic)) != 0 ||
+        header->version != RenderCheckpointVersion)
+        ErrorExit("%s: not a pbrt render checkpoint.", filename);
+    if (header->filmType != film.Tag() || header->pixelBounds != film.PixelBounds())
+        ErrorExit("%s: render checkpoint was saved with a different film or pixel "
+                  "bounds.",
+                  filename);
+}
+
+static bool ReadRenderCheckpoint(const std::string &filename, FilmHandle film,
+                                 int firstSample, int spp, int *startWave, int *endWave,
+                                 int *waveDelta) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+
+    RenderCheckpointHeader header;
+    ReadRenderCheckpointHeader(filename, f, film, &header);
+    if (header.samplesPerPixel != spp || header.firstSample != firstSample ||
+        header.seed != Options->seed)
+        ErrorExit("%s: render checkpoint was saved with a different sample count, "
+                  "sample range, or seed.",
+                  filename);
+    if (!film.ReadCheckpoint(f))
+        ErrorExit("%s: render checkpoint's pixels don't match the film.", filename);
+    fclose(f);
+
+    *startWave = header.startWave;
+    *endWave = header.endWave;
+    *waveDelta = header.waveDelta;
+    return true;
+}
+
+void MergeRenderCheckpoints(const std::vector<std::string> &filenames,
+                            CameraHandle camera) {
+    FilmHandle film = camera.GetFilm();
+    std::vector<RenderCheckpointHeader> headers;
+    int64_t nSamples = 0;
+    for (const std::string &filename : filenames) {
+        FILE *f = fopen(filename.c_str(), "rb");
+        if (!f)
+            ErrorExit("%s: %s", filename, ErrorString());
+
+        // Check that the checkpoint is from a render of the same frame
+        RenderCheckpointHeader header;
+        ReadRenderCheckpointHeader(filename, f, film, &header);
+        if (!headers.empty() && header.seed != headers[0].seed)
+            ErrorExit("%s: render checkpoint was saved with a different seed than %s.",
+                      filename, filenames[0]);
+        for (size_t i = 0; i < headers.size(); ++i)
+            if (header.firstSample < headers[i].startWave &&
+                headers[i].firstSample < header.startWave)
+                Warning("%s: samples [%d,%d) overlap those of %s.", filename,
+                        header.firstSample, header.startWave, filenames[i]);
+        if (header.startWave < header.samplesPerPixel)
+            Warning("%s: render is incomplete; merging its samples [%d,%d).", filename,
+                    header.firstSample, header.startWave);
+
+        // Add the checkpoint's pixel accumulators to the film
+        if (!film.MergeCheckpoint(f))
+            ErrorExit("%s: render checkpoint's pixels don't match the film.", filename);
+        fclose(f);
+        LOG_VERBOSE("Merged samples [%d,%d) from %s", header.firstSample,
+                    header.startWave, filename);
+
+        nSamples += header.startWave - header.firstSample;
+        headers.push_back(header);
+    }
+    if (nSamples == 0)
+        ErrorExit("No pixel samples found in render checkpoints to merge.");
+
+    // Write the image, normalizing splats by the total number of samples taken
+    ImageMetadata metadata;
+    metadata.samplesPerPixel = nSamples;
+    camera.InitMetadata(&metadata);
+    film.WriteImage(metadata, 1.0f / nSamples);
+}
+
+// TileSettings Method Definitions
+TileSettings TileSettings::Create(const ParameterDictionary &parameters,
+                                  const FileLoc *loc) {
+    TileSettings tiles;
+    // Previews from the center out are most useful when displaying the image
+    bool previewing = !Options->displayServer.empty() || !Options->previewFile.empty();
+    std::string orderName =
+        parameters.GetOneString("tileorder", previewing ? "spiral" : "hilbert");
+    pstd::optional<TileOrder> order = ParseTileOrder(orderName);
+    if (!order)
+        ErrorExit(loc, "%s: unknown tile order.", orderName);
+    tiles.order = *order;
+    tiles.size = parameters.GetOneInt("tilesize", 0);
+    if (tiles.size < 0)
+        ErrorExit(loc, "\"tilesize\" must not be negative.");
+    return tiles;
+}
+
 // ImageTileIntegrator Method Definitions
 void ImageTileIntegrator::Render() {
     // Handle debugStart, if set
@@ -144,17 +302,56 @@ void ImageTileIntegrator::Render() {
     // Declare common variables for rendering image in tiles
     Bounds2i pixelBounds = camera.GetFilm().PixelBounds();
     int spp = samplerPrototype.SamplesPerPixel();
-    int startWave = 0, endWave = 1, waveDelta = 1;
-
-    std::vector<ScratchBuffer> scratchBuffers;
-    for (int i = 0; i < MaxThreadIndex(); ++i)
-        scratchBuffers.push_back(ScratchBuffer(65536));
+    // Only take samples in _Options->sampleRange_, if given, for a render that
+    // is split across processes
+    int firstSample = 0;
+    if (Options->sampleRangeEnd) {
+        if (Options->sampleRangeBegin >= spp)
+            ErrorExit("--sample-range starts at sample %d but there are only %d "
+                      "pixel samples.",
+                      Options->sampleRangeBegin, spp);
+        firstSample = Options->sampleRangeBegin;
+        spp = std::min(spp, *Options->sampleRangeEnd);
+    }
+    int startWave = firstSample, endWave = firstSample + 1, waveDelta = 1;
+
+    // Allocate per-thread scratch memory and samplers in their threads, so
+    // that they are local to each thread's NUMA node
+    std::vector<ScratchBuffer> scratchBuffers(MaxThreadIndex());
+    std::vector<SamplerHandle> samplers(MaxThreadIndex());
+    ForEachThread([&]() {
+        scratchBuffers[ThreadIndex] = ScratchBuffer(65536);
+        samplers[ThreadIndex] = samplerPrototype.Clone(1, Allocator())[0];
+    });
 
-    std::vector<SamplerHandle> samplers =
-        samplerPrototype.Clone(MaxThreadIndex(), Allocator());
+    // Choose the size of image tiles
+    int tileSize = tiles.size > 0 ? tiles.size : AutoTileSize(pixelBounds);
+    LOG_VERBOSE("Rendering %s tiles of size %d", pbrt::ToString(tiles.order), tileSize);
+
+    // Partition image rows between NUMA nodes when threads are pinned
+    int nNodes = NumaNodeCount();
+    std::vector<std::vector<Bounds2i>> nodeTiles(nNodes);
+    if (nNodes > 1) {
+        std::vector<Bounds2i> imageTiles =
+            OrderedTiles(pixelBounds, tileSize, tiles.order);
+        for (int node = 0; node < nNodes; ++node) {
+            // Bind the film's memory for the node's rows and give it the parts
+            // of the tiles that overlap them, preserving the tile order
+            int y0 = pixelBounds.pMin.y + pixelBounds.Diagonal().y * node / nNodes;
+            int y1 = pixelBounds.pMin.y + pixelBounds.Diagonal().y * (node + 1) / nNodes;
+            camera.GetFilm().BindRowsToNumaNode(y0, y1, node);
+            Bounds2i nodeBounds(Point2i(pixelBounds.pMin.x, y0),
+                                Point2i(pixelBounds.pMax.x, y1));
+            for (const Bounds2i &tile : imageTiles) {
+                Bounds2i nodeTile = pbrt::Intersect(tile, nodeBounds);
+                if (!nodeTile.IsEmpty())
+                    nodeTiles[node].push_back(nodeTile);
+            }
+        }
+    }
 
-    ProgressReporter progress(int64_t(spp) * pixelBounds.Area(), "Rendering",
-                              Options->quiet);
+    ProgressReporter progress(int64_t(spp - firstSample) * pixelBounds.Area(),
+                              "Rendering", Options->quiet);
 
     if (Options->recordPixelStatistics)
         StatsEnablePixelStats(pixelBounds,
@@ -190,12 +387,16 @@ void ImageTileIntegrator::Render() {
             ErrorExit("%s: %s", Options->mseReferenceOutput, ErrorString());
     }
 
-    // Connect to display server if needed
-    if (!Options->displayServer.empty()) {
+    // Connect to display server and preview file if needed
+    if (!Options->displayServer.empty() || !Options->previewFile.empty()) {
         FilmHandle film = camera.GetFilm();
         DisplayDynamic(film.GetFilename(), Point2i(pixelBounds.Diagonal()),
                        {"R", "G", "B"},
-                       [=](Bounds2i b, pstd::span<pstd::span<Float>> displayValue) {
+                       [=](Bounds2i b,
+                           pstd::span<pstd::span<Float>> displayValue) mutable {
+                           // Have threads add their splats to the film for later
+                           // updates; this one may not include all of them
+                           film.RequestSplatFlush();
                            int index = 0;
                            for (Point2i p : b) {
                                RGB rgb = film.GetPixelRGB(pixelBounds.pMin + p);
@@ -206,30 +407,127 @@ void ImageTileIntegrator::Render() {
                        });
     }
 
-    while (startWave < spp) {
-        // Render image tiles in parallel
-        ParallelFor2D(pixelBounds, [&](Bounds2i tileBounds) {
-            // Render image tile given by _tileBounds_
-            ScratchBuffer &scratchBuffer = scratchBuffers[ThreadIndex];
-            SamplerHandle &sampler = samplers[ThreadIndex];
-            VLOG(1, "Starting image tile %s startWave %d, endWave %d", tileBounds,
-                 startWave, endWave);
-            for (Point2i pPixel : tileBounds) {
-                StatsReportPixelStart(pPixel);
-                threadPixel = pPixel;
-                // Render samples in pixel _pPixel_
-                for (int sampleIndex = startWave; sampleIndex < endWave; ++sampleIndex) {
-                    threadSampleIndex = sampleIndex;
-                    sampler.StartPixelSample(pPixel, sampleIndex);
-                    EvaluatePixelSample(pPixel, sampleIndex, sampler, scratchBuffer);
-                    scratchBuffer.Reset();
+    // Restore film and sample wave state from checkpoint if resuming
+    if (Options->resume) {
+        if (ReadRenderCheckpoint(Options->checkpointFile, camera.GetFilm(), firstSample,
+                                 spp, &startWave, &endWave, &waveDelta)) {
+            LOG_VERBOSE("Resuming render from %s with spp = %d", Options->checkpointFile,
+                        startWave - firstSample);
+            progress.Update(int64_t(startWave - firstSample) * pixelBounds.Area());
+            if (startWave == spp) {
+                // The checkpointed render had finished; just write the image
+                ImageMetadata metadata;
+                metadata.samplesPerPixel = spp - firstSample;
+                camera.InitMetadata(&metadata);
+                camera.GetFilm().WriteImage(metadata, 1.0f / (spp - firstSample));
+            }
+        } else
+            Warning("%s: render checkpoint not found. Starting from the beginning.",
+                    Options->checkpointFile);
+    }
+
+    // Set up adaptive sampling, if requested
+    Float errorThreshold = Options->adaptiveErrorThreshold;
+    if (errorThreshold > 0 && !SupportsAdaptiveSampling()) {
+        Warning("Integrator doesn't support adaptive sampling. Ignoring --adaptive-error.");
+        errorThreshold = 0;
+    }
+    // Pixels are only skipped once they have enough samples for a
+    // reasonable error estimate.
+    int minAdaptiveSamples = std::min(spp - firstSample, 16);
+    std::atomic<int64_t> waveSampledPixels{0};
+
+    auto renderTile = [&](Bounds2i tileBounds) {
+        // Render image tile given by _tileBounds_
+        ScratchBuffer &scratchBuffer = scratchBuffers[ThreadIndex];
+        SamplerHandle &sampler = samplers[ThreadIndex];
+        VLOG(1, "Starting image tile %s startWave %d, endWave %d", tileBounds, startWave,
+             endWave);
+        int64_t sampledPixels = 0;
+        for (Point2i pPixel : tileBounds) {
+            // Skip pixels that have already converged if sampling adaptively
+            if (errorThreshold > 0) {
+                nAdaptivePixelSamples += endWave - startWave;
+                if (startWave - firstSample >= minAdaptiveSamples &&
+                    camera.GetFilm().GetPixelRelativeError(pPixel) < errorThreshold) {
+                    nAdaptiveSkippedSamples += endWave - startWave;
+                    continue;
                 }
+            }
+            ++sampledPixels;
+
+            StatsReportPixelStart(pPixel);
+            threadPixel = pPixel;
+            // Render samples in pixel _pPixel_
+            for (int sampleIndex = startWave; sampleIndex < endWave; ++sampleIndex) {
+                threadSampleIndex = sampleIndex;
+                sampler.StartPixelSample(pPixel, sampleIndex);
+                EvaluatePixelSample(pPixel, sampleIndex, sampler, scratchBuffer);
+                scratchBuffer.Reset();
+            }
+
+            StatsReportPixelEnd(pPixel);
+        }
+        VLOG(1, "Finished image tile %s", tileBounds);
+        waveSampledPixels += sampledPixels;
+        progress.Update((endWave - startWave) * tileBounds.Area());
+    };
+
+    // Track the time spent rendering sample waves for _Options->timeLimit_
+    double waveSeconds = 0;
+    int waveSamples = 0;
+
+    // Write images in the background while the following waves are rendered
+    AsyncImageWriter imageWriter;
 
-                StatsReportPixelEnd(pPixel);
+    while (startWave < spp) {
+        // Shorten the wave so that it is expected to finish within the time limit
+        if (Options->timeLimit > 0 && waveSamples > 0) {
+            double secondsPerSample = waveSeconds / waveSamples;
+            double remainingSeconds = Options->timeLimit - progress.ElapsedSeconds();
+            int64_t maxSamples = remainingSeconds / secondsPerSample;
+            if (maxSamples < 1) {
+                LOG_VERBOSE("Time limit reached with spp = %d", startWave - firstSample);
+                break;
             }
-            VLOG(1, "Finished image tile %s", tileBounds);
-            progress.Update((endWave - startWave) * tileBounds.Area());
-        });
+            endWave = std::min<int64_t>(endWave, startWave + maxSamples);
+        }
+
+        // Render image tiles in parallel
+        Timer waveTimer;
+        waveSampledPixels = 0;
+        if (nNodes == 1)
+            ParallelFor2D(pixelBounds, tileSize, tiles.order, renderTile);
+        else {
+            // Have each thread take tiles from its own node's rows while there
+            // are any left, then help the other nodes
+            std::vector<std::atomic<size_t>> nextTile(nNodes);
+            size_t nTiles = 0;
+            for (int node = 0; node < nNodes; ++node) {
+                nextTile[node] = 0;
+                nTiles += nodeTiles[node].size();
+            }
+            ParallelFor(0, nTiles, [&](int64_t) {
+                for (int i = 0; i < nNodes; ++i) {
+                    int node = (ThreadNumaNode() + i) % nNodes;
+                    size_t tileIndex = nextTile[node]++;
+                    if (tileIndex < nodeTiles[node].size()) {
+                        renderTile(nodeTiles[node][tileIndex]);
+                        return;
+                    }
+                }
+                LOG_FATAL("Ran out of image tiles");
+            });
+        }
+        // Add the wave's splats, which threads have accumulated separately
+        camera.GetFilm().FlushSplats();
+        waveSeconds += waveTimer.ElapsedSeconds();
+        waveSamples += endWave - startWave;
+        if (waveSampledPixels == 0) {
+            // All pixels have converged; the image was written after the last wave
+            LOG_VERBOSE("All pixels converged with spp = %d", startWave - firstSample);
+            break;
+        }
 
         // Update start and end wave
         startWave = endWave;
@@ -238,22 +536,31 @@ void ImageTileIntegrator::Render() {
             waveDelta = std::min(2 * waveDelta, 64);
 
         // Write current image to disk
-        LOG_VERBOSE("Writing image with spp = %d", startWave);
+        int nSamples = startWave - firstSample;
+        LOG_VERBOSE("Writing image with spp = %d", nSamples);
         ImageMetadata metadata;
         metadata.renderTimeSeconds = progress.ElapsedSeconds();
-        metadata.samplesPerPixel = startWave;
-        if (referenceImage) {
-            ImageMetadata filmMetadata;
-            Image filmImage = camera.GetFilm().GetImage(&filmMetadata, 1.f / startWave);
-            ImageChannelValues mse =
-                filmImage.MSE(filmImage.AllChannelsDesc(), *referenceImage);
-            fprintf(mseOutFile, "%d, %.9g\n", startWave, mse.Average());
-            metadata.MSE = mse.Average();
-            fflush(mseOutFile);
-        }
+        metadata.samplesPerPixel = nSamples;
         camera.InitMetadata(&metadata);
-        camera.GetFilm().WriteImage(metadata, 1.0f / startWave);
+        Image image = camera.GetFilm().GetImage(&metadata, 1.0f / nSamples);
+        std::function<void(const Image &, ImageMetadata *)> computeMSE;
+        if (referenceImage)
+            computeMSE = [&referenceImage, mseOutFile, nSamples](
+                             const Image &image, ImageMetadata *metadata) {
+                ImageChannelValues mse =
+                    image.MSE(image.AllChannelsDesc(), *referenceImage);
+                fprintf(mseOutFile, "%d, %.9g\n", nSamples, mse.Average());
+                metadata->MSE = mse.Average();
+                fflush(mseOutFile);
+            };
+        imageWriter.Write(std::move(image), metadata, camera.GetFilm().GetFilename(),
+                          computeMSE);
+
+        if (!Options->checkpointFile.empty())
+            WriteRenderCheckpoint(Options->checkpointFile, camera.GetFilm(), firstSample,
+                                  spp, startWave, endWave, waveDelta);
     }
+    imageWriter.Wait();
     if (mseOutFile)
         fclose(mseOutFile);
     progress.Done();
@@ -350,6 +657,15 @@ bool Integrator::IntersectP(const Ray &ray, Float tMax) const {
         return false;
 }
 
+void Integrator::IntersectPN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                             pstd::span<bool> occluded) const {
+    nShadowTests += rays.size();
+    if (aggregate)
+        aggregate.IntersectPN(rays, tMax, occluded);
+    else
+        std::fill(occluded.begin(), occluded.end(), false);
+}
+
 std::string Integrator::ToString() const {
     std::string s = StringPrintf("[ Scene aggregate: %s sceneBounds: %s lights[%d]: [ ",
                                  aggregate, sceneBounds, lights.size());
@@ -426,8 +742,9 @@ SimplePathIntegrator::SimplePathIntegrator(int maxDepth, bool sampleLights,
                                            bool sampleBSDF, CameraHandle camera,
                                            SamplerHandle sampler,
                                            PrimitiveHandle aggregate,
-                                           std::vector<LightHandle> lights)
-    : RayIntegrator(camera, sampler, aggregate, lights),
+                                           std::vector<LightHandle> lights,
+                                           TileSettings tiles)
+    : RayIntegrator(camera, sampler, aggregate, lights, tiles),
       maxDepth(maxDepth),
       sampleLights(sampleLights),
       sampleBSDF(sampleBSDF),
@@ -539,15 +856,19 @@ std::unique_ptr<SimplePathIntegrator> SimplePathIntegrator::Create(
     int maxDepth = parameters.GetOneInt("maxdepth", 5);
     bool sampleLights = parameters.GetOneBool("samplelights", true);
     bool sampleBSDF = parameters.GetOneBool("samplebsdf", true);
+    TileSettings tiles = TileSettings::Create(parameters, loc);
     return std::make_unique<SimplePathIntegrator>(maxDepth, sampleLights, sampleBSDF,
-                                                  camera, sampler, aggregate, lights);
+                                                  camera, sampler, aggregate, lights,
+                                                  tiles);
 }
 
 // LightPathIntegrator Method Definitions
 LightPathIntegrator::LightPathIntegrator(int maxDepth, CameraHandle camera,
                                          SamplerHandle sampler, PrimitiveHandle aggregate,
-                                         std::vector<LightHandle> lights)
-    : ImageTileIntegrator(camera, sampler, aggregate, lights), maxDepth(maxDepth) {
+                                         std::vector<LightHandle> lights,
+                                         TileSettings tiles)
+    : ImageTileIntegrator(camera, sampler, aggregate, lights, tiles),
+      maxDepth(maxDepth) {
     lightSampler = std::make_unique<PowerLightSampler>(lights, Allocator());
 }
 
@@ -645,8 +966,9 @@ std::unique_ptr<LightPathIntegrator> LightPathIntegrator::Create(
     const ParameterDictionary &parameters, CameraHandle camera, SamplerHandle sampler,
     PrimitiveHandle aggregate, std::vector<LightHandle> lights, const FileLoc *loc) {
     int maxDepth = parameters.GetOneInt("maxdepth", 5);
+    TileSettings tiles = TileSettings::Create(parameters, loc);
     return std::make_unique<LightPathIntegrator>(maxDepth, camera, sampler, aggregate,
-                                                 lights);
+                                                 lights, tiles);
 }
 
 STAT_PERCENT("Integrator/Zero-radiance paths", zeroRadiancePaths, totalPaths);
@@ -657,8 +979,8 @@ STAT_INT_DISTRIBUTION("Integrator/Path length", pathLength);
 PathIntegrator::PathIntegrator(int maxDepth, CameraHandle camera, SamplerHandle sampler,
                                PrimitiveHandle aggregate, std::vector<LightHandle> lights,
                                Float rrThreshold, const std::string &lightSampleStrategy,
-                               bool regularize)
-    : RayIntegrator(camera, sampler, aggregate, lights),
+                               bool regularize, TileSettings tiles)
+    : RayIntegrator(camera, sampler, aggregate, lights, tiles),
       maxDepth(maxDepth),
       rrThreshold(rrThreshold),
       lightSampler(LightSamplerHandle::Create(lightSampleStrategy, lights, Allocator())),
@@ -843,16 +1165,19 @@ std::unique_ptr<PathIntegrator> PathIntegrator::Create(
     Float rrThreshold = parameters.GetOneFloat("rrthreshold", 1.);
     std::string lightStrategy = parameters.GetOneString("lightsampler", "bvh");
     bool regularize = parameters.GetOneBool("regularize", false);
+    TileSettings tiles = TileSettings::Create(parameters, loc);
     return std::make_unique<PathIntegrator>(maxDepth, camera, sampler, aggregate, lights,
-                                            rrThreshold, lightStrategy, regularize);
+                                            rrThreshold, lightStrategy, regularize,
+                                            tiles);
 }
 
 // SimpleVolPathIntegrator Method Definitions
 SimpleVolPathIntegrator::SimpleVolPathIntegrator(int maxDepth, CameraHandle camera,
                                                  SamplerHandle sampler,
                                                  PrimitiveHandle aggregate,
-                                                 std::vector<LightHandle> lights)
-    : RayIntegrator(camera, sampler, aggregate, lights), maxDepth(maxDepth) {
+                                                 std::vector<LightHandle> lights,
+                                                 TileSettings tiles)
+    : RayIntegrator(camera, sampler, aggregate, lights, tiles), maxDepth(maxDepth) {
     for (LightHandle light : lights) {
         if (IsDeltaLight(light.Type()))
             ErrorExit("SimpleVolPathIntegrator only supports area and infinite light "
@@ -950,8 +1275,9 @@ std::unique_ptr<SimpleVolPathIntegrator> SimpleVolPathIntegrator::Create(
     const ParameterDictionary &parameters, CameraHandle camera, SamplerHandle sampler,
     PrimitiveHandle aggregate, std::vector<LightHandle> lights, const FileLoc *loc) {
     int maxDepth = parameters.GetOneInt("maxdepth", 5);
+    TileSettings tiles = TileSettings::Create(parameters, loc);
     return std::make_unique<SimpleVolPathIntegrator>(maxDepth, camera, sampler, aggregate,
-                                                     lights);
+                                                     lights, tiles);
 }
 
 STAT_COUNTER("Integrator/Volume interactions", volumeInteractions);
@@ -1358,18 +1684,21 @@ std::unique_ptr<VolPathIntegrator> VolPathIntegrator::Create(
     Float rrThreshold = parameters.GetOneFloat("rrthreshold", 1.);
     std::string lightStrategy = parameters.GetOneString("lightsampler", "bvh");
     bool regularize = parameters.GetOneBool("regularize", false);
+    TileSettings tiles = TileSettings::Create(parameters, loc);
     return std::make_unique<VolPathIntegrator>(maxDepth, camera, sampler, aggregate,
                                                lights, rrThreshold, lightStrategy,
-                                               regularize);
+                                               regularize, tiles);
 }
 
 // AOIntegrator Method Definitions
-AOIntegrator::AOIntegrator(bool cosSample, Float maxDist, CameraHandle camera,
-                           SamplerHandle sampler, PrimitiveHandle aggregate,
-                           std::vector<LightHandle> lights, SpectrumHandle illuminant)
-    : RayIntegrator(camera, sampler, aggregate, lights),
+AOIntegrator::AOIntegrator(bool cosSample, Float maxDist, int nSamples,
+                           CameraHandle camera, SamplerHandle sampler,
+                           PrimitiveHandle aggregate, std::vector<LightHandle> lights,
+                           SpectrumHandle illuminant, TileSettings tiles)
+    : RayIntegrator(camera, sampler, aggregate, lights, tiles),
       cosSample(cosSample),
       maxDist(maxDist),
+      nSamples(nSamples),
       illuminant(illuminant) {}
 
 SampledSpectrum AOIntegrator::Li(RayDifferential ray, SampledWavelengths &lambda,
@@ -1395,33 +1724,46 @@ retry:
         Vector3f s = Normalize(isect.dpdu);
         Vector3f t = Cross(isect.n, s);
 
-        Vector3f wi;
-        Float pdf;
-        Point2f u = sampler.Get2D();
-        if (cosSample) {
-            wi = SampleCosineHemisphere(u);
-            pdf = CosineHemispherePDF(std::abs(wi.z));
-        } else {
-            wi = SampleUniformHemisphere(u);
-            pdf = UniformHemispherePDF();
-        }
-        if (pdf == 0)
-            return SampledSpectrum(0.);
-
+        // Sample _nSamples_ occlusion rays and trace them as a single stream
         Frame f = Frame::FromZ(n);
-        wi = f.FromLocal(wi);
-
-        // Divide by pi so that fully visible is one.
-        Ray r = isect.SpawnRay(wi);
-        if (!IntersectP(r, maxDist))
-            return illuminant.Sample(lambda) * SampledSpectrum(Dot(wi, n) / (Pi * pdf));
+        Ray *rays = scratchBuffer.Alloc<Ray[]>(nSamples);
+        Float *tMax = scratchBuffer.Alloc<Float[]>(nSamples);
+        Float *weight = scratchBuffer.Alloc<Float[]>(nSamples);
+        bool *occluded = scratchBuffer.Alloc<bool[]>(nSamples);
+        for (int i = 0; i < nSamples; ++i) {
+            Vector3f wi;
+            Float pdf;
+            Point2f u = sampler.Get2D();
+            if (cosSample) {
+                wi = SampleCosineHemisphere(u);
+                pdf = CosineHemispherePDF(std::abs(wi.z));
+            } else {
+                wi = SampleUniformHemisphere(u);
+                pdf = UniformHemispherePDF();
+            }
+            wi = f.FromLocal(wi);
+            rays[i] = isect.SpawnRay(wi);
+            tMax[i] = maxDist;
+            // Divide by pi so that fully visible is one.
+            weight[i] = (pdf == 0) ? 0 : Dot(wi, n) / (Pi * pdf);
+        }
+        IntersectPN(pstd::MakeConstSpan(rays, nSamples),
+                    pstd::MakeConstSpan(tMax, nSamples), pstd::MakeSpan(occluded, nSamples));
+
+        Float visibility = 0;
+        for (int i = 0; i < nSamples; ++i)
+            if (!occluded[i])
+                visibility += weight[i];
+        if (visibility > 0)
+            return illuminant.Sample(lambda) * SampledSpectrum(visibility / nSamples);
     }
     return SampledSpectrum(0.);
 }
 
 std::string AOIntegrator::ToString() const {
-    return StringPrintf("[ AOIntegrator cosSample: %s maxDist: %f illuminant: %s ]",
-                        cosSample, maxDist, illuminant);
+    return StringPrintf(
+        "[ AOIntegrator cosSample: %s maxDist: %f nSamples: %d illuminant: %s ]",
+        cosSample, maxDist, nSamples, illuminant);
 }
 
 std::unique_ptr<AOIntegrator> AOIntegrator::Create(
@@ -1430,8 +1772,12 @@ std::unique_ptr<AOIntegrator> AOIntegrator::Create(
     const FileLoc *loc) {
     bool cosSample = parameters.GetOneBool("cossample", true);
     Float maxDist = parameters.GetOneFloat("maxdistance", Infinity);
-    return std::make_unique<AOIntegrator>(cosSample, maxDist, camera, sampler, aggregate,
-                                          lights, illuminant);
+    int nSamples = parameters.GetOneInt("nsamples", 1);
+    if (nSamples < 1)
+        ErrorExit(loc, "%d: \"nsamples\" must be at least one.", nSamples);
+    TileSettings tiles = TileSettings::Create(parameters, loc);
+    return std::make_unique<AOIntegrator>(cosSample, maxDist, nSamples, camera, sampler,
+                                          aggregate, lights, illuminant, tiles);
 }
 
 // BDPT Utility Function Declarations
@@ -2386,9 +2732,10 @@ std::unique_ptr<BDPTIntegrator> BDPTIntegrator::Create(
 
     std::string lightStrategy = parameters.GetOneString("lightsampler", "power");
     bool regularize = parameters.GetOneBool("regularize", false);
+    TileSettings tiles = TileSettings::Create(parameters, loc);
     return std::make_unique<BDPTIntegrator>(camera, sampler, aggregate, lights, maxDepth,
                                             visualizeStrategies, visualizeWeights,
-                                            lightStrategy, regularize);
+                                            lightStrategy, regularize, tiles);
 }
 
 STAT_PERCENT("Integrator/Acceptance rate", acceptedMutations, totalMutations);
@@ -2528,13 +2875,17 @@ void MLTIntegrator::Render() {
     Float b = std::accumulate(bootstrapWeights.begin(), bootstrapWeights.end(), 0.) /
               bootstrapWeights.size() * (maxDepth + 1);
 
-    // Set up connection to display server, if enabled
-    if (!Options->displayServer.empty()) {
+    // Set up connection to display server and preview file, if enabled
+    if (!Options->displayServer.empty() || !Options->previewFile.empty()) {
         FilmHandle film = camera.GetFilm();
         Bounds2i pixelBounds = film.PixelBounds();
         DisplayDynamic(film.GetFilename(), Point2i(pixelBounds.Diagonal()),
                        {"R", "G", "B"},
-                       [=](Bounds2i b, pstd::span<pstd::span<Float>> displayValue) {
+                       [=](Bounds2i b,
+                           pstd::span<pstd::span<Float>> displayValue) mutable {
+                           // Have threads add their splats to the film for later
+                           // updates; this one may not include all of them
+                           film.RequestSplatFlush();
                            int index = 0;
                            for (Point2i p : b) {
                                RGB rgb = film.GetPixelRGB(pixelBounds.pMin + p);
@@ -2549,7 +2900,11 @@ void MLTIntegrator::Render() {
     FilmHandle film = camera.GetFilm();
     int64_t nTotalMutations =
         (int64_t)mutationsPerPixel * (int64_t)film.SampleBounds().Area();
+    // Number of mutations made, which is less than _nTotalMutations_ if the time
+    // limit is reached
+    std::atomic<int64_t> nMutationsMade{nTotalMutations};
     if (!lights.empty()) {
+        nMutationsMade = 0;
         // Allocate scratch buffers for MLT Markov chains
         std::vector<ScratchBuffer> threadScratchBuffers;
         for (int i = 0; i < MaxThreadIndex(); ++i)
@@ -2562,6 +2917,12 @@ void MLTIntegrator::Render() {
                 i * nTotalMutations / nChains;
             // Follow {i}th Markov chain for _nChainMutations_
             ScratchBuffer &scratchBuffer = threadScratchBuffers[ThreadIndex];
+            // Skip the chain if the time limit has already been reached
+            if (Options->timeLimit > 0 && timer.ElapsedSeconds() > Options->timeLimit) {
+                progress.Update(1);
+                return;
+            }
+
             // Select initial state from the set of bootstrap samples
             RNG rng(i);
             int bootstrapIndex = bootstrapTable.Sample(rng.Uniform<Float>());
@@ -2578,7 +2939,13 @@ void MLTIntegrator::Render() {
                 L(scratchBuffer, sampler, depth, &pCurrent, &lambdaCurrent);
 
             // Run the Markov chain for _nChainMutations_ steps
-            for (int64_t j = 0; j < nChainMutations; ++j) {
+            int64_t j = 0;
+            for (; j < nChainMutations; ++j) {
+                // Stop the chain early if the time limit has been reached
+                if (Options->timeLimit > 0 && j > 0 && (j % 256) == 0 &&
+                    timer.ElapsedSeconds() > Options->timeLimit)
+                    break;
+
                 StatsReportPixelStart(Point2i(pCurrent));
                 sampler.StartIteration();
                 Point2f pProposed;
@@ -2612,17 +2979,23 @@ void MLTIntegrator::Render() {
                 scratchBuffer.Reset();
                 StatsReportPixelEnd(Point2i(pCurrent));
             }
+            nMutationsMade += j;
 
             progress.Update(1);
         });
         progress.Done();
     }
 
-    // Store final image computed with MLT
+    // Store final image computed with MLT, normalized by the mutations made
+    Float mutationsMadePerPixel =
+        (nMutationsMade == nTotalMutations)
+            ? mutationsPerPixel
+            : Float(std::max<int64_t>(1, nMutationsMade)) / film.SampleBounds().Area();
     ImageMetadata metadata;
     metadata.renderTimeSeconds = timer.ElapsedSeconds();
+    metadata.samplesPerPixel = std::round(mutationsMadePerPixel);
     camera.InitMetadata(&metadata);
-    camera.GetFilm().WriteImage(metadata, b / mutationsPerPixel);
+    camera.GetFilm().WriteImage(metadata, b / mutationsMadePerPixel);
 }
 
 std::string MLTIntegrator::ToString() const {
@@ -2740,6 +3113,9 @@ void SPPMIntegrator::Render() {
         // TODO: size this
         perThreadScratchBuffers.push_back(ScratchBuffer(nPixels * 1024));
 
+    // Write images in the background while the following iterations run
+    AsyncImageWriter imageWriter;
+
     for (int iter = 0; iter < nIterations; ++iter) {
         // Generate SPPM visible points
         // Sample wavelengths for SPPM pass
@@ -3062,9 +3438,14 @@ void SPPMIntegrator::Render() {
             p.vp.bsdf = BSDF();
         });
 
+        // Stop if another iteration is not expected to finish within the time limit
+        bool outOfTime = Options->timeLimit > 0 &&
+                         progress.ElapsedSeconds() * (iter + 2) / (iter + 1) >
+                             Options->timeLimit;
+
         // Periodically store SPPM image in film and write image
-        if (iter + 1 == nIterations || (iter + 1 <= 64 && IsPowerOf2(iter + 1)) ||
-            ((iter + 1) % 64 == 0)) {
+        if (iter + 1 == nIterations || outOfTime ||
+            (iter + 1 <= 64 && IsPowerOf2(iter + 1)) || ((iter + 1) % 64 == 0)) {
             uint64_t Np = (uint64_t)(iter + 1) * (uint64_t)photonsPerIteration;
             Image rgbImage(PixelFormat::Float, Point2i(pixelBounds.Diagonal()),
                            {"R", "G", "B"});
@@ -3085,7 +3466,8 @@ void SPPMIntegrator::Render() {
             metadata.fullResolution = camera.GetFilm().FullResolution();
             metadata.colorSpace = colorSpace;
             camera.InitMetadata(&metadata);
-            rgbImage.Write(camera.GetFilm().GetFilename(), metadata);
+            imageWriter.Write(std::move(rgbImage), metadata,
+                              camera.GetFilm().GetFilename());
 
             // Write SPPM radius image, if requested
             if (getenv("SPPM_RADIUS") != nullptr) {
@@ -3111,6 +3493,11 @@ void SPPMIntegrator::Render() {
                 rimg.Write("sppm_radius.png", metadata);
             }
         }
+
+        if (outOfTime) {
+            LOG_VERBOSE("Time limit reached after %d SPPM iterations", iter + 1);
+            break;
+        }
     }
 #if 0
     // FIXME
@@ -50,6 +50,8 @@ class Integrator {
     pstd::optional<ShapeIntersection> Intersect(const Ray &ray,
                                                 Float tMax = Infinity) const;
     bool IntersectP(const Ray &ray, Float tMax = Infinity) const;
+    void IntersectPN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                     pstd::span<bool> occluded) const;
 
     virtual void Render() = 0;
 
@@ -84,13 +86,34 @@ class Integrator {
     Bounds3f sceneBounds;
 };
 
+// Merges the render checkpoints of ImageTileIntegrator renders of disjoint
+// ranges of sample indices into _camera_'s film and writes the final image.
+void MergeRenderCheckpoints(const std::vector<std::string> &filenames,
+                            CameraHandle camera);
+
+// TileSettings Definition
+// Order and size of the image tiles that an _ImageTileIntegrator_ renders. A
+// _size_ of zero selects a size based on the image size and the number of
+// threads.
+struct TileSettings {
+    static TileSettings Create(const ParameterDictionary &parameters,
+                               const FileLoc *loc);
+
+    TileOrder order = TileOrder::Hilbert;
+    int size = 0;
+};
+
 // ImageTileIntegrator Definition
 class ImageTileIntegrator : public Integrator {
   public:
     // ImageTileIntegrator Public Methods
     ImageTileIntegrator(CameraHandle camera, SamplerHandle sampler,
-                        PrimitiveHandle aggregate, std::vector<LightHandle> lights)
-        : Integrator(aggregate, lights), camera(camera), samplerPrototype(sampler) {}
+                        PrimitiveHandle aggregate, std::vector<LightHandle> lights,
+                        TileSettings tiles = {})
+        : Integrator(aggregate, lights),
+          camera(camera),
+          samplerPrototype(sampler),
+          tiles(tiles) {}
 
     void Render();
 
@@ -98,10 +121,15 @@ class ImageTileIntegrator : public Integrator {
                                      SamplerHandle sampler,
                                      ScratchBuffer &scratchBuffer) = 0;
 
+    // Integrators that splat to arbitrary pixels need all pixels to be
+    // sampled equally and so can't sample adaptively.
+    virtual bool SupportsAdaptiveSampling() const { return true; }
+
   protected:
     // ImageTileIntegrator Protected Members
     CameraHandle camera;
     SamplerHandle samplerPrototype;
+    TileSettings tiles;
 };
 
 // RayIntegrator Definition
@@ -109,8 +137,8 @@ class RayIntegrator : public ImageTileIntegrator {
   public:
     // RayIntegrator Public Methods
     RayIntegrator(CameraHandle camera, SamplerHandle sampler, PrimitiveHandle aggregate,
-                  std::vector<LightHandle> lights)
-        : ImageTileIntegrator(camera, sampler, aggregate, lights) {}
+                  std::vector<LightHandle> lights, TileSettings tiles = {})
+        : ImageTileIntegrator(camera, sampler, aggregate, lights, tiles) {}
 
     void EvaluatePixelSample(const Point2i &pPixel, int sampleIndex,
                              SamplerHandle sampler, ScratchBuffer &scratchBuffer) final;
@@ -125,8 +153,9 @@ class RandomWalkIntegrator : public RayIntegrator {
   public:
     // RandomWalkIntegrator Public Methods
     RandomWalkIntegrator(int maxDepth, CameraHandle camera, SamplerHandle sampler,
-                         PrimitiveHandle aggregate, std::vector<LightHandle> lights)
-        : RayIntegrator(camera, sampler, aggregate, lights), maxDepth(maxDepth) {}
+                         PrimitiveHandle aggregate, std::vector<LightHandle> lights,
+                         TileSettings tiles = {})
+        : RayIntegrator(camera, sampler, aggregate, lights, tiles), maxDepth(maxDepth) {}
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda,
                        SamplerHandle sampler, ScratchBuffer &scratchBuffer,
                        VisibleSurface *visibleSurface = nullptr) const;
@@ -153,7 +182,8 @@ class SimplePathIntegrator : public RayIntegrator {
     // SimplePathIntegrator Public Methods
     SimplePathIntegrator(int maxDepth, bool sampleLights, bool sampleBSDF,
                          CameraHandle camera, SamplerHandle sampler,
-                         PrimitiveHandle aggregate, std::vector<LightHandle> lights);
+                         PrimitiveHandle aggregate, std::vector<LightHandle> lights,
+                         TileSettings tiles = {});
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda,
                        SamplerHandle sampler, ScratchBuffer &scratchBuffer,
@@ -179,7 +209,7 @@ class PathIntegrator : public RayIntegrator {
     PathIntegrator(int maxDepth, CameraHandle camera, SamplerHandle sampler,
                    PrimitiveHandle aggregate, std::vector<LightHandle> lights,
                    Float rrThreshold = 1, const std::string &lightSampleStrategy = "bvh",
-                   bool regularize = false);
+                   bool regularize = false, TileSettings tiles = {});
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda,
                        SamplerHandle sampler, ScratchBuffer &scratchBuffer,
@@ -208,7 +238,8 @@ class SimpleVolPathIntegrator : public RayIntegrator {
   public:
     // SimpleVolPathIntegrator Public Methods
     SimpleVolPathIntegrator(int maxDepth, CameraHandle camera, SamplerHandle sampler,
-                            PrimitiveHandle aggregate, std::vector<LightHandle> lights);
+                            PrimitiveHandle aggregate, std::vector<LightHandle> lights,
+                            TileSettings tiles = {});
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda,
                        SamplerHandle sampler, ScratchBuffer &scratchBuffer,
@@ -233,8 +264,8 @@ class VolPathIntegrator : public RayIntegrator {
                       PrimitiveHandle aggregate, std::vector<LightHandle> lights,
                       Float rrThreshold = 1,
                       const std::string &lightSampleStrategy = "bvh",
-                      bool regularize = false)
-        : RayIntegrator(camera, sampler, aggregate, lights),
+                      bool regularize = false, TileSettings tiles = {})
+        : RayIntegrator(camera, sampler, aggregate, lights, tiles),
           maxDepth(maxDepth),
           rrThreshold(rrThreshold),
           lightSampler(
@@ -280,9 +311,10 @@ class VolPathIntegrator : public RayIntegrator {
 class AOIntegrator : public RayIntegrator {
   public:
     // AOIntegrator Public Methods
-    AOIntegrator(bool cosSample, Float maxDist, CameraHandle camera,
+    AOIntegrator(bool cosSample, Float maxDist, int nSamples, CameraHandle camera,
                  SamplerHandle sampler, PrimitiveHandle aggregate,
-                 std::vector<LightHandle> lights, SpectrumHandle illuminant);
+                 std::vector<LightHandle> lights, SpectrumHandle illuminant,
+                 TileSettings tiles = {});
 
     SampledSpectrum Li(RayDifferential ray, SampledWavelengths &lambda,
                        SamplerHandle sampler, ScratchBuffer &scratchBuffer,
@@ -298,6 +330,7 @@ class AOIntegrator : public RayIntegrator {
   private:
     bool cosSample;
     Float maxDist;
+    int nSamples;
     SpectrumHandle illuminant;
 };
 
@@ -306,11 +339,14 @@ class LightPathIntegrator : public ImageTileIntegrator {
   public:
     // LightPathIntegrator Public Methods
     LightPathIntegrator(int maxDepth, CameraHandle camera, SamplerHandle sampler,
-                        PrimitiveHandle aggregate, std::vector<LightHandle> lights);
+                        PrimitiveHandle aggregate, std::vector<LightHandle> lights,
+                        TileSettings tiles = {});
 
     void EvaluatePixelSample(const Point2i &pPixel, int sampleIndex,
                              SamplerHandle sampler, ScratchBuffer &scratchBuffer);
 
+    bool SupportsAdaptiveSampling() const { return false; }
+
     static std::unique_ptr<LightPathIntegrator> Create(
         const ParameterDictionary &parameters, CameraHandle camera, SamplerHandle sampler,
         PrimitiveHandle aggregate, std::vector<LightHandle> lights, const FileLoc *loc);
@@ -332,8 +368,8 @@ class BDPTIntegrator : public RayIntegrator {
                    std::vector<LightHandle> lights, int maxDepth,
                    bool visualizeStrategies, bool visualizeWeights,
                    const std::string &lightSampleStrategy = "power",
-                   bool regularize = false)
-        : RayIntegrator(camera, sampler, aggregate, lights),
+                   bool regularize = false, TileSettings tiles = {})
+        : RayIntegrator(camera, sampler, aggregate, lights, tiles),
           maxDepth(maxDepth),
           visualizeStrategies(visualizeStrategies),
           visualizeWeights(visualizeWeights),
@@ -353,6 +389,8 @@ class BDPTIntegrator : public RayIntegrator {
 
     void Render();
 
+    bool SupportsAdaptiveSampling() const { return false; }
+
   private:
     // BDPTIntegrator Private Members
     int maxDepth;
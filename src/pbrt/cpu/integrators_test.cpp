@@ -7,10 +7,13 @@
 #include <pbrt/cameras.h>
 #include <pbrt/cpu/accelerators.h>
 #include <pbrt/cpu/integrators.h>
+#include <pbrt/cpu/render.h>
 #include <pbrt/filters.h>
 #include <pbrt/lights.h>
 #include <pbrt/materials.h>
 #include <pbrt/options.h>
+#include <pbrt/parsedscene.h>
+#include <pbrt/parser.h>
 #include <pbrt/pbrt.h>
 #include <pbrt/samplers.h>
 #include <pbrt/shapes.h>
@@ -18,6 +21,7 @@
 #include <pbrt/util/color.h>
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/image.h>
+#include <pbrt/util/print.h>
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/vecmath.h>
 
@@ -419,3 +423,26 @@ TEST_P(RenderTest, RadianceMatches) {
 
 INSTANTIATE_TEST_CASE_P(AnalyticTestScenes, RenderTest,
                         testing::ValuesIn(GetIntegrators()));
+
+TEST(CPURender, TwoScenesInARow) {
+    // Each render frees its triangle mesh primitives when it's done, so a
+    // second scene must not see the first one's meshes.
+    for (Float L : {Float(0.5), Float(0.25)}) {
+        ParsedScene scene;
+        ParseString(&scene, StringPrintf(R"(
+Film "rgb" "integer xresolution" 16 "integer yresolution" 16
+    "string filename" "%s"
+Sampler "halton" "integer pixelsamples" 4
+Integrator "path" "integer maxdepth" 1
+Camera "perspective" "float fov" 30
+WorldBegin
+AreaLightSource "diffuse" "rgb L" [ %f %f %f ] "bool twosided" true
+Shape "trianglemesh" "point3 P" [ -10 -10 5  10 -10 5  10 10 5  -10 10 5 ]
+    "integer indices" [ 0 1 2  0 2 3 ]
+)",
+                                         inTestDir("test.exr"), L, L, L));
+        CPURender(scene);
+        CheckSceneAverage(inTestDir("test.exr"), L);
+        EXPECT_EQ(0, remove(inTestDir("test.exr").c_str()));
+    }
+}
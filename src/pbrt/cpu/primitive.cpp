@@ -14,6 +14,8 @@
 #include <pbrt/util/taggedptr.h>
 #include <pbrt/util/vecmath.h>
 
+#include <mutex>
+
 namespace pbrt {
 
 Bounds3f PrimitiveHandle::Bounds() const {
@@ -32,6 +34,15 @@ bool PrimitiveHandle::IntersectP(const Ray &r, Float tMax) const {
     return DispatchCPU(isectp);
 }
 
+void PrimitiveHandle::IntersectPN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                                  pstd::span<bool> occluded) const {
+    // Only the BVH amortizes traversal over ray streams; trace others one by one
+    if (Is<BVHAccel>())
+        return Cast<BVHAccel>()->IntersectPN(rays, tMax, occluded);
+    for (size_t i = 0; i < rays.size(); ++i)
+        occluded[i] = IntersectP(rays[i], tMax[i]);
+}
+
 // GeometricPrimitive Method Definitions
 GeometricPrimitive::GeometricPrimitive(ShapeHandle shape, MaterialHandle material,
                                        LightHandle areaLight,
@@ -120,6 +131,62 @@ pstd::optional<ShapeIntersection> SimplePrimitive::Intersect(const Ray &r,
     return si;
 }
 
+// TrianglePrimitive Method Definitions
+std::vector<const TriangleMeshPrimitive *> TrianglePrimitive::meshPrimitives;
+static std::mutex meshPrimitivesMutex;
+
+void TrianglePrimitive::AddMesh(int meshIndex,
+                                const TriangleMeshPrimitive *meshPrimitive) {
+    std::lock_guard<std::mutex> lock(meshPrimitivesMutex);
+    if (meshIndex >= meshPrimitives.size())
+        meshPrimitives.resize(meshIndex + 1);
+    meshPrimitives[meshIndex] = meshPrimitive;
+}
+
+void TrianglePrimitive::ClearMeshes() {
+    std::lock_guard<std::mutex> lock(meshPrimitivesMutex);
+    meshPrimitives.clear();
+    meshPrimitives.shrink_to_fit();
+}
+
+pstd::optional<ShapeIntersection> TrianglePrimitive::Intersect(const Ray &r,
+                                                               Float tMax) const {
+    pstd::optional<ShapeIntersection> si = triangle.Intersect(r, tMax);
+    if (!si)
+        return {};
+    CHECK_LT(si->tHit, 1.001 * tMax);
+    const TriangleMeshPrimitive *meshPrimitive = meshPrimitives[triangle.MeshIndex()];
+    // Test intersection against alpha texture, if present
+    if (meshPrimitive->alpha && meshPrimitive->alpha.Evaluate(si->intr) == 0) {
+        Ray rNext = si->intr.SpawnRay(r.d);
+        pstd::optional<ShapeIntersection> siNext = Intersect(rNext, tMax - si->tHit);
+        if (siNext)
+            siNext->tHit += si->tHit;
+        return siNext;
+    }
+
+    // Initialize _SurfaceInteraction_ from the mesh's shared properties
+    si->intr.areaLight = meshPrimitive->areaLights
+                             ? meshPrimitive->areaLights[triangle.TriangleIndex()]
+                             : nullptr;
+    si->intr.material = meshPrimitive->material;
+    CHECK_GE(Dot(si->intr.n, si->intr.shading.n), 0.);
+    if (meshPrimitive->mediumInterface.IsMediumTransition())
+        si->intr.mediumInterface = &meshPrimitive->mediumInterface;
+    else
+        si->intr.medium = r.medium;
+    return si;
+}
+
+bool TrianglePrimitive::IntersectP(const Ray &r, Float tMax) const {
+    const TriangleMeshPrimitive *meshPrimitive = meshPrimitives[triangle.MeshIndex()];
+    if (meshPrimitive->material && meshPrimitive->material.IsTransparent())
+        return false;
+    if (meshPrimitive->alpha)
+        return Intersect(r, tMax).has_value();
+    return triangle.IntersectP(r, tMax);
+}
+
 // TransformedPrimitive Method Definitions
 pstd::optional<ShapeIntersection> TransformedPrimitive::Intersect(const Ray &r,
                                                                   Float tMax) const {
@@ -12,11 +12,13 @@
 #include <pbrt/base/medium.h>
 #include <pbrt/base/shape.h>
 #include <pbrt/base/texture.h>
+#include <pbrt/shapes.h>
 #include <pbrt/util/stats.h>
 #include <pbrt/util/taggedptr.h>
 #include <pbrt/util/transform.h>
 
 #include <memory>
+#include <vector>
 
 namespace pbrt {
 
@@ -24,15 +26,18 @@ STAT_MEMORY_COUNTER("Memory/Primitives", primitiveMemory);
 
 class SimplePrimitive;
 class GeometricPrimitive;
+class TrianglePrimitive;
 class TransformedPrimitive;
 class AnimatedPrimitive;
 class BVHAccel;
 class KdTreeAccel;
+class InstanceBVHAccel;
 
 // PrimitiveHandle Definition
 class PrimitiveHandle
-    : public TaggedPointer<SimplePrimitive, GeometricPrimitive, TransformedPrimitive,
-                           AnimatedPrimitive, BVHAccel, KdTreeAccel> {
+    : public TaggedPointer<SimplePrimitive, GeometricPrimitive, TrianglePrimitive,
+                           TransformedPrimitive, AnimatedPrimitive, BVHAccel, KdTreeAccel,
+                           InstanceBVHAccel> {
   public:
     // Primitive Interface
     using TaggedPointer::TaggedPointer;
@@ -42,6 +47,9 @@ class PrimitiveHandle
     pstd::optional<ShapeIntersection> Intersect(const Ray &r,
                                                 Float tMax = Infinity) const;
     bool IntersectP(const Ray &r, Float tMax = Infinity) const;
+
+    void IntersectPN(pstd::span<const Ray> rays, pstd::span<const Float> tMax,
+                     pstd::span<bool> occluded) const;
 };
 
 // GeometricPrimitive Definition
@@ -52,6 +60,7 @@ class GeometricPrimitive {
                        const MediumInterface &mediumInterface,
                        FloatTextureHandle alpha = nullptr);
     Bounds3f Bounds() const;
+    ShapeHandle GetShape() const { return shape; }
     pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
     bool IntersectP(const Ray &r, Float tMax) const;
 
@@ -69,6 +78,7 @@ class SimplePrimitive {
   public:
     // SimplePrimitive Public Methods
     Bounds3f Bounds() const;
+    ShapeHandle GetShape() const { return shape; }
     pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
     bool IntersectP(const Ray &r, Float tMax) const;
     SimplePrimitive(ShapeHandle shape, MaterialHandle material);
@@ -78,6 +88,48 @@ class SimplePrimitive {
     MaterialHandle material;
 };
 
+// TriangleMeshPrimitive Definition
+struct TriangleMeshPrimitive {
+    TriangleMeshPrimitive(MaterialHandle material,
+                          const MediumInterface &mediumInterface,
+                          FloatTextureHandle alpha, const LightHandle *areaLights)
+        : material(material),
+          mediumInterface(mediumInterface),
+          alpha(alpha),
+          areaLights(areaLights) {
+        primitiveMemory += sizeof(*this);
+    }
+
+    MaterialHandle material;
+    MediumInterface mediumInterface;
+    FloatTextureHandle alpha;
+    // Indexed by triangle; _nullptr_ if the mesh isn't emissive
+    const LightHandle *areaLights;
+};
+
+// TrianglePrimitive Definition
+class TrianglePrimitive {
+  public:
+    // TrianglePrimitive Public Methods
+    static void AddMesh(int meshIndex, const TriangleMeshPrimitive *meshPrimitive);
+    // Must be called before the memory holding the added meshes is released
+    static void ClearMeshes();
+
+    TrianglePrimitive(const Triangle &triangle) : triangle(triangle) {
+        primitiveMemory += sizeof(*this);
+    }
+
+    Bounds3f Bounds() const { return triangle.Bounds(); }
+    const Triangle *GetTriangle() const { return &triangle; }
+    pstd::optional<ShapeIntersection> Intersect(const Ray &r, Float tMax) const;
+    bool IntersectP(const Ray &r, Float tMax) const;
+
+  private:
+    // TrianglePrimitive Private Members
+    Triangle triangle;
+    static std::vector<const TriangleMeshPrimitive *> meshPrimitives;
+};
+
 // TransformedPrimitive Definition
 class TransformedPrimitive {
   public:
@@ -12,16 +12,24 @@
 #include <pbrt/lights.h>
 #include <pbrt/materials.h>
 #include <pbrt/media.h>
+#include <pbrt/options.h>
 #include <pbrt/parsedscene.h>
 #include <pbrt/samplers.h>
 #include <pbrt/shapes.h>
 #include <pbrt/textures.h>
 #include <pbrt/util/colorspace.h>
+#include <pbrt/util/hash.h>
+#include <pbrt/util/parallel.h>
+
+#include <algorithm>
 
 namespace pbrt {
 
 void CPURender(ParsedScene &parsedScene) {
     Allocator alloc;
+    // Triangle primitives are allocated in bulk for each mesh
+    pstd::pmr::monotonic_buffer_resource primitiveResource;
+    Allocator primitiveAlloc(&primitiveResource);
 
     // Create media first (so have them for the camera...)
     std::map<std::string, MediumHandle> media = parsedScene.CreateMedia(alloc);
@@ -45,9 +53,13 @@ void CPURender(ParsedScene &parsedScene) {
                              &parsedScene.filter.loc, alloc);
 
     // Film
+    // Only the integrators that splat need storage for splats in the film
+    bool storeSplats = parsedScene.integrator.name == "lightpath" ||
+                       parsedScene.integrator.name == "bdpt" ||
+                       parsedScene.integrator.name == "mlt";
     FilmHandle film =
         FilmHandle::Create(parsedScene.film.name, parsedScene.film.parameters,
-                           &parsedScene.film.loc, filter, alloc);
+                           &parsedScene.film.loc, filter, storeSplats, alloc);
 
     // Camera
     MediumHandle cameraMedium =
@@ -56,6 +68,12 @@ void CPURender(ParsedScene &parsedScene) {
         parsedScene.camera.name, parsedScene.camera.parameters, cameraMedium,
         parsedScene.camera.cameraTransform, film, &parsedScene.camera.loc, alloc);
 
+    // Merge the render checkpoints rather than rendering, if requested
+    if (!Options->mergeCheckpointFiles.empty()) {
+        MergeRenderCheckpoints(Options->mergeCheckpointFiles, camera);
+        return;
+    }
+
     // Create _Sampler_ for rendering
     SamplerHandle sampler = SamplerHandle::Create(
         parsedScene.sampler.name, parsedScene.sampler.parameters,
@@ -112,12 +130,31 @@ void CPURender(ParsedScene &parsedScene) {
     // Non-animated shapes
     auto CreatePrimitivesForShapes =
         [&](const std::vector<ShapeSceneEntity> &shapes) -> std::vector<PrimitiveHandle> {
-        std::vector<PrimitiveHandle> primitives;
-        for (const auto &sh : shapes) {
-            pstd::vector<ShapeHandle> shapes =
+        // Create shapes in parallel; this is where meshes are read and built
+        std::vector<pstd::vector<ShapeHandle>> entityShapes(shapes.size());
+        ParallelFor(0, shapes.size(), [&](int64_t i) {
+            const auto &sh = shapes[i];
+            entityShapes[i] =
                 ShapeHandle::Create(sh.name, sh.renderFromObject, sh.objectFromRender,
                                     sh.reverseOrientation, sh.parameters, &sh.loc, alloc);
-            if (shapes.empty())
+        });
+
+        // Find each entity's material, media, and area lights in scene order
+        struct EntityPrimitives {
+            int entityIndex;
+            size_t offset;
+            MaterialHandle mtl;
+            MediumInterface mi;
+            FloatTextureHandle alphaTex;
+            std::vector<LightHandle> areaLights;
+            size_t nTriangles;
+            TrianglePrimitive *triangles;
+        };
+        std::vector<EntityPrimitives> entityPrimitives;
+        size_t nPrimitives = 0;
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            const auto &sh = shapes[i];
+            if (entityShapes[i].empty())
                 continue;
 
             FloatTextureHandle alphaTex = getAlphaTexture(sh.parameters, &sh.loc);
@@ -137,27 +174,85 @@ void CPURender(ParsedScene &parsedScene) {
             MediumInterface mi(findMedium(sh.insideMedium, &sh.loc),
                                findMedium(sh.outsideMedium, &sh.loc));
 
-            for (auto &s : shapes) {
-                // Possibly create area light for shape
-                LightHandle areaHandle = nullptr;
-                if (sh.lightIndex != -1) {
-                    CHECK_LT(sh.lightIndex, parsedScene.areaLights.size());
-                    const auto &areaLightEntity = parsedScene.areaLights[sh.lightIndex];
-
+            // Possibly create area lights for the entity's shapes
+            std::vector<LightHandle> areaLights;
+            if (sh.lightIndex != -1) {
+                CHECK_LT(sh.lightIndex, parsedScene.areaLights.size());
+                const auto &areaLightEntity = parsedScene.areaLights[sh.lightIndex];
+                for (ShapeHandle s : entityShapes[i]) {
                     LightHandle area = LightHandle::CreateArea(
                         areaLightEntity.name, areaLightEntity.parameters,
                         *sh.renderFromObject, mi, s, &areaLightEntity.loc, Allocator{});
-                    areaHandle = area;
+                    areaLights.push_back(area);
                     if (area)
                         lights.push_back(area);
                 }
-                if (areaHandle == nullptr && !mi.IsMediumTransition() && !alphaTex)
-                    primitives.push_back(new SimplePrimitive(s, mtl));
-                else
-                    primitives.push_back(
-                        new GeometricPrimitive(s, mtl, areaHandle, mi, alphaTex));
             }
+
+            // Share the entity's properties among the triangles of its mesh, if any;
+            // meshes create their triangles before any other shapes
+            const pstd::vector<ShapeHandle> &es = entityShapes[i];
+            size_t nTriangles =
+                std::partition_point(es.begin(), es.end(),
+                                     [](ShapeHandle s) { return s.Is<Triangle>(); }) -
+                es.begin();
+            TrianglePrimitive *triangles = nullptr;
+            if (nTriangles > 0) {
+                LightHandle *meshAreaLights = nullptr;
+                if (!areaLights.empty()) {
+                    meshAreaLights =
+                        primitiveAlloc.allocate_object<LightHandle>(nTriangles);
+                    std::copy(areaLights.begin(), areaLights.begin() + nTriangles,
+                              meshAreaLights);
+                }
+                TrianglePrimitive::AddMesh(
+                    es[0].Cast<Triangle>()->MeshIndex(),
+                    primitiveAlloc.new_object<TriangleMeshPrimitive>(mtl, mi, alphaTex,
+                                                                     meshAreaLights));
+                triangles = primitiveAlloc.allocate_object<TrianglePrimitive>(nTriangles);
+            }
+
+            entityPrimitives.push_back(EntityPrimitives{int(i), nPrimitives, mtl, mi,
+                                                        alphaTex, std::move(areaLights),
+                                                        nTriangles, triangles});
+            nPrimitives += entityShapes[i].size();
         }
+
+        // Create primitives in parallel, in the order of their shapes
+        std::vector<PrimitiveHandle> primitives(nPrimitives);
+        if (nPrimitives == 0)
+            return primitives;
+        ParallelFor(0, nPrimitives, [&](int64_t start, int64_t end) {
+            // Find the entity that the first primitive in the range comes from
+            auto iter = std::upper_bound(entityPrimitives.begin(), entityPrimitives.end(),
+                                         size_t(start),
+                                         [](size_t index, const EntityPrimitives &ep) {
+                                             return index < ep.offset;
+                                         });
+            const EntityPrimitives *ep = &*(iter - 1);
+
+            for (size_t index = start; index < end; ++index) {
+                if (index - ep->offset == entityShapes[ep->entityIndex].size())
+                    ++ep;
+                size_t shapeIndex = index - ep->offset;
+                ShapeHandle s = entityShapes[ep->entityIndex][shapeIndex];
+                if (shapeIndex < ep->nTriangles) {
+                    const Triangle *tri = s.Cast<Triangle>();
+                    DCHECK_EQ(tri->TriangleIndex(), int(shapeIndex));
+                    primitiveAlloc.construct(&ep->triangles[shapeIndex], *tri);
+                    primitives[index] = &ep->triangles[shapeIndex];
+                    continue;
+                }
+                LightHandle areaHandle =
+                    ep->areaLights.empty() ? nullptr : ep->areaLights[shapeIndex];
+                if (areaHandle == nullptr && !ep->mi.IsMediumTransition() &&
+                    !ep->alphaTex)
+                    primitives[index] = new SimplePrimitive(s, ep->mtl);
+                else
+                    primitives[index] = new GeometricPrimitive(s, ep->mtl, areaHandle,
+                                                               ep->mi, ep->alphaTex);
+            }
+        });
         return primitives;
     };
 
@@ -171,10 +266,18 @@ void CPURender(ParsedScene &parsedScene) {
         std::vector<PrimitiveHandle> primitives;
         primitives.reserve(shapes.size());
 
-        for (const auto &sh : shapes) {
-            pstd::vector<ShapeHandle> shapes =
+        // Create shapes in parallel before making their primitives in order
+        std::vector<pstd::vector<ShapeHandle>> entityShapes(shapes.size());
+        ParallelFor(0, shapes.size(), [&](int64_t i) {
+            const auto &sh = shapes[i];
+            entityShapes[i] =
                 ShapeHandle::Create(sh.name, sh.identity, sh.identity,
                                     sh.reverseOrientation, sh.parameters, &sh.loc, alloc);
+        });
+
+        for (size_t i = 0; i < shapes.size(); ++i) {
+            const auto &sh = shapes[i];
+            const pstd::vector<ShapeHandle> &shapes = entityShapes[i];
             if (shapes.empty())
                 continue;
 
@@ -242,11 +345,59 @@ void CPURender(ParsedScene &parsedScene) {
                       animatedPrimitives.end());
 
     // Instance definitions
-    std::map<std::string, PrimitiveHandle> instanceDefinitions;
+    // Each definition gets a bottom-level BVH, shared between definitions with
+    // identical shapes.
+    std::map<std::string, const BVHAccel *> instanceDefinitions;
+    std::map<uint64_t, std::vector<std::pair<const std::vector<ShapeSceneEntity> *,
+                                             const BVHAccel *>>>
+        sharedBLASes;
+    // Definitions with the same hash are only shared if their shapes match
+    auto sameShapes = [](const std::vector<ShapeSceneEntity> &a,
+                         const std::vector<ShapeSceneEntity> &b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                          [](const ShapeSceneEntity &sa, const ShapeSceneEntity &sb) {
+                              return sa.name == sb.name &&
+                                     sa.renderFromObject == sb.renderFromObject &&
+                                     sa.reverseOrientation == sb.reverseOrientation &&
+                                     sa.materialIndex == sb.materialIndex &&
+                                     sa.materialName == sb.materialName &&
+                                     sa.insideMedium == sb.insideMedium &&
+                                     sa.outsideMedium == sb.outsideMedium &&
+                                     sa.parameters.ContentEquals(sb.parameters);
+                          });
+    };
     for (const auto &inst : parsedScene.instanceDefinitions) {
         if (instanceDefinitions.find(inst.first) != instanceDefinitions.end())
             ErrorExit("%s: object instance redefined", inst.first);
 
+        // Compute hash of static shapes for BLAS sharing
+        uint64_t definitionHash = 0;
+        bool shareable = inst.second.animatedShapes.empty();
+        for (const auto &sh : inst.second.shapes) {
+            // Area lights must be created for each definition
+            shareable &= (sh.lightIndex == -1);
+            definitionHash = Hash(definitionHash, sh.parameters.ContentHash(),
+                                  sh.renderFromObject, sh.reverseOrientation,
+                                  sh.materialIndex);
+            for (const std::string *str : {&sh.name, &sh.materialName, &sh.insideMedium,
+                                           &sh.outsideMedium})
+                definitionHash = HashBuffer(str->data(), str->size(),
+                                            Hash(definitionHash, str->size()));
+        }
+        const BVHAccel *sharedBLAS = nullptr;
+        if (shareable && !inst.second.shapes.empty())
+            for (const auto &candidate : sharedBLASes[definitionHash])
+                if (sameShapes(*candidate.first, inst.second.shapes)) {
+                    sharedBLAS = candidate.second;
+                    break;
+                }
+        if (sharedBLAS) {
+            LOG_VERBOSE("Object instance \"%s\" shares its BVH with an identical "
+                        "definition", inst.first);
+            instanceDefinitions[inst.first] = sharedBLAS;
+            continue;
+        }
+
         std::vector<PrimitiveHandle> instancePrimitives =
             CreatePrimitivesForShapes(inst.second.shapes);
         std::vector<PrimitiveHandle> movingInstancePrimitives =
@@ -254,19 +405,20 @@ void CPURender(ParsedScene &parsedScene) {
         instancePrimitives.insert(instancePrimitives.end(),
                                   movingInstancePrimitives.begin(),
                                   movingInstancePrimitives.end());
-        if (instancePrimitives.empty()) {
+        if (instancePrimitives.empty())
             instanceDefinitions[inst.first] = nullptr;
-        } else {
-            if (instancePrimitives.size() > 1) {
-                PrimitiveHandle bvh = new BVHAccel(std::move(instancePrimitives));
-                instancePrimitives.clear();
-                instancePrimitives.push_back(bvh);
-            }
-            instanceDefinitions[inst.first] = instancePrimitives[0];
+        else {
+            const BVHAccel *blas = new BVHAccel(std::move(instancePrimitives));
+            instanceDefinitions[inst.first] = blas;
+            if (shareable)
+                sharedBLASes[definitionHash].push_back(
+                    std::make_pair(&inst.second.shapes, blas));
         }
     }
 
     // Instances
+    std::vector<InstanceBVHAccel::Instance> instances;
+    instances.reserve(parsedScene.instances.size());
     for (const auto &inst : parsedScene.instances) {
         auto iter = instanceDefinitions.find(inst.name);
         if (iter == instanceDefinitions.end())
@@ -277,12 +429,12 @@ void CPURender(ParsedScene &parsedScene) {
             continue;
 
         if (inst.renderFromInstance)
-            primitives.push_back(
-                new TransformedPrimitive(iter->second, inst.renderFromInstance));
+            instances.push_back({iter->second, inst.renderFromInstance, nullptr});
         else
-            primitives.push_back(
-                new AnimatedPrimitive(iter->second, inst.renderFromInstanceAnim));
+            instances.push_back({iter->second, nullptr, &inst.renderFromInstanceAnim});
     }
+    if (!instances.empty())
+        primitives.push_back(new InstanceBVHAccel(instances));
 
     // Accelerator
     PrimitiveHandle accel = nullptr;
@@ -325,6 +477,10 @@ void CPURender(ParsedScene &parsedScene) {
                 "to render them correctly.",
                 parsedScene.integrator.name);
 
+    if (Options->sampleRangeEnd && !dynamic_cast<ImageTileIntegrator *>(integrator.get()))
+        ErrorExit("\"%s\" integrator doesn't support --sample-range.",
+                  parsedScene.integrator.name);
+
     LOG_VERBOSE("Memory used after scene creation: %d", GetCurrentRSS());
 
     // Render!
@@ -335,6 +491,8 @@ void CPURender(ParsedScene &parsedScene) {
     PtexTextureBase::ReportStats();
     ImageTextureBase::ClearCache();
     FreeBufferCaches();
+    // The triangle mesh primitives are freed along with _primitiveResource_
+    TrianglePrimitive::ClearMeshes();
 }
 
 }  // namespace pbrt
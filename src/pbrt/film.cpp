@@ -41,6 +41,21 @@ Image FilmHandle::GetImage(ImageMetadata *metadata, Float splatScale) {
     return DispatchCPU(get);
 }
 
+void FilmHandle::FlushSplats() {
+    auto flush = [&](auto ptr) { return ptr->FlushSplats(); };
+    return DispatchCPU(flush);
+}
+
+void FilmHandle::RequestSplatFlush() {
+    auto request = [&](auto ptr) { return ptr->RequestSplatFlush(); };
+    return DispatchCPU(request);
+}
+
+void FilmHandle::BindRowsToNumaNode(int yStart, int yEnd, int node) {
+    auto bind = [&](auto ptr) { return ptr->BindRowsToNumaNode(yStart, yEnd, node); };
+    return DispatchCPU(bind);
+}
+
 std::string FilmHandle::ToString() const {
     if (ptr() == nullptr)
         return "(nullptr)";
@@ -54,6 +69,61 @@ std::string FilmHandle::GetFilename() const {
     return DispatchCPU(get);
 }
 
+bool FilmHandle::WriteCheckpoint(FILE *f) {
+    auto write = [&](auto ptr) { return ptr->WriteCheckpoint(f); };
+    return DispatchCPU(write);
+}
+
+bool FilmHandle::ReadCheckpoint(FILE *f) {
+    auto read = [&](auto ptr) { return ptr->ReadCheckpoint(f); };
+    return DispatchCPU(read);
+}
+
+bool FilmHandle::MergeCheckpoint(FILE *f) {
+    auto merge = [&](auto ptr) { return ptr->MergeCheckpoint(f); };
+    return DispatchCPU(merge);
+}
+
+// Film Checkpoint Function Definitions
+// Checkpoints store the raw pixel accumulators, preceded by the pixel size
+// and count so that a mismatched film is detected when reading.
+template <typename Pixel>
+static bool WritePixels(const Array2D<Pixel> &pixels, FILE *f) {
+    uint64_t header[2] = {sizeof(Pixel), uint64_t(pixels.size())};
+    return fwrite(header, sizeof(header), 1, f) == 1 &&
+           fwrite(pixels.begin(), sizeof(Pixel), pixels.size(), f) == pixels.size();
+}
+
+template <typename Pixel>
+static bool ReadPixels(Array2D<Pixel> &pixels, FILE *f) {
+    uint64_t header[2];
+    if (fread(header, sizeof(header), 1, f) != 1 || header[0] != sizeof(Pixel) ||
+        header[1] != pixels.size())
+        return false;
+    return fread((void *)pixels.begin(), sizeof(Pixel), pixels.size(), f) ==
+           pixels.size();
+}
+
+// Arrays of per-pixel values that are only allocated when needed are stored
+// with a count of zero if they are empty. Storage for them is allocated with
+// _values_'s allocator.
+template <typename T>
+static bool ReadOptionalPixels(Array2D<T> &values, const Bounds2i &pixelBounds,
+                               FILE *f) {
+    uint64_t header[2];
+    if (fread(header, sizeof(header), 1, f) != 1 || header[0] != sizeof(T))
+        return false;
+    if (header[1] == 0) {
+        values = Array2D<T>(values.get_allocator());
+        return true;
+    }
+    if (header[1] != pixelBounds.Area())
+        return false;
+    if (values.size() == 0)
+        values = Array2D<T>(pixelBounds, values.get_allocator());
+    return fread((void *)values.begin(), sizeof(T), values.size(), f) == values.size();
+}
+
 // FilmBase Method Definitions
 std::string FilmBase::BaseToString() const {
     return StringPrintf("fullResolution: %s diagonal: %f filter: %s filename: %s "
@@ -91,14 +161,97 @@ std::string VisibleSurface::ToString() const {
 }
 
 STAT_MEMORY_COUNTER("Memory/Film pixels", filmPixelMemory);
+STAT_MEMORY_COUNTER("Memory/Film splat buffers", splatBufferMemory);
+
+// SplatBuffers Method Definitions
+SplatBuffers::SplatBuffers(const Bounds2i &pixelBounds, bool storeSplats,
+                           Allocator alloc)
+    : pixelBounds(pixelBounds), sums(alloc) {
+    if (!storeSplats)
+        return;
+    Vector2i extent = pixelBounds.Diagonal();
+    nTilesX = (extent.x + TileSize - 1) / TileSize;
+    nTiles = nTilesX * ((extent.y + TileSize - 1) / TileSize);
+    threadBuffers = std::vector<ThreadBuffer>(MaxThreadIndex());
+    tileMutexes.reset(new std::mutex[nTiles]);
+    sums = Array2D<SplatSum>(pixelBounds, alloc);
+    filmPixelMemory += pixelBounds.Area() * sizeof(SplatSum);
+}
+
+void SplatBuffers::AllocateBuffer(ThreadBuffer &buffer) {
+    CHECK_GT(sums.size(), 0);  // Film was created without splat storage
+    buffer.tiles.reset(new SplatSum[MaxThreadTiles * TileArea]);
+    buffer.tileIndices.reset(new int[MaxThreadTiles]);
+    buffer.tileSlots.reset(new int[nTiles]);
+    std::fill(&buffer.tileSlots[0], &buffer.tileSlots[nTiles], -1);
+    splatBufferMemory += MaxThreadTiles * (TileArea * sizeof(SplatSum) + sizeof(int)) +
+                         nTiles * sizeof(int);
+}
+
+void SplatBuffers::AddToSums(ThreadBuffer &buffer) {
+    for (int slot = 0; slot < buffer.nTiles; ++slot) {
+        // Add the thread's sums for the tile to _sums_ and reset them
+        int tile = buffer.tileIndices[slot];
+        Point2i pMin = pixelBounds.pMin +
+                       TileSize * Vector2i(tile % nTilesX, tile / nTilesX);
+        Bounds2i tileBounds =
+            Intersect(Bounds2i(pMin, pMin + Vector2i(TileSize, TileSize)), pixelBounds);
+        SplatSum *tileSums = &buffer.tiles[slot * TileArea];
+        std::lock_guard<std::mutex> lock(tileMutexes[tile]);
+        for (Point2i p : tileBounds) {
+            SplatSum &sum = tileSums[TileOffset(p)];
+            for (int c = 0; c < 3; ++c)
+                sums[p].rgb[c] += sum.rgb[c];
+            sum = SplatSum();
+        }
+        buffer.tileSlots[tile] = -1;
+    }
+    buffer.nTiles = 0;
+}
+
+void SplatBuffers::RequestFlush() {
+    for (ThreadBuffer &buffer : threadBuffers)
+        buffer.flushRequested = true;
+}
+
+void SplatBuffers::Flush() {
+    // No thread may be splatting, so their buffers can be added here
+    for (ThreadBuffer &buffer : threadBuffers) {
+        buffer.flushRequested = false;
+        AddToSums(buffer);
+    }
+}
+
+bool SplatBuffers::WriteCheckpoint(FILE *f) const {
+    return WritePixels(sums, f);
+}
+
+bool SplatBuffers::ReadCheckpoint(FILE *f) {
+    return ReadPixels(sums, f);
+}
+
+bool SplatBuffers::MergeCheckpoint(FILE *f) {
+    if (sums.size() == 0)
+        return ReadPixels(sums, f);
+    Array2D<SplatSum> checkpointSums(pixelBounds, sums.get_allocator());
+    if (!ReadPixels(checkpointSums, f))
+        return false;
+    for (Point2i p : pixelBounds)
+        for (int c = 0; c < 3; ++c)
+            sums[p].rgb[c] += checkpointSums[p].rgb[c];
+    return true;
+}
 
 // RGBFilm Method Definitions
 RGBFilm::RGBFilm(const Point2i &resolution, const Bounds2i &pixelBounds,
                  FilterHandle filter, Float diagonal, const std::string &filename,
                  Float scale, const RGBColorSpace *colorSpace, Float maxComponentValue,
-                 bool writeFP16, Allocator allocator)
+                 bool writeFP16, bool estimateVariance, bool storeSplats,
+                 Allocator allocator)
     : FilmBase(resolution, pixelBounds, filter, diagonal, filename),
       pixels(pixelBounds, allocator),
+      varianceEstimators(allocator),
+      splatBuffers(pixelBounds, storeSplats, allocator),
       scale(scale),
       colorSpace(colorSpace),
       maxComponentValue(maxComponentValue),
@@ -107,6 +260,10 @@ RGBFilm::RGBFilm(const Point2i &resolution, const Bounds2i &pixelBounds,
     CHECK(!pixelBounds.IsEmpty());
     CHECK(colorSpace != nullptr);
     filmPixelMemory += pixelBounds.Area() * sizeof(Pixel);
+    if (estimateVariance) {
+        varianceEstimators = Array2D<VarianceEstimator<Float>>(pixelBounds, allocator);
+        filmPixelMemory += pixelBounds.Area() * sizeof(VarianceEstimator<Float>);
+    }
 }
 
 SampledWavelengths RGBFilm::SampleWavelengths(Float u) const {
@@ -132,9 +289,11 @@ void RGBFilm::AddSplat(const Point2f &p, SampledSpectrum v,
         // Evaluate filter at _pi_ and add splat contribution
         Float wt = filter.Evaluate(Point2f(p - pi - Vector2f(0.5, 0.5)));
         if (wt != 0) {
-            Pixel &pixel = pixels[pi];
-            for (int i = 0; i < 3; ++i)
-                pixel.splatRGB[i].Add(wt * rgb[i]);
+#ifdef PBRT_IS_GPU_CODE
+            LOG_FATAL("Film splats aren't supported on the GPU.");
+#else
+            splatBuffers.Add(pi, wt, rgb);
+#endif
         }
     }
 }
@@ -145,7 +304,39 @@ void RGBFilm::WriteImage(ImageMetadata metadata, Float splatScale) {
     image.Write(filename, metadata);
 }
 
+bool RGBFilm::WriteCheckpoint(FILE *f) {
+    splatBuffers.Flush();
+    return WritePixels(pixels, f) && WritePixels(varianceEstimators, f) &&
+           splatBuffers.WriteCheckpoint(f);
+}
+
+bool RGBFilm::ReadCheckpoint(FILE *f) {
+    return ReadPixels(pixels, f) && ReadPixels(varianceEstimators, f) &&
+           splatBuffers.ReadCheckpoint(f);
+}
+
+bool RGBFilm::MergeCheckpoint(FILE *f) {
+    // Read the checkpoint's pixels and add their accumulated values to the film's
+    Array2D<Pixel> checkpointPixels(pixelBounds, pixels.get_allocator());
+    Array2D<VarianceEstimator<Float>> checkpointVariance(pixels.get_allocator());
+    if (!ReadPixels(checkpointPixels, f) ||
+        !ReadOptionalPixels(checkpointVariance, pixelBounds, f))
+        return false;
+    for (Point2i p : pixelBounds) {
+        Pixel &pixel = pixels[p];
+        const Pixel &cp = checkpointPixels[p];
+        for (int c = 0; c < 3; ++c)
+            pixel.rgbSum[c] += cp.rgbSum[c];
+        pixel.weightSum += cp.weightSum;
+        if (varianceEstimators.size() > 0 && checkpointVariance.size() > 0)
+            varianceEstimators[p].Merge(checkpointVariance[p]);
+    }
+    return splatBuffers.MergeCheckpoint(f);
+}
+
 Image RGBFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
+    splatBuffers.Flush();
+
     // Convert image to RGB and compute final pixel values
     LOG_VERBOSE("Converting image to RGB and computing final weighted pixel values");
     PixelFormat format = writeFP16 ? PixelFormat::Half : PixelFormat::Float;
@@ -162,25 +353,26 @@ Image RGBFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
     metadata->fullResolution = fullResolution;
     metadata->colorSpace = colorSpace;
 
-    Float varianceSum = 0;
-    for (Point2i p : pixelBounds) {
-        const Pixel &pixel = pixels[p];
-        varianceSum += Float(pixel.varianceEstimator.Variance());
+    if (varianceEstimators.size() > 0) {
+        Float varianceSum = 0;
+        for (Point2i p : pixelBounds)
+            varianceSum += Float(varianceEstimators[p].Variance());
+        metadata->estimatedVariance = varianceSum / pixelBounds.Area();
     }
-    metadata->estimatedVariance = varianceSum / pixelBounds.Area();
 
     return image;
 }
 
 std::string RGBFilm::ToString() const {
     return StringPrintf("[ RGBFilm %s scale: %f colorSpace: %s maxComponentValue: %f "
-                        "writeFP16: %s ]",
-                        BaseToString(), scale, *colorSpace, maxComponentValue, writeFP16);
+                        "writeFP16: %s estimateVariance: %s ]",
+                        BaseToString(), scale, *colorSpace, maxComponentValue, writeFP16,
+                        varianceEstimators.size() > 0);
 }
 
 RGBFilm *RGBFilm::Create(const ParameterDictionary &parameters, FilterHandle filter,
-                         const RGBColorSpace *colorSpace, const FileLoc *loc,
-                         Allocator alloc) {
+                         const RGBColorSpace *colorSpace, bool storeSplats,
+                         const FileLoc *loc, Allocator alloc) {
     std::string filename = parameters.GetOneString("filename", "");
     if (!Options->imageFile.empty()) {
         if (!filename.empty())
@@ -273,10 +465,14 @@ RGBFilm *RGBFilm::Create(const ParameterDictionary &parameters, FilterHandle fil
     Float diagonal = parameters.GetOneFloat("diagonal", 35.);
     Float maxComponentValue = parameters.GetOneFloat("maxcomponentvalue", Infinity);
     bool writeFP16 = parameters.GetOneBool("savefp16", true);
+    // Compact films don't store per-pixel variance estimates unless adaptive
+    // sampling needs them; the image's variance metadata is then omitted.
+    bool compact = parameters.GetOneBool("compact", false);
+    bool estimateVariance = !compact || Options->adaptiveErrorThreshold > 0;
 
     return alloc.new_object<RGBFilm>(fullResolution, pixelBounds, filter, diagonal,
                                      filename, scale, colorSpace, maxComponentValue,
-                                     writeFP16, alloc);
+                                     writeFP16, estimateVariance, storeSplats, alloc);
 }
 
 // GBufferFilm Method Definitions
@@ -319,9 +515,11 @@ void GBufferFilm::AddSample(const Point2i &pFilm, SampledSpectrum L,
 GBufferFilm::GBufferFilm(const Point2i &resolution, const Bounds2i &pixelBounds,
                          FilterHandle filter, Float diagonal, const std::string &filename,
                          Float scale, const RGBColorSpace *colorSpace,
-                         Float maxComponentValue, bool writeFP16, Allocator alloc)
+                         Float maxComponentValue, bool writeFP16, bool storeSplats,
+                         Allocator alloc)
     : FilmBase(resolution, pixelBounds, filter, diagonal, filename),
       pixels(pixelBounds, alloc),
+      splatBuffers(pixelBounds, storeSplats, alloc),
       scale(scale),
       colorSpace(colorSpace),
       maxComponentValue(maxComponentValue),
@@ -351,9 +549,11 @@ void GBufferFilm::AddSplat(const Point2f &p, SampledSpectrum v,
     for (Point2i pi : splatBounds) {
         Float wt = filter.Evaluate(Point2f(p - pi - Vector2f(0.5, 0.5)));
         if (wt != 0) {
-            Pixel &pixel = pixels[pi];
-            for (int i = 0; i < 3; ++i)
-                pixel.splatRGB[i].Add(wt * rgb[i]);
+#ifdef PBRT_IS_GPU_CODE
+            LOG_FATAL("Film splats aren't supported on the GPU.");
+#else
+            splatBuffers.Add(pi, wt, rgb);
+#endif
         }
     }
 }
@@ -364,7 +564,41 @@ void GBufferFilm::WriteImage(ImageMetadata metadata, Float splatScale) {
     image.Write(filename, metadata);
 }
 
+bool GBufferFilm::WriteCheckpoint(FILE *f) {
+    splatBuffers.Flush();
+    return WritePixels(pixels, f) && splatBuffers.WriteCheckpoint(f);
+}
+
+bool GBufferFilm::ReadCheckpoint(FILE *f) {
+    return ReadPixels(pixels, f) && splatBuffers.ReadCheckpoint(f);
+}
+
+bool GBufferFilm::MergeCheckpoint(FILE *f) {
+    // Read the checkpoint's pixels and add their accumulated values to the film's
+    Array2D<Pixel> checkpointPixels(pixelBounds, pixels.get_allocator());
+    if (!ReadPixels(checkpointPixels, f))
+        return false;
+    for (Point2i p : pixelBounds) {
+        Pixel &pixel = pixels[p];
+        const Pixel &cp = checkpointPixels[p];
+        for (int c = 0; c < 3; ++c) {
+            pixel.rgbSum[c] += cp.rgbSum[c];
+            pixel.albedoSum[c] += cp.albedoSum[c];
+        }
+        pixel.weightSum += cp.weightSum;
+        pixel.pSum += cp.pSum;
+        pixel.dzdxSum += cp.dzdxSum;
+        pixel.dzdySum += cp.dzdySum;
+        pixel.nSum += cp.nSum;
+        pixel.nsSum += cp.nsSum;
+        pixel.rgbVarianceEstimator.Merge(cp.rgbVarianceEstimator);
+    }
+    return splatBuffers.MergeCheckpoint(f);
+}
+
 Image GBufferFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
+    splatBuffers.Flush();
+
     // Convert image to RGB and compute final pixel values
     LOG_VERBOSE("Converting image to RGB and computing final weighted pixel values");
     PixelFormat format = writeFP16 ? PixelFormat::Half : PixelFormat::Float;
@@ -421,7 +655,7 @@ Image GBufferFilm::GetImage(ImageMetadata *metadata, Float splatScale) {
 
         // Add splat value at pixel
         for (int c = 0; c < 3; ++c)
-            rgb[c] += splatScale * pixel.splatRGB[c] / filterIntegral;
+            rgb[c] += splatScale * splatBuffers.Sum(p, c) / filterIntegral;
 
         rgb *= scale;
 
@@ -465,7 +699,8 @@ std::string GBufferFilm::ToString() const {
 
 GBufferFilm *GBufferFilm::Create(const ParameterDictionary &parameters,
                                  FilterHandle filter, const RGBColorSpace *colorSpace,
-                                 const FileLoc *loc, Allocator alloc) {
+                                 bool storeSplats, const FileLoc *loc,
+                                 Allocator alloc) {
     std::string filename = parameters.GetOneString("filename", "");
     if (!Options->imageFile.empty()) {
         if (!filename.empty())
@@ -561,18 +796,19 @@ GBufferFilm *GBufferFilm::Create(const ParameterDictionary &parameters,
 
     return alloc.new_object<GBufferFilm>(fullResolution, pixelBounds, filter, diagonal,
                                          filename, scale, colorSpace, maxComponentValue,
-                                         writeFP16, alloc);
+                                         writeFP16, storeSplats, alloc);
 }
 
 FilmHandle FilmHandle::Create(const std::string &name,
                               const ParameterDictionary &parameters, const FileLoc *loc,
-                              FilterHandle filter, Allocator alloc) {
+                              FilterHandle filter, bool storeSplats, Allocator alloc) {
     FilmHandle film;
     if (name == "rgb")
-        film = RGBFilm::Create(parameters, filter, parameters.ColorSpace(), loc, alloc);
+        film = RGBFilm::Create(parameters, filter, parameters.ColorSpace(), storeSplats,
+                               loc, alloc);
     else if (name == "gbuffer")
-        film =
-            GBufferFilm::Create(parameters, filter, parameters.ColorSpace(), loc, alloc);
+        film = GBufferFilm::Create(parameters, filter, parameters.ColorSpace(),
+                                   storeSplats, loc, alloc);
     else
         ErrorExit(loc, "%s: film type unknown.", name);
 
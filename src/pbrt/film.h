@@ -22,6 +22,8 @@
 
 #include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
@@ -95,6 +97,97 @@ class FilmBase {
     Bounds2i pixelBounds;
 };
 
+// SplatBuffers Definition
+// SplatBuffers holds a film's splatted contributions. Splatting integrators
+// write all over the image from every thread, so rather than updating shared
+// sums as they splat, threads accumulate their splats privately in a small
+// set of image tiles. A thread adds its tiles to the shared sums, locking one
+// tile of the sums at a time, when it runs out of tiles or when it next
+// splats after RequestFlush() has been called; Flush() adds all threads'
+// tiles to the sums once they have stopped splatting.
+class SplatBuffers {
+  public:
+    // SplatBuffers Public Methods
+    SplatBuffers() = default;
+    // Films for integrators that don't splat pass false for _storeSplats_;
+    // they then have no splat sums.
+    SplatBuffers(const Bounds2i &pixelBounds, bool storeSplats, Allocator alloc);
+
+    void Add(const Point2i &p, Float wt, const RGB &rgb) {
+        ThreadBuffer &buffer = threadBuffers[ThreadIndex];
+        if (buffer.flushRequested.load(std::memory_order_relaxed) &&
+            buffer.flushRequested.exchange(false))
+            AddToSums(buffer);
+        // Allocate the buffer the first time the thread splats, so that its
+        // memory is local to the thread
+        if (!buffer.tiles)
+            AllocateBuffer(buffer);
+
+        // Find the thread's tile for _p_, starting a new one if needed
+        int tile = TileIndex(p);
+        int slot = buffer.tileSlots[tile];
+        if (slot == -1) {
+            if (buffer.nTiles == MaxThreadTiles)
+                AddToSums(buffer);
+            slot = buffer.nTiles++;
+            buffer.tileSlots[tile] = slot;
+            buffer.tileIndices[slot] = tile;
+        }
+        SplatSum &sum = buffer.tiles[slot * TileArea + TileOffset(p)];
+        for (int c = 0; c < 3; ++c)
+            sum.rgb[c] += wt * rgb[c];
+    }
+
+    void RequestFlush();
+    void Flush();
+
+    PBRT_CPU_GPU
+    double Sum(const Point2i &p, int c) const {
+        return sums.size() > 0 ? sums[p].rgb[c] : 0.;
+    }
+
+    bool WriteCheckpoint(FILE *f) const;
+    bool ReadCheckpoint(FILE *f);
+    bool MergeCheckpoint(FILE *f);
+
+  private:
+    // SplatBuffers Private Members
+    static constexpr int TileSize = 16, TileArea = TileSize * TileSize;
+    static constexpr int MaxThreadTiles = 64;
+    struct SplatSum {
+        double rgb[3] = {0., 0., 0.};
+    };
+    struct ThreadBuffer {
+        std::atomic<bool> flushRequested{false};
+        // Tiles of splat sums and the image tile that each one holds
+        std::unique_ptr<SplatSum[]> tiles;
+        std::unique_ptr<int[]> tileIndices;
+        int nTiles = 0;
+        // Index into _tiles_ for each image tile, or -1
+        std::unique_ptr<int[]> tileSlots;
+    };
+
+    // SplatBuffers Private Methods
+    void AllocateBuffer(ThreadBuffer &buffer);
+    void AddToSums(ThreadBuffer &buffer);
+
+    int TileIndex(const Point2i &p) const {
+        return (p.y - pixelBounds.pMin.y) / TileSize * nTilesX +
+               (p.x - pixelBounds.pMin.x) / TileSize;
+    }
+    int TileOffset(const Point2i &p) const {
+        return (p.y - pixelBounds.pMin.y) % TileSize * TileSize +
+               (p.x - pixelBounds.pMin.x) % TileSize;
+    }
+
+    Bounds2i pixelBounds;
+    int nTilesX = 0, nTiles = 0;
+    std::vector<ThreadBuffer> threadBuffers;
+    // Held while a tile's pixels in _sums_ are updated
+    std::unique_ptr<std::mutex[]> tileMutexes;
+    Array2D<SplatSum> sums;
+};
+
 // RGBFilm Definition
 class RGBFilm : public FilmBase {
   public:
@@ -112,8 +205,9 @@ class RGBFilm : public FilmBase {
         }
 
         DCHECK(InsideExclusive(pFilm, pixelBounds));
-        // Update pixel variance estimate
-        pixels[pFilm].varianceEstimator.Add(L.Average());
+        // Update pixel variance estimate, if variance is being estimated
+        if (varianceEstimators.size() > 0)
+            varianceEstimators[pFilm].Add(L.Average());
 
         // Update pixel values with filtered sample contribution
         Pixel &pixel = pixels[pFilm];
@@ -136,7 +230,7 @@ class RGBFilm : public FilmBase {
 
         // Add splat value at pixel
         for (int c = 0; c < 3; ++c)
-            rgb[c] += splatScale * pixel.splatRGB[c] / filterIntegral;
+            rgb[c] += splatScale * splatBuffers.Sum(p, c) / filterIntegral;
 
         // Scale pixel value by _scale_
         rgb *= scale;
@@ -144,15 +238,23 @@ class RGBFilm : public FilmBase {
         return rgb;
     }
 
+    PBRT_CPU_GPU
+    Float GetPixelRelativeError(const Point2i &p) const {
+        return varianceEstimators.size() > 0
+                   ? varianceEstimators[p].RelativeStandardError()
+                   : Infinity;
+    }
+
     RGBFilm() = default;
     RGBFilm(const Point2i &resolution, const Bounds2i &pixelBounds, FilterHandle filter,
             Float diagonal, const std::string &filename, Float scale,
             const RGBColorSpace *colorSpace, Float maxComponentValue = Infinity,
-            bool writeFP16 = true, Allocator allocator = {});
+            bool writeFP16 = true, bool estimateVariance = true,
+            bool storeSplats = true, Allocator allocator = {});
 
     static RGBFilm *Create(const ParameterDictionary &parameters, FilterHandle filter,
-                           const RGBColorSpace *colorSpace, const FileLoc *loc,
-                           Allocator alloc);
+                           const RGBColorSpace *colorSpace, bool storeSplats,
+                           const FileLoc *loc, Allocator alloc);
 
     PBRT_CPU_GPU
     SampledWavelengths SampleWavelengths(Float u) const;
@@ -163,6 +265,24 @@ class RGBFilm : public FilmBase {
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
 
+    // FlushSplats() may only be called when no threads are splatting;
+    // RequestSplatFlush() has them add their splats when they next splat.
+    void FlushSplats() { splatBuffers.Flush(); }
+    void RequestSplatFlush() { splatBuffers.RequestFlush(); }
+
+    bool WriteCheckpoint(FILE *f);
+    bool ReadCheckpoint(FILE *f);
+    bool MergeCheckpoint(FILE *f);
+
+    void BindRowsToNumaNode(int yStart, int yEnd, int node) {
+        Point2i pStart(pixelBounds.pMin.x, yStart);
+        size_t nPixels = size_t(yEnd - yStart) * pixelBounds.Diagonal().x;
+        BindMemoryToNumaNode(&pixels[pStart], sizeof(Pixel) * nPixels, node);
+        if (varianceEstimators.size() > 0)
+            BindMemoryToNumaNode(&varianceEstimators[pStart],
+                                 sizeof(VarianceEstimator<Float>) * nPixels, node);
+    }
+
     std::string ToString() const;
 
   private:
@@ -171,12 +291,13 @@ class RGBFilm : public FilmBase {
         Pixel() = default;
         double rgbSum[3] = {0., 0., 0.};
         double weightSum = 0.;
-        AtomicDouble splatRGB[3];
-        VarianceEstimator<Float> varianceEstimator;
     };
 
     // RGBFilm Private Members
     Array2D<Pixel> pixels;
+    // Compact films only store variance estimates if adaptive sampling uses them
+    Array2D<VarianceEstimator<Float>> varianceEstimators;
+    SplatBuffers splatBuffers;
     Float scale;
     const RGBColorSpace *colorSpace;
     Float maxComponentValue;
@@ -192,11 +313,11 @@ class GBufferFilm : public FilmBase {
                 FilterHandle filter, Float diagonal, const std::string &filename,
                 Float scale, const RGBColorSpace *colorSpace,
                 Float maxComponentValue = Infinity, bool writeFP16 = true,
-                Allocator alloc = {});
+                bool storeSplats = true, Allocator alloc = {});
 
     static GBufferFilm *Create(const ParameterDictionary &parameters, FilterHandle filter,
-                               const RGBColorSpace *colorSpace, const FileLoc *loc,
-                               Allocator alloc);
+                               const RGBColorSpace *colorSpace, bool storeSplats,
+                               const FileLoc *loc, Allocator alloc);
 
     PBRT_CPU_GPU
     SampledWavelengths SampleWavelengths(Float u) const;
@@ -224,7 +345,7 @@ class GBufferFilm : public FilmBase {
 
         // Add splat value at pixel
         for (int c = 0; c < 3; ++c)
-            rgb[c] += splatScale * pixel.splatRGB[c] / filterIntegral;
+            rgb[c] += splatScale * splatBuffers.Sum(p, c) / filterIntegral;
 
         // Scale pixel value by _scale_
         rgb *= scale;
@@ -232,9 +353,30 @@ class GBufferFilm : public FilmBase {
         return rgb;
     }
 
+    PBRT_CPU_GPU
+    Float GetPixelRelativeError(const Point2i &p) const {
+        return pixels[p].rgbVarianceEstimator.RelativeStandardError();
+    }
+
     void WriteImage(ImageMetadata metadata, Float splatScale = 1);
     Image GetImage(ImageMetadata *metadata, Float splatScale = 1);
 
+    // FlushSplats() may only be called when no threads are splatting;
+    // RequestSplatFlush() has them add their splats when they next splat.
+    void FlushSplats() { splatBuffers.Flush(); }
+    void RequestSplatFlush() { splatBuffers.RequestFlush(); }
+
+    bool WriteCheckpoint(FILE *f);
+    bool ReadCheckpoint(FILE *f);
+    bool MergeCheckpoint(FILE *f);
+
+    void BindRowsToNumaNode(int yStart, int yEnd, int node) {
+        Point2i pStart(pixelBounds.pMin.x, yStart);
+        BindMemoryToNumaNode(&pixels[pStart],
+                             sizeof(Pixel) * (yEnd - yStart) * pixelBounds.Diagonal().x,
+                             node);
+    }
+
     std::string ToString() const;
 
   private:
@@ -243,7 +385,6 @@ class GBufferFilm : public FilmBase {
         Pixel() = default;
         double rgbSum[3] = {0., 0., 0.};
         double weightSum = 0.;
-        AtomicDouble splatRGB[3];
         Point3f pSum;
         Float dzdxSum = 0, dzdySum = 0;
         Normal3f nSum, nsSum;
@@ -253,6 +394,7 @@ class GBufferFilm : public FilmBase {
 
     // GBufferFilm Private Members
     Array2D<Pixel> pixels;
+    SplatBuffers splatBuffers;
     Float scale;
     const RGBColorSpace *colorSpace;
     Float maxComponentValue;
@@ -308,6 +450,12 @@ inline RGB FilmHandle::GetPixelRGB(const Point2i &p, Float splatScale) const {
     return Dispatch(get);
 }
 
+PBRT_CPU_GPU
+inline Float FilmHandle::GetPixelRelativeError(const Point2i &p) const {
+    auto get = [&](auto ptr) { return ptr->GetPixelRelativeError(p); };
+    return Dispatch(get);
+}
+
 PBRT_CPU_GPU
 inline void FilmHandle::AddSample(const Point2i &pFilm, SampledSpectrum L,
                                   const SampledWavelengths &lambda,
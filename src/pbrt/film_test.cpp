@@ -0,0 +1,236 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/film.h>
+#include <pbrt/filters.h>
+#include <pbrt/pbrt.h>
+#include <pbrt/util/colorspace.h>
+#include <pbrt/util/image.h>
+#include <pbrt/util/parallel.h>
+#include <pbrt/util/rng.h>
+#include <pbrt/util/spectrum.h>
+
+#include <cstdio>
+
+using namespace pbrt;
+
+static std::string inTestDir(const std::string &path) {
+    return path;
+}
+
+TEST(RGBFilm, CheckpointRoundTrip) {
+    BoxFilter boxFilter;
+    FilterHandle filter(&boxFilter);
+    Point2i resolution(32, 24);
+    Bounds2i pixelBounds(Point2i(4, 2), Point2i(28, 20));
+    auto makeFilm = [&](const Bounds2i &pb) {
+        return RGBFilm(resolution, pb, filter, 0.035, "test.exr", 1,
+                       RGBColorSpace::sRGB);
+    };
+    RGBFilm film = makeFilm(pixelBounds);
+
+    // Accumulate samples and splats at random pixels
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Vector2i d = pixelBounds.Diagonal();
+        Point2i p = pixelBounds.pMin + Vector2i(rng.Uniform<uint32_t>() % d.x,
+                                                rng.Uniform<uint32_t>() % d.y);
+        SampledWavelengths lambda = film.SampleWavelengths(rng.Uniform<Float>());
+        film.AddSample(p, SampledSpectrum(rng.Uniform<Float>()), lambda, nullptr,
+                       rng.Uniform<Float>());
+        film.AddSplat(Point2f(p) + Vector2f(0.5f, 0.5f),
+                      SampledSpectrum(rng.Uniform<Float>()), lambda);
+    }
+
+    std::string filename = inTestDir("film.ckpt");
+    FILE *f = fopen(filename.c_str(), "wb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_TRUE(film.WriteCheckpoint(f));
+    fclose(f);
+
+    // Restore into a fresh film and make sure all pixels match
+    RGBFilm restored = makeFilm(pixelBounds);
+    f = fopen(filename.c_str(), "rb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_TRUE(restored.ReadCheckpoint(f));
+    fclose(f);
+    for (Point2i p : pixelBounds)
+        for (int c = 0; c < 3; ++c)
+            EXPECT_EQ(film.GetPixelRGB(p, 0.25f)[c], restored.GetPixelRGB(p, 0.25f)[c]);
+
+    // A film with different pixel bounds must reject the checkpoint
+    RGBFilm mismatched = makeFilm(Bounds2i(Point2i(0, 0), resolution));
+    f = fopen(filename.c_str(), "rb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_FALSE(mismatched.ReadCheckpoint(f));
+    fclose(f);
+
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(RGBFilm, MergeCheckpoint) {
+    BoxFilter boxFilter;
+    FilterHandle filter(&boxFilter);
+    Point2i resolution(16, 16);
+    Bounds2i pixelBounds(Point2i(0, 0), resolution);
+    auto makeFilm = [&]() {
+        return RGBFilm(resolution, pixelBounds, filter, 0.035, "test.exr", 1,
+                       RGBColorSpace::sRGB);
+    };
+    // _film_ gets all of the samples; _a_ and _b_ each get half of them
+    RGBFilm film = makeFilm(), a = makeFilm(), b = makeFilm();
+
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Point2i p(rng.Uniform<uint32_t>() % resolution.x,
+                  rng.Uniform<uint32_t>() % resolution.y);
+        SampledWavelengths lambda = film.SampleWavelengths(rng.Uniform<Float>());
+        SampledSpectrum L(rng.Uniform<Float>()), splat(rng.Uniform<Float>());
+        Float weight = rng.Uniform<Float>();
+        Point2f pSplat = Point2f(p) + Vector2f(0.5f, 0.5f);
+        film.AddSample(p, L, lambda, nullptr, weight);
+        film.AddSplat(pSplat, splat, lambda);
+        RGBFilm &half = (i & 1) ? a : b;
+        half.AddSample(p, L, lambda, nullptr, weight);
+        half.AddSplat(pSplat, splat, lambda);
+    }
+
+    std::string filename = inTestDir("film-merge.ckpt");
+    FILE *f = fopen(filename.c_str(), "wb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_TRUE(b.WriteCheckpoint(f));
+    fclose(f);
+
+    f = fopen(filename.c_str(), "rb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_TRUE(a.MergeCheckpoint(f));
+    fclose(f);
+    // Getting the images adds the films' pending splats to their pixels
+    ImageMetadata metadata;
+    film.GetImage(&metadata);
+    a.GetImage(&metadata);
+    for (Point2i p : pixelBounds)
+        for (int c = 0; c < 3; ++c)
+            EXPECT_FLOAT_EQ(film.GetPixelRGB(p, 0.25f)[c], a.GetPixelRGB(p, 0.25f)[c]);
+
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(RGBFilm, ParallelSplats) {
+    BoxFilter boxFilter;
+    FilterHandle filter(&boxFilter);
+    // Use enough pixels that threads have more tiles than they can hold
+    Point2i resolution(256, 192);
+    Bounds2i pixelBounds(Point2i(5, 3), resolution);
+    auto makeFilm = [&]() {
+        return RGBFilm(resolution, pixelBounds, filter, 0.035, "test.exr", 1,
+                       RGBColorSpace::sRGB);
+    };
+    RGBFilm film = makeFilm(), parallelFilm = makeFilm();
+
+    // Splat the same values serially and from many threads
+    auto splat = [&](RGBFilm &f, int i) {
+        RNG rng(i);
+        Point2f p = Bounds2f(pixelBounds).Lerp(
+            Point2f(rng.Uniform<Float>(), rng.Uniform<Float>()));
+        SampledWavelengths lambda = f.SampleWavelengths(rng.Uniform<Float>());
+        f.AddSplat(p, SampledSpectrum(rng.Uniform<Float>()), lambda);
+    };
+    for (int i = 0; i < 100000; ++i)
+        splat(film, i);
+    ParallelFor(0, 100000, [&](int64_t i) { splat(parallelFilm, i); });
+
+    // Splats still in the threads' buffers are only seen after a flush
+    film.FlushSplats();
+    parallelFilm.FlushSplats();
+    for (Point2i p : pixelBounds)
+        for (int c = 0; c < 3; ++c)
+            EXPECT_FLOAT_EQ(film.GetPixelRGB(p)[c], parallelFilm.GetPixelRGB(p)[c]);
+}
+
+TEST(RGBFilm, NoVarianceEstimates) {
+    BoxFilter boxFilter;
+    FilterHandle filter(&boxFilter);
+    Point2i resolution(16, 16);
+    Bounds2i pixelBounds(Point2i(0, 0), resolution);
+    RGBFilm film(resolution, pixelBounds, filter, 0.035, "test.exr", 1,
+                 RGBColorSpace::sRGB);
+    bool estimateVariance = false;
+    RGBFilm compactFilm(resolution, pixelBounds, filter, 0.035, "test.exr", 1,
+                        RGBColorSpace::sRGB, Infinity, true, estimateVariance);
+
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Point2i p(rng.Uniform<uint32_t>() % resolution.x,
+                  rng.Uniform<uint32_t>() % resolution.y);
+        SampledWavelengths lambda = film.SampleWavelengths(rng.Uniform<Float>());
+        SampledSpectrum L(rng.Uniform<Float>());
+        Float weight = rng.Uniform<Float>();
+        film.AddSample(p, L, lambda, nullptr, weight);
+        compactFilm.AddSample(p, L, lambda, nullptr, weight);
+    }
+
+    // The image is the same without variance estimates but has no variance
+    // metadata
+    ImageMetadata metadata, compactMetadata;
+    Image image = film.GetImage(&metadata);
+    Image compactImage = compactFilm.GetImage(&compactMetadata);
+    EXPECT_TRUE(metadata.estimatedVariance.has_value());
+    EXPECT_FALSE(compactMetadata.estimatedVariance.has_value());
+    for (int y = 0; y < resolution.y; ++y)
+        for (int x = 0; x < resolution.x; ++x)
+            for (int c = 0; c < 3; ++c)
+                EXPECT_EQ(image.GetChannel({x, y}, c),
+                          compactImage.GetChannel({x, y}, c));
+    EXPECT_TRUE(std::isinf(compactFilm.GetPixelRelativeError(Point2i(0, 0))));
+}
+
+TEST(RGBFilm, NoSplatStorage) {
+    BoxFilter boxFilter;
+    FilterHandle filter(&boxFilter);
+    Point2i resolution(16, 16);
+    Bounds2i pixelBounds(Point2i(0, 0), resolution);
+    auto makeFilm = [&](bool storeSplats) {
+        return RGBFilm(resolution, pixelBounds, filter, 0.035, "test.exr", 1,
+                       RGBColorSpace::sRGB, Infinity, true, true, storeSplats);
+    };
+    RGBFilm film = makeFilm(true), noSplatFilm = makeFilm(false);
+
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Point2i p(rng.Uniform<uint32_t>() % resolution.x,
+                  rng.Uniform<uint32_t>() % resolution.y);
+        SampledWavelengths lambda = film.SampleWavelengths(rng.Uniform<Float>());
+        SampledSpectrum L(rng.Uniform<Float>());
+        Float weight = rng.Uniform<Float>();
+        film.AddSample(p, L, lambda, nullptr, weight);
+        noSplatFilm.AddSample(p, L, lambda, nullptr, weight);
+    }
+    for (Point2i p : pixelBounds)
+        for (int c = 0; c < 3; ++c)
+            EXPECT_EQ(film.GetPixelRGB(p)[c], noSplatFilm.GetPixelRGB(p)[c]);
+
+    // Checkpoints can only be read by films that also don't store splats
+    std::string filename = inTestDir("film-nosplats.ckpt");
+    FILE *f = fopen(filename.c_str(), "wb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_TRUE(noSplatFilm.WriteCheckpoint(f));
+    fclose(f);
+    RGBFilm readFilm = makeFilm(false), splatFilm = makeFilm(true);
+    f = fopen(filename.c_str(), "rb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_TRUE(readFilm.ReadCheckpoint(f));
+    fclose(f);
+    f = fopen(filename.c_str(), "rb");
+    ASSERT_TRUE(f != nullptr);
+    EXPECT_FALSE(splatFilm.ReadCheckpoint(f));
+    fclose(f);
+    for (Point2i p : pixelBounds)
+        for (int c = 0; c < 3; ++c)
+            EXPECT_EQ(noSplatFilm.GetPixelRGB(p)[c], readFilm.GetPixelRGB(p)[c]);
+
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
@@ -81,7 +81,7 @@ GPUPathIntegrator::GPUPathIntegrator(Allocator alloc, const ParsedScene &scene)
                                   &scene.filter.loc, alloc);
 
     film = FilmHandle::Create(scene.film.name, scene.film.parameters, &scene.film.loc,
-                              filter, alloc);
+                              filter, false, alloc);
     initializeVisibleSurface = film.UsesVisibleSurface();
 
     sampler = SamplerHandle::Create(scene.sampler.name, scene.sampler.parameters,
@@ -273,7 +273,7 @@ void GPUPathIntegrator::Render(ImageMetadata *metadata) {
     std::atomic<bool> exitCopyThread{false};
     std::thread copyThread;
 
-    if (!Options->displayServer.empty()) {
+    if (!Options->displayServer.empty() || !Options->previewFile.empty()) {
         // Allocate staging memory on the GPU to store the current WIP
         // image.
         CUDA_CHECK(cudaMalloc(&displayRGB, resolution.x * resolution.y * sizeof(RGB)));
@@ -410,7 +410,7 @@ void GPUPathIntegrator::Render(ImageMetadata *metadata) {
 
             UpdateFilm();
 
-            if (!Options->displayServer.empty())
+            if (!Options->displayServer.empty() || !Options->previewFile.empty())
                 GPUParallelFor("Update Display RGB Buffer", maxQueueSize,
                                [=] PBRT_GPU(int pixelIndex) {
                                    Point2i pPixel = pixelSampleState.pPixel[pixelIndex];
@@ -431,7 +431,7 @@ void GPUPathIntegrator::Render(ImageMetadata *metadata) {
 
     // Wait until rendering is all done before we start to shut down the
     // display stuff..
-    if (!Options->displayServer.empty()) {
+    if (!Options->displayServer.empty() || !Options->previewFile.empty()) {
         exitCopyThread = true;
         copyThread.join();
     }
@@ -20,11 +20,17 @@ std::string PBRTOptions::ToString() const {
         "recordPixelStatistics: %s upgrade: %s disablePixelJitter: %s "
         "disableWavelengthJitter: %s forceDiffuse: %s useGPU: %s "
         "imageFile: %s mseReferenceImage: %s mseReferenceOutput: %s "
-        "debugStart: %s displayServer: %s cropWindow: %s pixelBounds: %s ]",
+        "debugStart: %s displayServer: %s previewFile: %s displayInterval: %f "
+        "bvhCacheDirectory: %s checkpointFile: %s "
+        "resume: %s pinThreads: %s adaptiveErrorThreshold: %f timeLimit: %f "
+        "sampleRangeBegin: %d sampleRangeEnd: %s mergeCheckpointFiles: %s "
+        "cropWindow: %s pixelBounds: %s ]",
         nThreads, seed, quickRender, quiet, recordPixelStatistics, upgrade,
         disablePixelJitter, disableWavelengthJitter, forceDiffuse, useGPU, imageFile,
-        mseReferenceImage, mseReferenceOutput, debugStart, displayServer, cropWindow,
-        pixelBounds);
+        mseReferenceImage, mseReferenceOutput, debugStart, displayServer, previewFile,
+        displayInterval, bvhCacheDirectory, checkpointFile, resume, pinThreads,
+        adaptiveErrorThreshold, timeLimit, sampleRangeBegin, sampleRangeEnd,
+        mergeCheckpointFiles, cropWindow, pixelBounds);
 }
 
 }  // namespace pbrt
@@ -11,6 +11,7 @@
 #include <pbrt/util/vecmath.h>
 
 #include <string>
+#include <vector>
 
 namespace pbrt {
 
@@ -40,6 +41,17 @@ struct PBRTOptions : BasicOptions {
     std::string mseReferenceImage, mseReferenceOutput;
     std::string debugStart;
     std::string displayServer;
+    std::string previewFile;
+    Float displayInterval = 0.25f;
+    std::string bvhCacheDirectory;
+    std::string checkpointFile;
+    bool resume = false;
+    bool pinThreads = false;
+    Float adaptiveErrorThreshold = 0;
+    Float timeLimit = 0;
+    int sampleRangeBegin = 0;
+    pstd::optional<int> sampleRangeEnd;
+    std::vector<std::string> mergeCheckpointFiles;
     pstd::optional<Bounds2f> cropWindow;
     pstd::optional<Bounds2i> pixelBounds;
 
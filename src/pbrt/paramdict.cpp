@@ -11,6 +11,7 @@
 #include <pbrt/util/colorspace.h>
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
+#include <pbrt/util/hash.h>
 #include <pbrt/util/memory.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/spectrum.h>
@@ -644,6 +645,37 @@ std::string ParameterDictionary::ToParameterDefinition(const ParsedParameter *p,
     return s;
 }
 
+uint64_t ParameterDictionary::ContentHash() const {
+    // Source locations and usage flags are deliberately not included
+    uint64_t hash = pbrt::Hash(colorSpace, params.size());
+    for (const ParsedParameter *p : params) {
+        hash = pbrt::Hash(hash, p->type.size(), p->name.size(), p->numbers.size(),
+                          p->strings.size(), p->bools.size());
+        hash = HashBuffer(p->type.data(), p->type.size(), hash);
+        hash = HashBuffer(p->name.data(), p->name.size(), hash);
+        hash = HashBuffer(p->numbers.data(), p->numbers.size() * sizeof(double), hash);
+        for (const std::string &str : p->strings)
+            hash = HashBuffer(str.data(), str.size(), pbrt::Hash(hash, str.size()));
+        hash = HashBuffer(p->bools.data(), p->bools.size(), hash);
+    }
+    return hash;
+}
+
+bool ParameterDictionary::ContentEquals(const ParameterDictionary &other) const {
+    if (colorSpace != other.colorSpace || params.size() != other.params.size())
+        return false;
+    auto equal = [](const auto &a, const auto &b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end());
+    };
+    for (size_t i = 0; i < params.size(); ++i) {
+        const ParsedParameter *p = params[i], *q = other.params[i];
+        if (p->type != q->type || p->name != q->name || !equal(p->numbers, q->numbers) ||
+            !equal(p->strings, q->strings) || !equal(p->bools, q->bools))
+            return false;
+    }
+    return true;
+}
+
 std::string ParameterDictionary::ToParameterList(int indentCount) const {
     std::string s;
     for (const ParsedParameter *p : params) {
@@ -81,6 +81,12 @@ class ParameterDictionary {
 
     const RGBColorSpace *ColorSpace() const { return colorSpace; }
 
+    // Returns a hash of the parameters' names, types, and values; dictionaries
+    // with equal hashes usually describe the same entity, which
+    // _ContentEquals()_ confirms.
+    uint64_t ContentHash() const;
+    bool ContentEquals(const ParameterDictionary &other) const;
+
     std::string ToParameterList(int indent = 0) const;
     std::string ToParameterDefinition(const std::string &) const;
     std::string ToString() const;
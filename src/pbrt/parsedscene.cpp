@@ -20,7 +20,10 @@
 #include <pbrt/util/spectrum.h>
 #include <pbrt/util/transform.h>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <mutex>
 
 namespace pbrt {
@@ -456,6 +459,127 @@ ParsedScene::~ParsedScene() {
     delete graphicsState;
 }
 
+std::unique_ptr<ParsedScene> ParsedScene::CopyForImport(FileLoc loc) const {
+    if (currentApiState != APIState::WorldBlock)
+        ErrorExit(&loc, "Import statement only allowed inside world definition block.");
+    if (currentInstance != nullptr)
+        ErrorExit(&loc, "Import statement not allowed inside object instance "
+                        "definition.");
+
+    std::unique_ptr<ParsedScene> importedScene = std::make_unique<ParsedScene>();
+    importedScene->currentApiState = currentApiState;
+    importedScene->curTransform = curTransform;
+    importedScene->activeTransformBits = activeTransformBits;
+    importedScene->namedCoordinateSystems = namedCoordinateSystems;
+    importedScene->transformStartTime = transformStartTime;
+    importedScene->transformEndTime = transformEndTime;
+    importedScene->renderFromWorld = renderFromWorld;
+    *importedScene->graphicsState = *graphicsState;
+    // Copy the materials so that the current material index remains valid;
+    // only the materials that the imported file adds are merged back.
+    importedScene->materials = materials;
+    importedScene->nInheritedMaterials = materials.size();
+    return importedScene;
+}
+
+void ParsedScene::MergeImported(ParsedScene *importedScene) {
+    for (const auto &push : importedScene->pushStack)
+        ErrorExitDeferred(&push.second, "Missing end to %s in imported file",
+                          push.first == 'a'   ? "AttributeBegin"
+                          : push.first == 't' ? "TransformBegin"
+                                              : "ObjectBegin");
+    errorExit |= importedScene->errorExit;
+
+    // Append the imported materials and area lights and update the indices
+    // and transforms of the imported shapes to refer to this scene's
+    int nInherited = importedScene->nInheritedMaterials;
+    int materialOffset = int(materials.size()) - nInherited;
+    std::move(importedScene->materials.begin() + nInherited,
+              importedScene->materials.end(), std::back_inserter(materials));
+    int areaLightOffset = areaLights.size();
+    std::move(importedScene->areaLights.begin(), importedScene->areaLights.end(),
+              std::back_inserter(areaLights));
+
+    auto updateIndices = [&](auto &shape) {
+        if (shape.materialIndex >= nInherited)
+            shape.materialIndex += materialOffset;
+        if (shape.lightIndex != -1)
+            shape.lightIndex += areaLightOffset;
+    };
+    auto mergeShapes = [&](std::vector<ShapeSceneEntity> &from,
+                           std::vector<ShapeSceneEntity> *to) {
+        for (ShapeSceneEntity &shape : from) {
+            updateIndices(shape);
+            shape.renderFromObject = transformCache.Lookup(*shape.renderFromObject);
+            shape.objectFromRender = transformCache.Lookup(*shape.objectFromRender);
+            to->push_back(std::move(shape));
+        }
+    };
+    auto mergeAnimatedShapes = [&](std::vector<AnimatedShapeSceneEntity> &from,
+                                   std::vector<AnimatedShapeSceneEntity> *to) {
+        for (AnimatedShapeSceneEntity &shape : from) {
+            updateIndices(shape);
+            shape.identity = transformCache.Lookup(*shape.identity);
+            to->push_back(std::move(shape));
+        }
+    };
+    mergeShapes(importedScene->shapes, &shapes);
+    mergeAnimatedShapes(importedScene->animatedShapes, &animatedShapes);
+
+    for (InstanceSceneEntity &instance : importedScene->instances) {
+        if (instance.renderFromInstance != nullptr)
+            instance.renderFromInstance =
+                transformCache.Lookup(*instance.renderFromInstance);
+        instances.push_back(std::move(instance));
+    }
+    for (auto &definition : importedScene->instanceDefinitions) {
+        if (instanceDefinitions.find(definition.first) != instanceDefinitions.end()) {
+            ErrorExitDeferred(&definition.second.loc,
+                              "%s: trying to redefine an object instance",
+                              definition.first);
+            continue;
+        }
+        InstanceDefinitionSceneEntity &merged = instanceDefinitions[definition.first];
+        merged = InstanceDefinitionSceneEntity(definition.first, definition.second.loc);
+        mergeShapes(definition.second.shapes, &merged.shapes);
+        mergeAnimatedShapes(definition.second.animatedShapes, &merged.animatedShapes);
+    }
+
+    std::move(importedScene->lights.begin(), importedScene->lights.end(),
+              std::back_inserter(lights));
+
+    // Merge named entities, which must not already be defined
+    for (auto &nm : importedScene->namedMaterials) {
+        if (std::find_if(namedMaterials.begin(), namedMaterials.end(), [&](auto &m) {
+                return m.first == nm.first;
+            }) != namedMaterials.end())
+            ErrorExitDeferred(&nm.second.loc, "%s: named material redefined.", nm.first);
+        else
+            namedMaterials.push_back(std::move(nm));
+    }
+    using NamedTextures = std::vector<std::pair<std::string, TextureSceneEntity>>;
+    auto mergeTextures = [&](NamedTextures &from, NamedTextures *to) {
+        for (auto &tex : from) {
+            if (std::find_if(to->begin(), to->end(), [&](auto &t) {
+                    return t.first == tex.first;
+                }) != to->end())
+                ErrorExitDeferred(&tex.second.loc, "Redefining texture \"%s\".",
+                                  tex.first);
+            else
+                to->push_back(std::move(tex));
+        }
+    };
+    mergeTextures(importedScene->floatTextures, &floatTextures);
+    mergeTextures(importedScene->spectrumTextures, &spectrumTextures);
+    for (auto &medium : importedScene->media) {
+        if (media.find(medium.first) != media.end())
+            ErrorExitDeferred(&medium.second.loc, "Named medium \"%s\" redefined.",
+                              medium.first);
+        else
+            media[medium.first] = std::move(medium.second);
+    }
+}
+
 void ParsedScene::Option(const std::string &name, const std::string &value, FileLoc loc) {
     std::string nName = normalizeArg(name);
 
@@ -1783,4 +1907,323 @@ void FormattingScene::ObjectInstance(const std::string &name, FileLoc loc) {
 
 void FormattingScene::EndOfFiles() {}
 
+// BinarySceneWriter Method Definitions
+BinarySceneWriter::BinarySceneWriter(const std::string &filename) : filename(filename) {
+    f = fopen(filename.c_str(), "wb");
+    if (!f)
+        ErrorExit("%s: %s", filename, ErrorString());
+    BinarySceneHeader header;
+    std::memcpy(header.magic, BinarySceneMagic, sizeof(header.magic));
+    header.version = BinarySceneVersion;
+    header.byteOrder = BinarySceneByteOrder;
+    write(header);
+}
+
+BinarySceneWriter::~BinarySceneWriter() {
+    if (errorExit)
+        ErrorExit("Fatal errors during scene updating.");
+    if (ferror(f) != 0 || fclose(f) != 0)
+        ErrorExit("%s: error writing binary scene file: %s", filename, ErrorString());
+}
+
+void BinarySceneWriter::write(const void *ptr, size_t size) {
+    if (size > 0 && fwrite(ptr, size, 1, f) != 1)
+        ErrorExit("%s: %s", filename, ErrorString());
+    offset += size;
+}
+
+void BinarySceneWriter::write(const std::string &str) {
+    write(uint32_t(str.size()));
+    write(str.data(), str.size());
+}
+
+void BinarySceneWriter::writeFloats(const Float *v, int n) {
+    for (int i = 0; i < n; ++i)
+        write(double(v[i]));
+}
+
+void BinarySceneWriter::writeDirective(BinarySceneDirective directive,
+                                       const FileLoc &loc) {
+    if (loc.filename != currentSourceFile) {
+        currentSourceFile = std::string(loc.filename);
+        write(BinarySceneDirective::Filename);
+        write(currentSourceFile);
+    }
+    write(directive);
+    write(int32_t(loc.line));
+    write(int32_t(loc.column));
+}
+
+void BinarySceneWriter::writeParameters(const ParsedParameterVector &params,
+                                        bool resolveFilenames) {
+    write(uint32_t(params.size()));
+    for (const ParsedParameter *p : params) {
+        write(p->type);
+        write(p->name);
+        write(int32_t(p->loc.line));
+        write(int32_t(p->loc.column));
+
+        // Pad so that the numbers are aligned in the file
+        write(uint64_t(p->numbers.size()));
+        const char zeros[alignof(double)] = {};
+        write(zeros, (alignof(double) - offset % alignof(double)) % alignof(double));
+        write(p->numbers.data(), p->numbers.size() * sizeof(double));
+
+        // Store input files with absolute paths; when the binary file is
+        // loaded, relative ones would be resolved against its directory
+        // rather than the directory of the scene file they came from.
+        bool isFilename = p->type == "spectrum" ||
+                          (p->type == "string" &&
+                           (p->name == "filename" || p->name == "lensfile" ||
+                            p->name == "aperture" || p->name == "emissionfilename"));
+        write(uint64_t(p->strings.size()));
+        for (const std::string &s : p->strings) {
+            if (resolveFilenames && isFilename && !GetNamedSpectrum(s)) {
+                std::string path = AbsolutePath(ResolveFilename(s));
+                if (FileExists(path)) {
+                    write(path);
+                    continue;
+                }
+            }
+            write(s);
+        }
+
+        write(uint64_t(p->bools.size()));
+        write(p->bools.data(), p->bools.size());
+    }
+}
+
+void BinarySceneWriter::Option(const std::string &name, const std::string &value,
+                               FileLoc loc) {
+    writeDirective(BinarySceneDirective::Option, loc);
+    write(name);
+    write(value);
+}
+
+void BinarySceneWriter::Identity(FileLoc loc) {
+    writeDirective(BinarySceneDirective::Identity, loc);
+}
+
+void BinarySceneWriter::Translate(Float dx, Float dy, Float dz, FileLoc loc) {
+    writeDirective(BinarySceneDirective::Translate, loc);
+    Float v[3] = {dx, dy, dz};
+    writeFloats(v, 3);
+}
+
+void BinarySceneWriter::Rotate(Float angle, Float ax, Float ay, Float az, FileLoc loc) {
+    writeDirective(BinarySceneDirective::Rotate, loc);
+    Float v[4] = {angle, ax, ay, az};
+    writeFloats(v, 4);
+}
+
+void BinarySceneWriter::Scale(Float sx, Float sy, Float sz, FileLoc loc) {
+    writeDirective(BinarySceneDirective::Scale, loc);
+    Float v[3] = {sx, sy, sz};
+    writeFloats(v, 3);
+}
+
+void BinarySceneWriter::LookAt(Float ex, Float ey, Float ez, Float lx, Float ly,
+                               Float lz, Float ux, Float uy, Float uz, FileLoc loc) {
+    writeDirective(BinarySceneDirective::LookAt, loc);
+    Float v[9] = {ex, ey, ez, lx, ly, lz, ux, uy, uz};
+    writeFloats(v, 9);
+}
+
+void BinarySceneWriter::ConcatTransform(Float transform[16], FileLoc loc) {
+    writeDirective(BinarySceneDirective::ConcatTransform, loc);
+    writeFloats(transform, 16);
+}
+
+void BinarySceneWriter::Transform(Float transform[16], FileLoc loc) {
+    writeDirective(BinarySceneDirective::Transform, loc);
+    writeFloats(transform, 16);
+}
+
+void BinarySceneWriter::CoordinateSystem(const std::string &name, FileLoc loc) {
+    writeDirective(BinarySceneDirective::CoordinateSystem, loc);
+    write(name);
+}
+
+void BinarySceneWriter::CoordSysTransform(const std::string &name, FileLoc loc) {
+    writeDirective(BinarySceneDirective::CoordSysTransform, loc);
+    write(name);
+}
+
+void BinarySceneWriter::ActiveTransformAll(FileLoc loc) {
+    writeDirective(BinarySceneDirective::ActiveTransformAll, loc);
+}
+
+void BinarySceneWriter::ActiveTransformEndTime(FileLoc loc) {
+    writeDirective(BinarySceneDirective::ActiveTransformEndTime, loc);
+}
+
+void BinarySceneWriter::ActiveTransformStartTime(FileLoc loc) {
+    writeDirective(BinarySceneDirective::ActiveTransformStartTime, loc);
+}
+
+void BinarySceneWriter::TransformTimes(Float start, Float end, FileLoc loc) {
+    writeDirective(BinarySceneDirective::TransformTimes, loc);
+    Float v[2] = {start, end};
+    writeFloats(v, 2);
+}
+
+void BinarySceneWriter::ColorSpace(const std::string &n, FileLoc loc) {
+    writeDirective(BinarySceneDirective::ColorSpace, loc);
+    write(n);
+}
+
+void BinarySceneWriter::PixelFilter(const std::string &name,
+                                    ParsedParameterVector params, FileLoc loc) {
+    writeDirective(BinarySceneDirective::PixelFilter, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::Film(const std::string &type, ParsedParameterVector params,
+                             FileLoc loc) {
+    writeDirective(BinarySceneDirective::Film, loc);
+    write(type);
+    // The film's "filename" is an output, relative to the working directory.
+    writeParameters(params, false);
+}
+
+void BinarySceneWriter::Sampler(const std::string &name, ParsedParameterVector params,
+                                FileLoc loc) {
+    writeDirective(BinarySceneDirective::Sampler, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::Accelerator(const std::string &name,
+                                    ParsedParameterVector params, FileLoc loc) {
+    writeDirective(BinarySceneDirective::Accelerator, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::Integrator(const std::string &name, ParsedParameterVector params,
+                                   FileLoc loc) {
+    writeDirective(BinarySceneDirective::Integrator, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::Camera(const std::string &name, ParsedParameterVector params,
+                               FileLoc loc) {
+    writeDirective(BinarySceneDirective::Camera, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::MakeNamedMedium(const std::string &name,
+                                        ParsedParameterVector params, FileLoc loc) {
+    writeDirective(BinarySceneDirective::MakeNamedMedium, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::MediumInterface(const std::string &insideName,
+                                        const std::string &outsideName, FileLoc loc) {
+    writeDirective(BinarySceneDirective::MediumInterface, loc);
+    write(insideName);
+    write(outsideName);
+}
+
+void BinarySceneWriter::WorldBegin(FileLoc loc) {
+    writeDirective(BinarySceneDirective::WorldBegin, loc);
+}
+
+void BinarySceneWriter::AttributeBegin(FileLoc loc) {
+    writeDirective(BinarySceneDirective::AttributeBegin, loc);
+}
+
+void BinarySceneWriter::AttributeEnd(FileLoc loc) {
+    writeDirective(BinarySceneDirective::AttributeEnd, loc);
+}
+
+void BinarySceneWriter::Attribute(const std::string &target,
+                                  ParsedParameterVector params, FileLoc loc) {
+    writeDirective(BinarySceneDirective::Attribute, loc);
+    write(target);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::TransformBegin(FileLoc loc) {
+    writeDirective(BinarySceneDirective::TransformBegin, loc);
+}
+
+void BinarySceneWriter::TransformEnd(FileLoc loc) {
+    writeDirective(BinarySceneDirective::TransformEnd, loc);
+}
+
+void BinarySceneWriter::Texture(const std::string &name, const std::string &type,
+                                const std::string &texname,
+                                ParsedParameterVector params, FileLoc loc) {
+    writeDirective(BinarySceneDirective::Texture, loc);
+    write(name);
+    write(type);
+    write(texname);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::Material(const std::string &name, ParsedParameterVector params,
+                                 FileLoc loc) {
+    writeDirective(BinarySceneDirective::Material, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::MakeNamedMaterial(const std::string &name,
+                                          ParsedParameterVector params, FileLoc loc) {
+    writeDirective(BinarySceneDirective::MakeNamedMaterial, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::NamedMaterial(const std::string &name, FileLoc loc) {
+    writeDirective(BinarySceneDirective::NamedMaterial, loc);
+    write(name);
+}
+
+void BinarySceneWriter::LightSource(const std::string &name,
+                                    ParsedParameterVector params, FileLoc loc) {
+    writeDirective(BinarySceneDirective::LightSource, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::AreaLightSource(const std::string &name,
+                                        ParsedParameterVector params, FileLoc loc) {
+    writeDirective(BinarySceneDirective::AreaLightSource, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::Shape(const std::string &name, ParsedParameterVector params,
+                              FileLoc loc) {
+    writeDirective(BinarySceneDirective::Shape, loc);
+    write(name);
+    writeParameters(params);
+}
+
+void BinarySceneWriter::ReverseOrientation(FileLoc loc) {
+    writeDirective(BinarySceneDirective::ReverseOrientation, loc);
+}
+
+void BinarySceneWriter::ObjectBegin(const std::string &name, FileLoc loc) {
+    writeDirective(BinarySceneDirective::ObjectBegin, loc);
+    write(name);
+}
+
+void BinarySceneWriter::ObjectEnd(FileLoc loc) {
+    writeDirective(BinarySceneDirective::ObjectEnd, loc);
+}
+
+void BinarySceneWriter::ObjectInstance(const std::string &name, FileLoc loc) {
+    writeDirective(BinarySceneDirective::ObjectInstance, loc);
+    write(name);
+}
+
+void BinarySceneWriter::EndOfFiles() {}
+
 }  // namespace pbrt
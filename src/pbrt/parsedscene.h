@@ -14,7 +14,9 @@
 #include <pbrt/util/print.h>
 #include <pbrt/util/transform.h>
 
+#include <cstdio>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_set>
@@ -327,6 +329,11 @@ class ParsedScene : public SceneRepresentation {
 
     void EndOfFiles();
 
+    // Files given with _Import_ are parsed into separate scenes that start
+    // from a copy of the current graphics state and are then merged back.
+    std::unique_ptr<ParsedScene> CopyForImport(FileLoc loc) const;
+    void MergeImported(ParsedScene *importedScene);
+
     std::string ToString() const;
 
     void CreateTextures(std::map<std::string, FloatTextureHandle> *floatTextureMap,
@@ -388,6 +395,7 @@ class ParsedScene : public SceneRepresentation {
     std::vector<std::pair<char, FileLoc>>
         pushStack;  // 'a': attribute, 't': transform, 'o': object
     InstanceDefinitionSceneEntity *currentInstance = nullptr;
+    size_t nInheritedMaterials = 0;
 };
 
 class FormattingScene : public SceneRepresentation {
@@ -462,6 +470,81 @@ class FormattingScene : public SceneRepresentation {
     std::map<std::string, std::string> definedObjectInstances;
 };
 
+// BinarySceneWriter Definition
+class BinarySceneWriter : public SceneRepresentation {
+  public:
+    BinarySceneWriter(const std::string &filename);
+    ~BinarySceneWriter();
+
+    void Option(const std::string &name, const std::string &value, FileLoc loc);
+    void Identity(FileLoc loc);
+    void Translate(Float dx, Float dy, Float dz, FileLoc loc);
+    void Rotate(Float angle, Float ax, Float ay, Float az, FileLoc loc);
+    void Scale(Float sx, Float sy, Float sz, FileLoc loc);
+    void LookAt(Float ex, Float ey, Float ez, Float lx, Float ly, Float lz, Float ux,
+                Float uy, Float uz, FileLoc loc);
+    void ConcatTransform(Float transform[16], FileLoc loc);
+    void Transform(Float transform[16], FileLoc loc);
+    void CoordinateSystem(const std::string &, FileLoc loc);
+    void CoordSysTransform(const std::string &, FileLoc loc);
+    void ActiveTransformAll(FileLoc loc);
+    void ActiveTransformEndTime(FileLoc loc);
+    void ActiveTransformStartTime(FileLoc loc);
+    void TransformTimes(Float start, Float end, FileLoc loc);
+    void ColorSpace(const std::string &n, FileLoc loc);
+    void PixelFilter(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Film(const std::string &type, ParsedParameterVector params, FileLoc loc);
+    void Sampler(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Accelerator(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Integrator(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void Camera(const std::string &, ParsedParameterVector params, FileLoc loc);
+    void MakeNamedMedium(const std::string &name, ParsedParameterVector params,
+                         FileLoc loc);
+    void MediumInterface(const std::string &insideName, const std::string &outsideName,
+                         FileLoc loc);
+    void WorldBegin(FileLoc loc);
+    void AttributeBegin(FileLoc loc);
+    void AttributeEnd(FileLoc loc);
+    void Attribute(const std::string &target, ParsedParameterVector params, FileLoc loc);
+    void TransformBegin(FileLoc loc);
+    void TransformEnd(FileLoc loc);
+    void Texture(const std::string &name, const std::string &type,
+                 const std::string &texname, ParsedParameterVector params, FileLoc loc);
+    void Material(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void MakeNamedMaterial(const std::string &name, ParsedParameterVector params,
+                           FileLoc loc);
+    void NamedMaterial(const std::string &name, FileLoc loc);
+    void LightSource(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void AreaLightSource(const std::string &name, ParsedParameterVector params,
+                         FileLoc loc);
+    void Shape(const std::string &name, ParsedParameterVector params, FileLoc loc);
+    void ReverseOrientation(FileLoc loc);
+    void ObjectBegin(const std::string &name, FileLoc loc);
+    void ObjectEnd(FileLoc loc);
+    void ObjectInstance(const std::string &name, FileLoc loc);
+
+    void EndOfFiles();
+
+  private:
+    // BinarySceneWriter Private Methods
+    void write(const void *ptr, size_t size);
+    template <typename T>
+    void write(const T &value) {
+        write(&value, sizeof(T));
+    }
+    void write(const std::string &str);
+    void writeFloats(const Float *v, int n);
+    void writeDirective(BinarySceneDirective directive, const FileLoc &loc);
+    void writeParameters(const ParsedParameterVector &params,
+                         bool resolveFilenames = true);
+
+    // BinarySceneWriter Private Members
+    std::string filename;
+    FILE *f = nullptr;
+    size_t offset = 0;
+    std::string currentSourceFile;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_PARSEDSCENE_H
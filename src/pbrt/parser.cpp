@@ -11,6 +11,7 @@
 #include <pbrt/util/error.h>
 #include <pbrt/util/file.h>
 #include <pbrt/util/memory.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/stats.h>
 
@@ -529,8 +530,328 @@ static ParsedParameterVector parseParameters(
     return parameterVector;
 }
 
+bool IsBinarySceneFile(const std::string &filename) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+    char magic[sizeof(BinarySceneMagic)];
+    bool isBinary = fread(magic, sizeof(magic), 1, f) == 1 &&
+                    memcmp(magic, BinarySceneMagic, sizeof(magic)) == 0;
+    fclose(f);
+    return isBinary;
+}
+
+// BinarySceneReader Definition
+class BinarySceneReader {
+  public:
+    // BinarySceneReader Public Methods
+    BinarySceneReader(const char *data, size_t size, const std::string &filename)
+        : filename(filename), start(data), pos(data), end(data + size) {}
+
+    bool AtEnd() const { return pos == end; }
+
+    template <typename T>
+    T Read() {
+        T value;
+        std::memcpy(&value, get(1, sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    void ReadFloats(Float *v, int n) {
+        for (int i = 0; i < n; ++i)
+            v[i] = Float(Read<double>());
+    }
+
+    std::string ReadString() {
+        uint32_t length = Read<uint32_t>();
+        return std::string(get(length, 1), length);
+    }
+
+    FileLoc ReadLoc() {
+        loc.line = Read<int32_t>();
+        loc.column = Read<int32_t>();
+        return loc;
+    }
+
+    void SetSourceFilename(std::string_view name) { loc.filename = name; }
+
+    ParsedParameterVector ReadParameters(Allocator alloc) {
+        ParsedParameterVector params;
+        uint32_t count = Read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            std::string type = ReadString(), name = ReadString();
+            ParsedParameter *param = alloc.new_object<ParsedParameter>(alloc, ReadLoc());
+            param->type = std::move(type);
+            param->name = std::move(name);
+
+            // Copy the parameter's numbers directly from the file's aligned array
+            uint64_t nNumbers = Read<uint64_t>();
+            pos = start + ((pos - start + alignof(double) - 1) & ~(alignof(double) - 1));
+            const char *numbers = get(nNumbers, sizeof(double));
+            param->numbers.resize(nNumbers);
+            std::memcpy(param->numbers.data(), numbers, nNumbers * sizeof(double));
+
+            uint64_t nStrings = Read<uint64_t>();
+            for (uint64_t j = 0; j < nStrings; ++j)
+                param->strings.push_back(ReadString());
+
+            uint64_t nBools = Read<uint64_t>();
+            const char *bools = get(nBools, 1);
+            param->bools.resize(nBools);
+            std::memcpy(param->bools.data(), bools, nBools);
+
+            params.push_back(param);
+        }
+        return params;
+    }
+
+  private:
+    // BinarySceneReader Private Methods
+    const char *get(uint64_t count, size_t size) {
+        if (pos > end || count > size_t(end - pos) / size)
+            ErrorExit(&loc, "%s: premature end of binary scene file", filename);
+        const char *p = pos;
+        pos += count * size;
+        return p;
+    }
+
+    // BinarySceneReader Private Members
+    const std::string &filename;
+    const char *start, *pos, *end;
+    FileLoc loc;
+};
+
+static void parseBinary(SceneRepresentation *scene, const std::string &filename) {
+    LOG_VERBOSE("Reading binary scene %s", filename);
+    // Map the binary scene file into memory
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        ErrorExit("%s: %s", filename, ErrorString());
+    struct stat stat;
+    if (fstat(fd, &stat) != 0)
+        ErrorExit("%s: %s", filename, ErrorString());
+    size_t size = stat.st_size;
+    void *ptr = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0)
+                         : nullptr;
+    if (ptr == MAP_FAILED)
+        ErrorExit("%s: %s", filename, ErrorString());
+    if (close(fd) != 0)
+        ErrorExit("%s: %s", filename, ErrorString());
+    const char *data = (const char *)ptr;
+#else
+    std::string contents = ReadFileContents(filename);
+    const char *data = contents.data();
+    size_t size = contents.size();
+#endif
+
+    BinarySceneReader reader(data, size, filename);
+    BinarySceneHeader header = reader.Read<BinarySceneHeader>();
+    if (memcmp(header.magic, BinarySceneMagic, sizeof(header.magic)) != 0)
+        ErrorExit("%s: not a binary scene file", filename);
+    if (header.byteOrder != BinarySceneByteOrder)
+        ErrorExit("%s: binary scene file was written with a different byte order",
+                  filename);
+    if (header.version != BinarySceneVersion)
+        ErrorExit("%s: binary scene file version %d is not supported", filename,
+                  header.version);
+
+    TrackedMemoryResource memoryResource;
+    Allocator alloc(&memoryResource);
+    while (!reader.AtEnd()) {
+        BinarySceneDirective directive = reader.Read<BinarySceneDirective>();
+        if (directive == BinarySceneDirective::Filename) {
+            // As with the _Tokenizer_, leak the filename so that _FileLoc_s
+            // that refer to it remain valid.
+            reader.SetSourceFilename(*new std::string(reader.ReadString()));
+            continue;
+        }
+
+        FileLoc loc = reader.ReadLoc();
+        auto paramListEntrypoint =
+            [&](void (SceneRepresentation::*apiFunc)(const std::string &,
+                                                     ParsedParameterVector, FileLoc)) {
+                std::string name = reader.ReadString();
+                ParsedParameterVector params = reader.ReadParameters(alloc);
+                (scene->*apiFunc)(name, std::move(params), loc);
+            };
+        auto stringEntrypoint = [&](void (SceneRepresentation::*apiFunc)(
+                                        const std::string &, FileLoc)) {
+            (scene->*apiFunc)(reader.ReadString(), loc);
+        };
+
+        Float v[16];
+        switch (directive) {
+        case BinarySceneDirective::Option: {
+            std::string name = reader.ReadString();
+            std::string value = reader.ReadString();
+            scene->Option(name, value, loc);
+            break;
+        }
+        case BinarySceneDirective::Identity:
+            scene->Identity(loc);
+            break;
+        case BinarySceneDirective::Translate:
+            reader.ReadFloats(v, 3);
+            scene->Translate(v[0], v[1], v[2], loc);
+            break;
+        case BinarySceneDirective::Rotate:
+            reader.ReadFloats(v, 4);
+            scene->Rotate(v[0], v[1], v[2], v[3], loc);
+            break;
+        case BinarySceneDirective::Scale:
+            reader.ReadFloats(v, 3);
+            scene->Scale(v[0], v[1], v[2], loc);
+            break;
+        case BinarySceneDirective::LookAt:
+            reader.ReadFloats(v, 9);
+            scene->LookAt(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], loc);
+            break;
+        case BinarySceneDirective::ConcatTransform:
+            reader.ReadFloats(v, 16);
+            scene->ConcatTransform(v, loc);
+            break;
+        case BinarySceneDirective::Transform:
+            reader.ReadFloats(v, 16);
+            scene->Transform(v, loc);
+            break;
+        case BinarySceneDirective::CoordinateSystem:
+            stringEntrypoint(&SceneRepresentation::CoordinateSystem);
+            break;
+        case BinarySceneDirective::CoordSysTransform:
+            stringEntrypoint(&SceneRepresentation::CoordSysTransform);
+            break;
+        case BinarySceneDirective::ActiveTransformAll:
+            scene->ActiveTransformAll(loc);
+            break;
+        case BinarySceneDirective::ActiveTransformEndTime:
+            scene->ActiveTransformEndTime(loc);
+            break;
+        case BinarySceneDirective::ActiveTransformStartTime:
+            scene->ActiveTransformStartTime(loc);
+            break;
+        case BinarySceneDirective::TransformTimes:
+            reader.ReadFloats(v, 2);
+            scene->TransformTimes(v[0], v[1], loc);
+            break;
+        case BinarySceneDirective::ColorSpace:
+            stringEntrypoint(&SceneRepresentation::ColorSpace);
+            break;
+        case BinarySceneDirective::PixelFilter:
+            paramListEntrypoint(&SceneRepresentation::PixelFilter);
+            break;
+        case BinarySceneDirective::Film:
+            paramListEntrypoint(&SceneRepresentation::Film);
+            break;
+        case BinarySceneDirective::Accelerator:
+            paramListEntrypoint(&SceneRepresentation::Accelerator);
+            break;
+        case BinarySceneDirective::Integrator:
+            paramListEntrypoint(&SceneRepresentation::Integrator);
+            break;
+        case BinarySceneDirective::Camera:
+            paramListEntrypoint(&SceneRepresentation::Camera);
+            break;
+        case BinarySceneDirective::MakeNamedMedium:
+            paramListEntrypoint(&SceneRepresentation::MakeNamedMedium);
+            break;
+        case BinarySceneDirective::MediumInterface: {
+            std::string insideName = reader.ReadString();
+            std::string outsideName = reader.ReadString();
+            scene->MediumInterface(insideName, outsideName, loc);
+            break;
+        }
+        case BinarySceneDirective::Sampler:
+            paramListEntrypoint(&SceneRepresentation::Sampler);
+            break;
+        case BinarySceneDirective::WorldBegin:
+            scene->WorldBegin(loc);
+            break;
+        case BinarySceneDirective::AttributeBegin:
+            scene->AttributeBegin(loc);
+            break;
+        case BinarySceneDirective::AttributeEnd:
+            scene->AttributeEnd(loc);
+            break;
+        case BinarySceneDirective::Attribute:
+            paramListEntrypoint(&SceneRepresentation::Attribute);
+            break;
+        case BinarySceneDirective::TransformBegin:
+            scene->TransformBegin(loc);
+            break;
+        case BinarySceneDirective::TransformEnd:
+            scene->TransformEnd(loc);
+            break;
+        case BinarySceneDirective::Texture: {
+            std::string name = reader.ReadString();
+            std::string type = reader.ReadString();
+            std::string texName = reader.ReadString();
+            ParsedParameterVector params = reader.ReadParameters(alloc);
+            scene->Texture(name, type, texName, std::move(params), loc);
+            break;
+        }
+        case BinarySceneDirective::Material:
+            paramListEntrypoint(&SceneRepresentation::Material);
+            break;
+        case BinarySceneDirective::MakeNamedMaterial:
+            paramListEntrypoint(&SceneRepresentation::MakeNamedMaterial);
+            break;
+        case BinarySceneDirective::NamedMaterial:
+            stringEntrypoint(&SceneRepresentation::NamedMaterial);
+            break;
+        case BinarySceneDirective::LightSource:
+            paramListEntrypoint(&SceneRepresentation::LightSource);
+            break;
+        case BinarySceneDirective::AreaLightSource:
+            paramListEntrypoint(&SceneRepresentation::AreaLightSource);
+            break;
+        case BinarySceneDirective::Shape:
+            paramListEntrypoint(&SceneRepresentation::Shape);
+            break;
+        case BinarySceneDirective::ReverseOrientation:
+            scene->ReverseOrientation(loc);
+            break;
+        case BinarySceneDirective::ObjectBegin:
+            stringEntrypoint(&SceneRepresentation::ObjectBegin);
+            break;
+        case BinarySceneDirective::ObjectEnd:
+            scene->ObjectEnd(loc);
+            break;
+        case BinarySceneDirective::ObjectInstance:
+            stringEntrypoint(&SceneRepresentation::ObjectInstance);
+            break;
+        default:
+            ErrorExit(&loc, "%s: unknown binary scene directive %d", filename,
+                      int(directive));
+        }
+    }
+
+#ifdef PBRT_HAVE_MMAP
+    if (ptr && munmap(ptr, size) != 0)
+        ErrorExit("munmap: %s", ErrorString());
+#endif
+}
+
+static void parse(SceneRepresentation *scene, std::unique_ptr<Tokenizer> t);
+
+static void parseFile(SceneRepresentation *scene, const std::string &filename) {
+    if (IsBinarySceneFile(filename))
+        parseBinary(scene, filename);
+    else {
+        std::unique_ptr<Tokenizer> t =
+            Tokenizer::CreateFromFile(filename, [](const char *msg, const FileLoc *loc) {
+                ErrorExit(loc, "%s", msg);
+            });
+        if (t)
+            parse(scene, std::move(t));
+    }
+}
+
 static void parse(SceneRepresentation *scene, std::unique_ptr<Tokenizer> t) {
     bool formatting = dynamic_cast<FormattingScene *>(scene) != nullptr;
+    ParsedScene *parsedScene = dynamic_cast<ParsedScene *>(scene);
+    // Imported files and the scenes that they will be parsed into
+    std::vector<std::pair<std::string, std::unique_ptr<ParsedScene>>> imports;
     TrackedMemoryResource memoryResource;
     Allocator alloc(&memoryResource);
 
@@ -688,10 +1009,30 @@ static void parse(SceneRepresentation *scene, std::unique_ptr<Tokenizer> t) {
                            dynamic_cast<FormattingScene *>(scene)->indent(), filename);
                 else {
                     filename = ResolveFilename(filename);
-                    std::unique_ptr<Tokenizer> tinc =
-                        Tokenizer::CreateFromFile(filename, parseError);
-                    if (tinc)
-                        fileStack.push_back(std::move(tinc));
+                    if (IsBinarySceneFile(filename))
+                        parseBinary(scene, filename);
+                    else {
+                        std::unique_ptr<Tokenizer> tinc =
+                            Tokenizer::CreateFromFile(filename, parseError);
+                        if (tinc)
+                            fileStack.push_back(std::move(tinc));
+                    }
+                }
+            } else if (tok->token == "Import") {
+                Token filenameToken = *nextToken(TokenRequired);
+                std::string filename = toString(dequoteString(filenameToken));
+                if (formatting)
+                    Printf("%sImport \"%s\"\n",
+                           dynamic_cast<FormattingScene *>(scene)->indent(), filename);
+                else if (parsedScene)
+                    imports.push_back(std::make_pair(
+                        ResolveFilename(filename), parsedScene->CopyForImport(tok->loc)));
+                else {
+                    // Without separate scenes to parse into, keep the imported
+                    // file's graphics state changes local to it.
+                    scene->AttributeBegin(tok->loc);
+                    parseFile(scene, ResolveFilename(filename));
+                    scene->AttributeEnd(tok->loc);
                 }
             } else if (tok->token == "Identity")
                 scene->Identity(tok->loc);
@@ -859,6 +1200,13 @@ static void parse(SceneRepresentation *scene, std::unique_ptr<Tokenizer> t) {
             syntaxError(*tok);
         }
     }
+
+    // Parse the imported files in parallel and merge them in order
+    ParallelFor(0, imports.size(), [&](int64_t i) {
+        parseFile(imports[i].second.get(), imports[i].first);
+    });
+    for (auto &import : imports)
+        parsedScene->MergeImported(import.second.get());
 }
 
 void ParseFiles(SceneRepresentation *scene, pstd::span<const std::string> filenames) {
@@ -878,6 +1226,11 @@ void ParseFiles(SceneRepresentation *scene, pstd::span<const std::string> filena
             if (fn != "-")
                 SetSearchDirectory(fn);
 
+            if (fn != "-" && IsBinarySceneFile(fn)) {
+                parseBinary(scene, fn);
+                continue;
+            }
+
             std::unique_ptr<Tokenizer> t = Tokenizer::CreateFromFile(fn, tokError);
             if (t)
                 parse(scene, std::move(t));
@@ -138,6 +138,71 @@ class SceneRepresentation {
 void ParseFiles(SceneRepresentation *scene, pstd::span<const std::string> filenames);
 void ParseString(SceneRepresentation *scene, std::string str);
 
+// Binary Scene Format Definitions
+// Binary scene files hold a _BinarySceneHeader_ followed by directives. Each
+// directive is a _BinarySceneDirective_ and the line and column of its source,
+// followed by its arguments: strings are a 32-bit length and their characters,
+// and _Float_ arguments are doubles. A parameter list is a 32-bit count and then
+// each parameter's type, name, line, and column, followed by its numbers,
+// strings, and bools, each preceded by a 64-bit count. Numbers are stored as
+// raw doubles, 8-byte aligned within the file, so that they can be read
+// without any conversion. Everything is in the byte order of the writer.
+struct BinarySceneHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+};
+
+constexpr char BinarySceneMagic[8] = "pbrtbin";
+constexpr uint32_t BinarySceneVersion = 1;
+constexpr uint32_t BinarySceneByteOrder = 0x01020304;
+
+enum class BinarySceneDirective : uint32_t {
+    Filename,
+    Option,
+    Identity,
+    Translate,
+    Rotate,
+    Scale,
+    LookAt,
+    ConcatTransform,
+    Transform,
+    CoordinateSystem,
+    CoordSysTransform,
+    ActiveTransformAll,
+    ActiveTransformEndTime,
+    ActiveTransformStartTime,
+    TransformTimes,
+    ColorSpace,
+    PixelFilter,
+    Film,
+    Accelerator,
+    Integrator,
+    Camera,
+    MakeNamedMedium,
+    MediumInterface,
+    Sampler,
+    WorldBegin,
+    AttributeBegin,
+    AttributeEnd,
+    Attribute,
+    TransformBegin,
+    TransformEnd,
+    Texture,
+    Material,
+    MakeNamedMaterial,
+    NamedMaterial,
+    LightSource,
+    AreaLightSource,
+    Shape,
+    ReverseOrientation,
+    ObjectBegin,
+    ObjectEnd,
+    ObjectInstance
+};
+
+bool IsBinarySceneFile(const std::string &filename);
+
 // Token Definition
 struct Token {
     Token() = default;
@@ -4,8 +4,10 @@
 
 #include <gtest/gtest.h>
 
+#include <pbrt/parsedscene.h>
 #include <pbrt/parser.h>
 #include <pbrt/pbrt.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/pstd.h>
 
 #include <fstream>
@@ -144,3 +146,212 @@ Integrator "deep" "float density" [ 2 2.66612 -5e-51]
 
     EXPECT_EQ(0, remove(filename.c_str()));
 }
+
+TEST(Parser, BinaryScene) {
+    std::string includeFilename = inTestDir("include.pbrt");
+    std::ofstream inc(includeFilename);
+    inc << R"(
+Material "conductor" "spectrum eta" "metal-Cu-eta" "float roughness" 0.125
+Shape "trianglemesh" "point3 P" [ 0 0 0 1 0 0 1 1 0.5 ] "integer indices" [ 0 1 2 ]
+    "point2 uv" [ 0 0 1 0 1 1 ]
+)";
+    inc.close();
+    ASSERT_TRUE(inc.good());
+
+    std::string filename = inTestDir("test.pbrt");
+    std::ofstream out(filename);
+    out << R"(
+LookAt 0 0 5  0 0 0  0 1 0
+Camera "perspective" "float fov" [ 45 ]
+Film "rgb" "integer xresolution" [ 64 ] "integer yresolution" 32
+    "string filename" "test.exr"
+Sampler "halton" "integer pixelsamples" 16
+WorldBegin
+LightSource "infinite" "rgb L" [ .5 .25 .125 ]
+AttributeBegin
+  Translate 1 -2 3.5
+  Rotate 30 0 1 0
+  Texture "checks" "spectrum" "checkerboard" "float uscale" 4 "rgb tex1" [ 1 0 0 ]
+  Material "diffuse" "texture reflectance" "checks"
+  AreaLightSource "diffuse" "blackbody L" 5500 "bool twosided" true
+  Shape "sphere" "float radius" 0.25
+AttributeEnd
+ObjectBegin "obj"
+  Include "include.pbrt"
+ObjectEnd
+ObjectInstance "obj"
+)";
+    out.close();
+    ASSERT_TRUE(out.good());
+
+    std::string binaryFilename = inTestDir("test.pbrtbin");
+    {
+        BinarySceneWriter writer(binaryFilename);
+        ParseFiles(&writer, {filename});
+    }
+    EXPECT_TRUE(IsBinarySceneFile(binaryFilename));
+    EXPECT_FALSE(IsBinarySceneFile(filename));
+
+    // The binary scene should be parsed to the same scene as the text file,
+    // including the source locations of its entities.
+    ParsedScene textScene, binaryScene;
+    ParseFiles(&textScene, {filename});
+    ParseFiles(&binaryScene, {binaryFilename});
+    auto expectSame = [](const auto &a, const auto &b) {
+        EXPECT_EQ(StringPrintf("%s", a), StringPrintf("%s", b));
+    };
+    expectSame(textScene.camera.parameters, binaryScene.camera.parameters);
+    expectSame(textScene.camera.cameraTransform.CameraFromWorld(0),
+               binaryScene.camera.cameraTransform.CameraFromWorld(0));
+    expectSame(textScene.film, binaryScene.film);
+    expectSame(textScene.sampler, binaryScene.sampler);
+    expectSame(textScene.lights[0].parameters, binaryScene.lights[0].parameters);
+    expectSame(textScene.spectrumTextures[0].second,
+               binaryScene.spectrumTextures[0].second);
+    expectSame(textScene.materials, binaryScene.materials);
+    expectSame(textScene.areaLights, binaryScene.areaLights);
+    expectSame(textScene.shapes, binaryScene.shapes);
+    expectSame(textScene.instanceDefinitions["obj"],
+               binaryScene.instanceDefinitions["obj"]);
+    const auto &instanceShapes = binaryScene.instanceDefinitions["obj"].shapes;
+    ASSERT_EQ(1, instanceShapes.size());
+    EXPECT_EQ("include.pbrt", instanceShapes[0].loc.filename);
+
+    // Writing the binary scene again should give the same file.
+    std::string binaryFilename2 = inTestDir("test2.pbrtbin");
+    {
+        BinarySceneWriter writer(binaryFilename2);
+        ParseFiles(&writer, {binaryFilename});
+    }
+    EXPECT_EQ(ReadFileContents(binaryFilename), ReadFileContents(binaryFilename2));
+
+    EXPECT_EQ(0, remove(includeFilename.c_str()));
+    EXPECT_EQ(0, remove(filename.c_str()));
+    EXPECT_EQ(0, remove(binaryFilename.c_str()));
+    EXPECT_EQ(0, remove(binaryFilename2.c_str()));
+}
+
+TEST(Parser, BinarySceneFilenames) {
+    std::string plyFilename = inTestDir("binary-filenames.ply");
+    std::ofstream ply(plyFilename);
+    ply << "ply\n";
+    ply.close();
+    ASSERT_TRUE(ply.good());
+
+    std::string filename = inTestDir("binary-filenames.pbrt");
+    std::ofstream out(filename);
+    out << R"(
+Film "rgb" "string filename" "binary-filenames.ply"
+WorldBegin
+Shape "plymesh" "string filename" "binary-filenames.ply"
+Shape "plymesh" "string filename" "missing.ply"
+)";
+    out.close();
+    ASSERT_TRUE(out.good());
+
+    std::string binaryFilename = inTestDir("binary-filenames.pbrtbin");
+    {
+        BinarySceneWriter writer(binaryFilename);
+        ParseFiles(&writer, {filename});
+    }
+
+    // Input files are stored with absolute paths so that the binary file can
+    // be written to a different directory than the scene; the film's output
+    // filename and names that don't resolve to a file are left as they are.
+    ParsedScene scene;
+    ParseFiles(&scene, {binaryFilename});
+    ASSERT_EQ(2, scene.shapes.size());
+    std::string plyPath = scene.shapes[0].parameters.GetOneString("filename", "");
+    EXPECT_NE(plyFilename, plyPath);
+    EXPECT_EQ(AbsolutePath(plyFilename), plyPath);
+    EXPECT_TRUE(FileExists(plyPath));
+    EXPECT_EQ("missing.ply", scene.shapes[1].parameters.GetOneString("filename", ""));
+    EXPECT_EQ(plyFilename, scene.film.parameters.GetOneString("filename", ""));
+
+    EXPECT_EQ(0, remove(plyFilename.c_str()));
+    EXPECT_EQ(0, remove(filename.c_str()));
+    EXPECT_EQ(0, remove(binaryFilename.c_str()));
+}
+
+TEST(Parser, Import) {
+    auto writeFile = [](const std::string &filename, const char *contents) {
+        std::ofstream out(filename);
+        out << contents;
+        out.close();
+        EXPECT_TRUE(out.good());
+    };
+    writeFile(inTestDir("import0.pbrt"), R"(
+Material "dielectric"
+Shape "sphere" "float radius" 0.5
+AttributeBegin
+  Translate 0 5 0
+  AreaLightSource "diffuse" "rgb L" [ 1 1 1 ]
+  Shape "sphere" "float radius" 0.25
+AttributeEnd
+MakeNamedMaterial "named" "string type" "diffuse"
+ObjectBegin "obj"
+  Shape "disk"
+ObjectEnd
+)");
+    writeFile(inTestDir("import1.pbrt"), R"(
+NamedMaterial "named"
+Shape "cylinder"
+Import "import2.pbrt"
+)");
+    writeFile(inTestDir("import2.pbrt"), R"(
+Scale 2 2 2
+Shape "disk"
+)");
+    std::string filename = inTestDir("import.pbrt");
+    writeFile(filename, R"(
+WorldBegin
+Material "conductor"
+Translate 1 0 0
+Import "import0.pbrt"
+Shape "sphere" "float radius" 2
+Import "import1.pbrt"
+ObjectInstance "obj"
+)");
+
+    ParsedScene scene;
+    ParseFiles(&scene, {filename});
+
+    // The imported files' changes to the graphics state don't affect the
+    // importing file, and their shapes follow its own.
+    ASSERT_EQ(5, scene.shapes.size());
+    pbrt::Transform translate = Translate(Vector3f(1, 0, 0));
+    const ShapeSceneEntity &sphere = scene.shapes[0];
+    EXPECT_EQ(2, sphere.parameters.GetOneFloat("radius", 0));
+    EXPECT_EQ("conductor", scene.materials[sphere.materialIndex].name);
+    EXPECT_EQ(-1, sphere.lightIndex);
+    EXPECT_EQ(translate, *sphere.renderFromObject);
+
+    EXPECT_EQ(0.5, scene.shapes[1].parameters.GetOneFloat("radius", 0));
+    EXPECT_EQ("dielectric", scene.materials[scene.shapes[1].materialIndex].name);
+    EXPECT_EQ(translate, *scene.shapes[1].renderFromObject);
+
+    const ShapeSceneEntity &emitter = scene.shapes[2];
+    EXPECT_EQ(0.25, emitter.parameters.GetOneFloat("radius", 0));
+    EXPECT_EQ("dielectric", scene.materials[emitter.materialIndex].name);
+    ASSERT_EQ(1, scene.areaLights.size());
+    EXPECT_EQ(0, emitter.lightIndex);
+    EXPECT_EQ(translate * Translate(Vector3f(0, 5, 0)), *emitter.renderFromObject);
+
+    EXPECT_EQ("cylinder", scene.shapes[3].name);
+    EXPECT_EQ("named", scene.shapes[3].materialName);
+    EXPECT_EQ(translate, *scene.shapes[3].renderFromObject);
+
+    // Nested imports start from the state of the importing file
+    EXPECT_EQ("disk", scene.shapes[4].name);
+    EXPECT_EQ("named", scene.shapes[4].materialName);
+    EXPECT_EQ(translate * Scale(2, 2, 2), *scene.shapes[4].renderFromObject);
+
+    ASSERT_EQ(1, scene.namedMaterials.size());
+    EXPECT_EQ("named", scene.namedMaterials[0].first);
+    ASSERT_EQ(1, scene.instanceDefinitions.count("obj"));
+    EXPECT_EQ(1, scene.instanceDefinitions["obj"].shapes.size());
+    EXPECT_EQ(1, scene.instances.size());
+
+    for (const char *name : {"import", "import0", "import1", "import2"})
+        EXPECT_EQ(0, remove(inTestDir(std::string(name) + ".pbrt").c_str()));
+}
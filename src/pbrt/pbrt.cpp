@@ -31,8 +31,8 @@ void InitPBRT(const PBRTOptions &opt) {
 
     // General \pbrt Initialization
     int nThreads = Options->nThreads != 0 ? Options->nThreads : AvailableCores();
-    ParallelInit(nThreads);  // Threads must be launched before the
-                             // profiler is initialized.
+    // Threads must be launched before the profiler is initialized.
+    ParallelInit(nThreads, Options->pinThreads);
 
     if (Options->useGPU) {
 #ifdef PBRT_BUILD_GPU_RENDERER
@@ -61,8 +61,11 @@ void InitPBRT(const PBRTOptions &opt) {
         BilinearPatch::Init({});
     }
 
+    SetDisplayUpdateInterval(Options->displayInterval);
     if (!Options->displayServer.empty())
         ConnectToDisplayServer(Options->displayServer);
+    if (!Options->previewFile.empty())
+        OpenPreviewFile(Options->previewFile);
 }
 
 void CleanupPBRT() {
@@ -78,7 +81,7 @@ void CleanupPBRT() {
     if (PrintCheckRare(stdout))
         ErrorExit("CHECK_RARE failures");
 
-    if (!Options->displayServer.empty())
+    if (!Options->displayServer.empty() || !Options->previewFile.empty())
         DisconnectFromDisplayServer();
 
     // API Cleanup
@@ -21,6 +21,8 @@
 #include <pbrt/util/splines.h>
 #include <pbrt/util/stats.h>
 
+#include <mutex>
+
 #if defined(PBRT_BUILD_GPU_RENDERER)
 #include <cuda.h>
 #endif
@@ -139,6 +141,9 @@ pstd::vector<const TriangleMesh *> *Triangle::allMeshes;
 #if defined(PBRT_BUILD_GPU_RENDERER)
 PBRT_GPU pstd::vector<const TriangleMesh *> *allTriangleMeshesGPU;
 #endif
+// Shapes are created in parallel when the scene is loaded, so adding meshes to
+// _allMeshes_ requires holding a lock.
+static std::mutex allTriangleMeshesMutex;
 
 void Triangle::Init(Allocator alloc) {
     allMeshes = alloc.new_object<pstd::vector<const TriangleMesh *>>(alloc);
@@ -154,9 +159,13 @@ STAT_MEMORY_COUNTER("Memory/Triangles", triangleBytes);
 // Triangle Method Definitions
 pstd::vector<ShapeHandle> Triangle::CreateTriangles(const TriangleMesh *mesh,
                                                     Allocator alloc) {
-    CHECK_LT(allMeshes->size(), 1 << 31);
-    int meshIndex = int(allMeshes->size());
-    allMeshes->push_back(mesh);
+    int meshIndex;
+    {
+        std::lock_guard<std::mutex> lock(allTriangleMeshesMutex);
+        CHECK_LT(allMeshes->size(), 1 << 31);
+        meshIndex = int(allMeshes->size());
+        allMeshes->push_back(mesh);
+    }
 
     pstd::vector<ShapeHandle> tris(mesh->nTriangles, alloc);
     Triangle *t = alloc.allocate_object<Triangle>(mesh->nTriangles);
@@ -178,6 +187,49 @@ Bounds3f Triangle::Bounds() const {
     return Union(Bounds3f(p0, p1), p2);
 }
 
+Bounds3f Triangle::ClippedBounds(const Bounds3f &clip) const {
+    // Initialize polygon with the triangle's vertices
+    auto mesh = GetMesh();
+    const int *v = &mesh->vertexIndices[3 * triIndex];
+    // Each of the six clipping planes adds at most one vertex
+    Point3f poly[9] = {mesh->p[v[0]], mesh->p[v[1]], mesh->p[v[2]]};
+    int nVertices = 3;
+
+    // Clip polygon against the planes of _clip_
+    for (int dim = 0; dim < 3; ++dim)
+        for (int side = 0; side < 2; ++side) {
+            Float plane = clip[side][dim];
+            auto inside = [=](const Point3f &p) {
+                return side == 0 ? p[dim] >= plane : p[dim] <= plane;
+            };
+            Point3f clipped[9];
+            int nClipped = 0;
+            for (int i = 0; i < nVertices; ++i) {
+                const Point3f &a = poly[i], &b = poly[(i + 1) % nVertices];
+                if (inside(a))
+                    clipped[nClipped++] = a;
+                if (inside(a) != inside(b)) {
+                    Float t = (plane - a[dim]) / (b[dim] - a[dim]);
+                    Point3f p = a + t * (b - a);
+                    p[dim] = plane;
+                    clipped[nClipped++] = p;
+                }
+            }
+            if (nClipped == 0)
+                return {};
+            std::copy(clipped, clipped + nClipped, poly);
+            nVertices = nClipped;
+        }
+
+    // Bound clipped polygon, conservatively covering error in the clipped vertices
+    Bounds3f bounds;
+    for (int i = 0; i < nVertices; ++i)
+        bounds = Union(bounds, poly[i]);
+    Float maxCoord = std::max(MaxComponentValue(Abs(Vector3f(bounds.pMin))),
+                              MaxComponentValue(Abs(Vector3f(bounds.pMax))));
+    return pbrt::Intersect(Expand(bounds, gamma(3) * maxCoord), clip);
+}
+
 DirectionCone Triangle::NormalBounds() const {
     // Get triangle vertices in _p0_, _p1_, and _p2_
     auto mesh = GetMesh();
@@ -1011,12 +1063,18 @@ BilinearPatchMesh *BilinearPatch::CreateMesh(const Transform *renderFromObject,
         std::move(N), std::move(uv), std::move(faceIndices), imageDist);
 }
 
+// See _allTriangleMeshesMutex_.
+static std::mutex allBilinearMeshesMutex;
+
 pstd::vector<ShapeHandle> BilinearPatch::CreatePatches(const BilinearPatchMesh *mesh,
                                                        Allocator alloc) {
-    CHECK_LT(allMeshes->size(), 1 << 31);
-    int meshIndex = int(allMeshes->size());
-
-    allMeshes->push_back(mesh);
+    int meshIndex;
+    {
+        std::lock_guard<std::mutex> lock(allBilinearMeshesMutex);
+        CHECK_LT(allMeshes->size(), 1 << 31);
+        meshIndex = int(allMeshes->size());
+        allMeshes->push_back(mesh);
+    }
 
     pstd::vector<ShapeHandle> blps(mesh->nPatches, alloc);
     BilinearPatch *patches = alloc.allocate_object<BilinearPatch>(mesh->nPatches);
@@ -1416,17 +1474,24 @@ pstd::vector<ShapeHandle> ShapeHandle::Create(const std::string &name,
         std::string filename = ResolveFilename(parameters.GetOneString("filename", ""));
         TriQuadMesh plyMesh = TriQuadMesh::ReadPLY(filename);
 
+        // Hand the PLY buffers over to the meshes rather than copying them,
+        // unless the quads still need the vertices
         if (!plyMesh.triIndices.empty()) {
+            bool haveQuads = !plyMesh.quadIndices.empty();
             TriangleMesh *mesh = alloc.new_object<TriangleMesh>(
-                *renderFromObject, reverseOrientation, plyMesh.triIndices, plyMesh.p,
-                std::vector<Vector3f>(), plyMesh.n, plyMesh.uv, plyMesh.faceIndices);
+                *renderFromObject, reverseOrientation, std::move(plyMesh.triIndices),
+                haveQuads ? plyMesh.p : std::move(plyMesh.p), std::vector<Vector3f>(),
+                haveQuads ? plyMesh.n : std::move(plyMesh.n),
+                haveQuads ? plyMesh.uv : std::move(plyMesh.uv),
+                haveQuads ? plyMesh.faceIndices : std::move(plyMesh.faceIndices));
             shapes = Triangle::CreateTriangles(mesh, alloc);
         }
 
         if (!plyMesh.quadIndices.empty()) {
             BilinearPatchMesh *mesh = alloc.new_object<BilinearPatchMesh>(
-                *renderFromObject, reverseOrientation, plyMesh.quadIndices, plyMesh.p,
-                plyMesh.n, plyMesh.uv, plyMesh.faceIndices, nullptr /* image dist */);
+                *renderFromObject, reverseOrientation, std::move(plyMesh.quadIndices),
+                std::move(plyMesh.p), std::move(plyMesh.n), std::move(plyMesh.uv),
+                std::move(plyMesh.faceIndices), nullptr /* image dist */);
             pstd::vector<ShapeHandle> quadMesh =
                 BilinearPatch::CreatePatches(mesh, alloc);
             shapes.insert(shapes.end(), quadMesh.begin(), quadMesh.end());
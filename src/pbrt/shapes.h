@@ -882,8 +882,14 @@ class Triangle {
 
     static void Init(Allocator alloc);
 
+    PBRT_CPU_GPU
+    int MeshIndex() const { return meshIndex; }
+    PBRT_CPU_GPU
+    int TriangleIndex() const { return triIndex; }
+
     PBRT_CPU_GPU
     Bounds3f Bounds() const;
+    Bounds3f ClippedBounds(const Bounds3f &clip) const;
 
     PBRT_CPU_GPU
     pstd::optional<ShapeIntersection> Intersect(const Ray &ray,
@@ -910,6 +916,13 @@ class Triangle {
     PBRT_CPU_GPU
     DirectionCone NormalBounds() const;
 
+    PBRT_CPU_GPU
+    pstd::array<Point3f, 3> Vertices() const {
+        auto mesh = GetMesh();
+        const int *v = &mesh->vertexIndices[3 * triIndex];
+        return {mesh->p[v[0]], mesh->p[v[1]], mesh->p[v[2]]};
+    }
+
     std::string ToString() const;
 
     static TriangleMesh *CreateMesh(const Transform *renderFromObject,
@@ -140,12 +140,11 @@ void PrintStackTrace() {
 #endif
 }
 
-static std::vector<std::function<std::string(void)>> callbacks;
-
 void CheckCallbackScope::Fail() {
     PrintStackTrace();
 
     std::string message;
+    std::lock_guard<std::mutex> lock(mutex);
     for (auto iter = callbacks.rbegin(); iter != callbacks.rend(); ++iter)
         message += (*iter)();
     fprintf(stderr, "%s\n\n", message.c_str());
@@ -159,15 +158,17 @@ void CheckCallbackScope::Fail() {
 #endif
 }
 
-std::vector<std::function<std::string(void)>> CheckCallbackScope::callbacks;
+std::mutex CheckCallbackScope::mutex;
+std::list<std::function<std::string(void)>> CheckCallbackScope::callbacks;
 
 CheckCallbackScope::CheckCallbackScope(std::function<std::string(void)> callback) {
-    callbacks.push_back(std::move(callback));
+    std::lock_guard<std::mutex> lock(mutex);
+    iter = callbacks.insert(callbacks.end(), std::move(callback));
 }
 
 CheckCallbackScope::~CheckCallbackScope() {
-    CHECK_GT(callbacks.size(), 0);
-    callbacks.pop_back();
+    std::lock_guard<std::mutex> lock(mutex);
+    callbacks.erase(iter);
 }
 
 }  // namespace pbrt
@@ -11,6 +11,8 @@
 #include <pbrt/util/stats.h>
 
 #include <functional>
+#include <list>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -124,7 +126,10 @@ class CheckCallbackScope {
     static void Fail();
 
   private:
-    static std::vector<std::function<std::string(void)>> callbacks;
+    // Scopes may be opened and closed concurrently by multiple threads
+    static std::mutex mutex;
+    static std::list<std::function<std::string(void)>> callbacks;
+    std::list<std::function<std::string(void)>>::iterator iter;
 };
 
 #define CUDA_CHECK(EXPR)                                        \
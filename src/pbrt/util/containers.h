@@ -221,6 +221,8 @@ class Array2D {
     PBRT_CPU_GPU
     int ySize() const { return extent.pMax.y - extent.pMin.y; }
 
+    allocator_type get_allocator() const { return allocator; }
+
     PBRT_CPU_GPU
     iterator begin() { return values; }
     PBRT_CPU_GPU
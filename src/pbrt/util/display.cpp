@@ -10,8 +10,11 @@
 #include <pbrt/util/print.h>
 #include <pbrt/util/string.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <mutex>
 #include <thread>
 
@@ -32,6 +35,10 @@ using socket_t = int;
 #include <signal.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
 #define SOCKET_ERROR (-1)
 #define INVALID_SOCKET (-1)
 #endif
@@ -215,6 +222,137 @@ constexpr int tileSize = 128;
 
 }  // namespace
 
+// PreviewFile Definition
+class PreviewFile {
+  public:
+    PreviewFile(const std::string &filename);
+    ~PreviewFile() { Unmap(); }
+
+    PreviewFile(const PreviewFile &) = delete;
+    PreviewFile &operator=(const PreviewFile &) = delete;
+
+    float *BeginUpdate(const std::string &title, Point2i resolution,
+                       const std::vector<std::string> &channelNames);
+    void EndUpdate();
+
+  private:
+    bool Map(size_t length);
+    void Unmap();
+
+    std::string filename;
+    PreviewFileHeader *header = nullptr;
+    size_t mappedLength = 0;
+    uint64_t sequence = 0;
+};
+
+// PreviewFile Method Definitions
+PreviewFile::PreviewFile(const std::string &filename) : filename(filename) {
+    // Make sure that the file can be created before rendering starts
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f)
+        ErrorExit("%s: %s", filename, ErrorString());
+    fclose(f);
+}
+
+float *PreviewFile::BeginUpdate(const std::string &title, Point2i resolution,
+                                const std::vector<std::string> &channelNames) {
+    // Map the file, resizing it if the image's resolution has changed
+    int nChannels = channelNames.size();
+    size_t length = sizeof(PreviewFileHeader) +
+                    sizeof(float) * size_t(resolution.x) * resolution.y * nChannels;
+    if (length != mappedLength) {
+        Unmap();
+        if (!Map(length))
+            return nullptr;
+    }
+
+    // Mark the pixels as being updated and refresh the header
+    header->sequence = ++sequence;
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, PreviewFileMagic, sizeof(header->magic));
+    header->version = PreviewFileVersion;
+    header->width = resolution.x;
+    header->height = resolution.y;
+    header->nChannels = nChannels;
+    strncpy(header->title, title.c_str(), sizeof(header->title) - 1);
+    for (int c = 0; c < std::min<int>(nChannels, 8); ++c)
+        strncpy(header->channelNames[c], channelNames[c].c_str(),
+                sizeof(header->channelNames[c]) - 1);
+
+    return (float *)(header + 1);
+}
+
+void PreviewFile::EndUpdate() {
+    std::atomic_thread_fence(std::memory_order_release);
+    header->sequence = ++sequence;
+}
+
+bool PreviewFile::Map(size_t length) {
+    CHECK(header == nullptr);
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        LOG_ERROR("%s: %s", filename, ErrorString());
+        return false;
+    }
+    if (ftruncate(fd, length) != 0) {
+        LOG_ERROR("%s: %s", filename, ErrorString());
+        close(fd);
+        return false;
+    }
+    void *ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        LOG_ERROR("%s: %s", filename, ErrorString());
+        return false;
+    }
+#elif defined(PBRT_IS_WINDOWS)
+    HANDLE fileHandle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE,
+                                    FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_ALWAYS,
+                                    FILE_ATTRIBUTE_NORMAL, 0);
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        LOG_ERROR("%s: %s", filename, ErrorString());
+        return false;
+    }
+    HANDLE mapping = CreateFileMapping(fileHandle, 0, PAGE_READWRITE,
+                                       DWORD(uint64_t(length) >> 32),
+                                       DWORD(length & 0xffffffff), 0);
+    CloseHandle(fileHandle);
+    if (!mapping) {
+        LOG_ERROR("%s: %s", filename, ErrorString());
+        return false;
+    }
+    void *ptr = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, length);
+    CloseHandle(mapping);
+    if (!ptr) {
+        LOG_ERROR("%s: %s", filename, ErrorString());
+        return false;
+    }
+#else
+    void *ptr = nullptr;
+    LOG_ERROR("%s: memory-mapped preview files are not supported on this system.",
+              filename);
+    return false;
+#endif
+
+    header = (PreviewFileHeader *)ptr;
+    memset(header, 0, sizeof(PreviewFileHeader));
+    mappedLength = length;
+    return true;
+}
+
+void PreviewFile::Unmap() {
+    if (!header)
+        return;
+#ifdef PBRT_HAVE_MMAP
+    munmap(header, mappedLength);
+#elif defined(PBRT_IS_WINDOWS)
+    UnmapViewOfFile(header);
+#endif
+    header = nullptr;
+    mappedLength = 0;
+}
+
 class DisplayItem {
   public:
     DisplayItem(
@@ -223,6 +361,7 @@ class DisplayItem {
         std::function<void(Bounds2i b, pstd::span<pstd::span<Float>>)> getTileValues);
 
     bool Display(IPCChannel &channel);
+    void WritePreview(PreviewFile &file);
 
   private:
     bool SendOpenImage(IPCChannel &channel);
@@ -368,6 +507,37 @@ bool DisplayItem::Display(IPCChannel &ipcChannel) {
     return true;
 }
 
+void DisplayItem::WritePreview(PreviewFile &file) {
+    float *pixels = file.BeginUpdate(title, resolution, channelNames);
+    if (!pixels)
+        return;
+
+    // Get the image's values tile by tile and copy them to the mapped file
+    int nChannels = channelNames.size();
+    std::vector<Float> tileValues(nChannels * tileSize * tileSize);
+    std::vector<pstd::span<Float>> displayValues(nChannels);
+    for (int c = 0; c < nChannels; ++c)
+        displayValues[c] =
+            pstd::MakeSpan(&tileValues[c * tileSize * tileSize], tileSize * tileSize);
+
+    for (int y = 0; y < resolution.y; y += tileSize)
+        for (int x = 0; x < resolution.x; x += tileSize) {
+            Bounds2i b(Point2i(x, y), Point2i(std::min(x + tileSize, resolution.x),
+                                              std::min(y + tileSize, resolution.y)));
+            getTileValues(b, pstd::MakeSpan(displayValues));
+
+            int index = 0;
+            for (Point2i p : b) {
+                float *pixel = pixels + nChannels * (size_t(p.y) * resolution.x + p.x);
+                for (int c = 0; c < nChannels; ++c)
+                    pixel[c] = displayValues[c][index];
+                ++index;
+            }
+        }
+
+    file.EndUpdate();
+}
+
 bool DisplayItem::SendOpenImage(IPCChannel &ipcChannel) {
     // Initial "open the image" message
     uint8_t buffer[1024];
@@ -391,40 +561,81 @@ bool DisplayItem::SendOpenImage(IPCChannel &ipcChannel) {
 
 static std::atomic<bool> exitThread{false};
 static std::mutex mutex;
+static std::condition_variable exitCondition;
 static std::thread updateThread;
 static std::vector<DisplayItem> dynamicItems;
+static Float updateInterval = 0.25f;
 
 static IPCChannel *channel;
+static PreviewFile *previewFile;
 
-static void updateDynamicItems() {
-    while (!exitThread) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(250));
-
-        std::lock_guard<std::mutex> lock(mutex);
+static void displayDynamicItems() {
+    if (channel)
         for (auto &item : dynamicItems)
             item.Display(*channel);
+    if (previewFile && !dynamicItems.empty())
+        dynamicItems.front().WritePreview(*previewFile);
+}
+
+static void updateDynamicItems() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!exitThread) {
+        exitCondition.wait_for(lock, std::chrono::duration<Float>(updateInterval));
+        displayDynamicItems();
     }
 
     // One last time to get the last bits
-    std::lock_guard<std::mutex> lock(mutex);
-    for (auto &item : dynamicItems)
-        item.Display(*channel);
+    displayDynamicItems();
 
     dynamicItems.clear();
     delete channel;
     channel = nullptr;
+    delete previewFile;
+    previewFile = nullptr;
+}
+
+static void startUpdateThread() {
+    if (updateThread.get_id() == std::thread::id())
+        updateThread = std::thread(updateDynamicItems);
 }
 
 void ConnectToDisplayServer(const std::string &host) {
+    // Note: the channel is created without holding the mutex, since ErrorExit()
+    // disconnects from the display server.
     CHECK(channel == nullptr);
-    channel = new IPCChannel(host);
+    IPCChannel *newChannel = new IPCChannel(host);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        channel = newChannel;
+    }
 
-    updateThread = std::thread(updateDynamicItems);
+    startUpdateThread();
+}
+
+void OpenPreviewFile(const std::string &filename) {
+    CHECK(previewFile == nullptr);
+    PreviewFile *newFile = new PreviewFile(filename);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        previewFile = newFile;
+    }
+
+    startUpdateThread();
+}
+
+void SetDisplayUpdateInterval(Float seconds) {
+    CHECK_GT(seconds, 0);
+    std::lock_guard<std::mutex> lock(mutex);
+    updateInterval = seconds;
 }
 
 void DisconnectFromDisplayServer() {
     if (updateThread.get_id() != std::thread::id()) {
-        exitThread = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            exitThread = true;
+        }
+        exitCondition.notify_all();
         updateThread.join();
         updateThread = std::thread();
         exitThread = false;
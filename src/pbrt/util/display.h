@@ -23,6 +23,32 @@ namespace pbrt {
 void ConnectToDisplayServer(const std::string &host);
 void DisconnectFromDisplayServer();
 
+// Images registered via DisplayDynamic() are sent to the display server and
+// written to the preview file every _seconds_. (Default: 0.25.)
+void SetDisplayUpdateInterval(Float seconds);
+
+// PreviewFileHeader Definition
+// A preview file is a memory-mapped file that holds the current pixel values of the
+// first image passed to DisplayDynamic(), so that other processes can follow a
+// render's progress. It starts with this header, followed by _width_ x _height_
+// pixels of _nChannels_ interleaved 32-bit floats in scanline order; the names of
+// up to the first eight channels are stored in the header. _sequence_ is odd while
+// the pixels are being updated; readers should retry if it is odd or if it changed
+// while they were copying the pixels.
+struct PreviewFileHeader {
+    char magic[8];
+    int32_t version;
+    int32_t width, height, nChannels;
+    uint64_t sequence;
+    char title[256];
+    char channelNames[8][32];
+};
+
+static constexpr char PreviewFileMagic[8] = "pbrtprv";
+static constexpr int32_t PreviewFileVersion = 1;
+
+void OpenPreviewFile(const std::string &filename);
+
 void DisplayStatic(
     const std::string &title, const Point2i &resolution,
     std::vector<std::string> channelNames,
@@ -0,0 +1,84 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/display.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace pbrt;
+
+static bool ReadPreview(const std::string &filename, PreviewFileHeader *header,
+                        std::vector<float> *pixels) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f)
+        return false;
+    bool ok = fread(header, sizeof(*header), 1, f) == 1 && (header->sequence & 1) == 0;
+    if (ok) {
+        pixels->resize(size_t(header->width) * header->height * header->nChannels);
+        ok = fread(pixels->data(), sizeof(float), pixels->size(), f) == pixels->size();
+    }
+    fclose(f);
+    return ok;
+}
+
+TEST(Display, PreviewFile) {
+    std::string filename = "preview.pbrtprv";
+    SetDisplayUpdateInterval(0.01f);
+    OpenPreviewFile(filename);
+
+    Point2i res(150, 37);
+    std::atomic<int> pass{1};
+    DisplayDynamic("preview", res, {"R", "G"},
+                   [&](Bounds2i b, pstd::span<pstd::span<Float>> values) {
+                       int index = 0;
+                       for (Point2i p : b) {
+                           values[0][index] = pass * (p.x + res.x * p.y);
+                           values[1][index] = -pass;
+                           ++index;
+                       }
+                   });
+
+    // Check that updates appear while the image is still registered
+    auto expectPass = [&](int expected) {
+        PreviewFileHeader header;
+        std::vector<float> pixels;
+        for (int i = 0; i < 500; ++i) {
+            if (ReadPreview(filename, &header, &pixels) && pixels[1] == -expected)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_EQ(0, memcmp(header.magic, PreviewFileMagic, sizeof(header.magic)));
+        EXPECT_EQ(PreviewFileVersion, header.version);
+        EXPECT_EQ(res.x, header.width);
+        EXPECT_EQ(res.y, header.height);
+        EXPECT_EQ(2, header.nChannels);
+        EXPECT_STREQ("R", header.channelNames[0]);
+        EXPECT_STREQ("G", header.channelNames[1]);
+        ASSERT_EQ(2 * res.x * res.y, pixels.size());
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x) {
+                int offset = 2 * (x + res.x * y);
+                EXPECT_EQ(expected * (x + res.x * y), pixels[offset]);
+                EXPECT_EQ(-expected, pixels[offset + 1]);
+            }
+    };
+    expectPass(1);
+
+    // The final update happens when disconnecting
+    SetDisplayUpdateInterval(1000.f);
+    pass = 2;
+    DisconnectFromDisplayServer();
+    expectPass(2);
+
+    SetDisplayUpdateInterval(0.25f);
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
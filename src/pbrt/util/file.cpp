@@ -69,6 +69,16 @@ std::string ResolveFilename(const std::string &filename) {
         return (searchDirectory / filesystem::path(filename)).make_absolute().str();
 }
 
+std::string AbsolutePath(const std::string &filename) {
+    if (filename.empty() || IsAbsolutePath(filename))
+        return filename;
+    return filesystem::path(filename).make_absolute().str();
+}
+
+bool FileExists(const std::string &filename) {
+    return !filename.empty() && filesystem::path(filename).exists();
+}
+
 std::vector<std::string> MatchingFilenames(const std::string &filenameBase) {
     std::vector<std::string> filenames;
 
@@ -21,6 +21,8 @@ bool WriteFile(const std::string &filename, const std::string &contents);
 std::vector<float> ReadFloatFile(const std::string &filename);
 
 std::string ResolveFilename(const std::string &filename);
+std::string AbsolutePath(const std::string &filename);
+bool FileExists(const std::string &filename);
 void SetSearchDirectory(const std::string &filename);
 
 bool HasExtension(const std::string &filename, const std::string &ext);
@@ -27,9 +27,12 @@
 #include <ImfMatrixAttribute.h>
 #include <ImfOutputFile.h>
 #include <ImfStringVectorAttribute.h>
+#include <ImfThreading.h>
 #endif
 
+#include <atomic>
 #include <cmath>
+#include <mutex>
 #include <numeric>
 
 // use lodepng and get 16-bit.
@@ -495,10 +498,12 @@ Image Image::ConvertToFormat(PixelFormat newFormat, ColorEncodingHandle encoding
         return *this;
 
     Image newImage(newFormat, resolution, channelNames, encoding);
-    for (int y = 0; y < resolution.y; ++y)
-        for (int x = 0; x < resolution.x; ++x)
-            for (int c = 0; c < NChannels(); ++c)
-                newImage.SetChannel({x, y}, c, GetChannel({x, y}, c));
+    ParallelFor(0, resolution.y, [&](int64_t y0, int64_t y1) {
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < resolution.x; ++x)
+                for (int c = 0; c < NChannels(); ++c)
+                    newImage.SetChannel({x, y}, c, GetChannel({x, y}, c));
+    });
     return newImage;
 }
 
@@ -942,6 +947,26 @@ ImageAndMetadata Image::Read(const std::string &name, Allocator alloc,
     }
 }
 
+// AsyncImageWriter Method Definitions
+void AsyncImageWriter::Write(
+    Image image, ImageMetadata metadata, std::string filename,
+    std::function<void(const Image &, ImageMetadata *)> prepare) {
+    Wait();
+    thread = std::thread([image = std::move(image), metadata = std::move(metadata),
+                          filename = std::move(filename),
+                          prepare = std::move(prepare)]() mutable {
+        if (prepare)
+            prepare(image, &metadata);
+        LOG_VERBOSE("Writing image %s in the background", filename);
+        image.Write(filename, metadata);
+    });
+}
+
+void AsyncImageWriter::Wait() {
+    if (thread.joinable())
+        thread.join();
+}
+
 bool Image::Write(const std::string &name, const ImageMetadata &metadata) const {
     if (metadata.pixelBounds)
         CHECK_EQ(metadata.pixelBounds->Area(), resolution.x * resolution.y);
@@ -998,6 +1023,16 @@ bool Image::Write(const std::string &name, const ImageMetadata &metadata) const
 ///////////////////////////////////////////////////////////////////////////
 // OpenEXR
 
+// Have OpenEXR compress and decompress chunks of scanlines in parallel using as
+// many threads as pbrt's thread pool has.
+static void InitEXRThreads() {
+    static std::once_flag initialized;
+    std::call_once(initialized, []() {
+        Imf::setGlobalThreadCount(RunningThreads());
+        LOG_VERBOSE("Using %d threads for OpenEXR I/O", RunningThreads());
+    });
+}
+
 static Imf::FrameBuffer imageToFrameBuffer(const Image &image,
                                            const ImageChannelDesc &desc,
                                            const Imath::Box2i &dataWindow) {
@@ -1031,6 +1066,7 @@ static Imf::FrameBuffer imageToFrameBuffer(const Image &image,
 }
 
 static ImageAndMetadata ReadEXR(const std::string &name, Allocator alloc) {
+    InitEXRThreads();
     try {
         Imf::InputFile file(name.c_str());
         Imath::Box2i dw = file.header().dataWindow();
@@ -1155,6 +1191,7 @@ bool Image::WriteEXR(const std::string &name, const ImageMetadata &metadata) con
         return ConvertToFormat(PixelFormat::Half).WriteEXR(name, metadata);
     CHECK(Is16Bit(format) || Is32Bit(format));
 
+    InitEXRThreads();
     try {
         Imath::Box2i displayWindow, dataWindow;
         if (metadata.fullResolution)
@@ -1267,15 +1304,17 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
 
         if (state.info_png.color.bitdepth == 16) {
             image = Image(PixelFormat::Half, Point2i(width, height), {"Y"});
-            auto bufIter = buf.begin();
-            for (unsigned int y = 0; y < height; ++y)
-                for (unsigned int x = 0; x < width; ++x, bufIter += 2) {
-                    // Convert from little endian.
-                    Float v = (((int)bufIter[0] << 8) + (int)bufIter[1]) / 65535.f;
-                    v = encoding.ToFloatLinear(v);
-                    image.SetChannel(Point2i(x, y), 0, v);
-                }
-            CHECK(bufIter == buf.end());
+            CHECK_EQ(buf.size(), 2 * size_t(width) * height);
+            ParallelFor(0, height, [&](int64_t y0, int64_t y1) {
+                for (int y = y0; y < y1; ++y)
+                    for (unsigned int x = 0; x < width; ++x) {
+                        const unsigned char *bufPtr = &buf[2 * (size_t(y) * width + x)];
+                        // Convert from little endian.
+                        Float v = (((int)bufPtr[0] << 8) + (int)bufPtr[1]) / 65535.f;
+                        v = encoding.ToFloatLinear(v);
+                        image.SetChannel(Point2i(x, y), 0, v);
+                    }
+            });
         } else {
             image = Image(PixelFormat::U256, Point2i(width, height), {"Y"}, encoding);
             std::copy(buf.begin(), buf.end(), (uint8_t *)image.RawPointer({0, 0}));
@@ -1295,20 +1334,22 @@ static ImageAndMetadata ReadPNG(const std::string &name, Allocator alloc,
         metadata.colorSpace = RGBColorSpace::sRGB;
         if (state.info_png.color.bitdepth == 16) {
             image = Image(PixelFormat::Half, Point2i(width, height), {"R", "G", "B"});
-            auto bufIter = buf.begin();
-            for (unsigned int y = 0; y < height; ++y)
-                for (unsigned int x = 0; x < width; ++x, bufIter += 6) {
-                    CHECK(bufIter < buf.end());
-                    // Convert from little endian.
-                    Float rgb[3] = {(((int)bufIter[0] << 8) + (int)bufIter[1]) / 65535.f,
-                                    (((int)bufIter[2] << 8) + (int)bufIter[3]) / 65535.f,
-                                    (((int)bufIter[4] << 8) + (int)bufIter[5]) / 65535.f};
-                    for (int c = 0; c < 3; ++c) {
-                        rgb[c] = encoding.ToFloatLinear(rgb[c]);
-                        image.SetChannel(Point2i(x, y), c, rgb[c]);
+            CHECK_EQ(buf.size(), 6 * size_t(width) * height);
+            ParallelFor(0, height, [&](int64_t y0, int64_t y1) {
+                for (int y = y0; y < y1; ++y)
+                    for (unsigned int x = 0; x < width; ++x) {
+                        const unsigned char *bufPtr = &buf[6 * (size_t(y) * width + x)];
+                        // Convert from little endian.
+                        Float rgb[3] = {
+                            (((int)bufPtr[0] << 8) + (int)bufPtr[1]) / 65535.f,
+                            (((int)bufPtr[2] << 8) + (int)bufPtr[3]) / 65535.f,
+                            (((int)bufPtr[4] << 8) + (int)bufPtr[5]) / 65535.f};
+                        for (int c = 0; c < 3; ++c) {
+                            rgb[c] = encoding.ToFloatLinear(rgb[c]);
+                            image.SetChannel(Point2i(x, y), c, rgb[c]);
+                        }
                     }
-                }
-            CHECK(bufIter == buf.end());
+            });
         } else {
             image = Image(PixelFormat::U256, Point2i(width, height), {"R", "G", "B"},
                           encoding);
@@ -1352,7 +1393,7 @@ std::string Image::ToString() const {
 
 bool Image::WritePNG(const std::string &name, const ImageMetadata &metadata) const {
     unsigned int error = 0;
-    int nOutOfGamut = 0;
+    std::atomic<int> nOutOfGamut{0};
 
     if (format == PixelFormat::U256) {
         if (NChannels() == 1)
@@ -1370,29 +1411,37 @@ bool Image::WritePNG(const std::string &name, const ImageMetadata &metadata) con
         // assume..
         std::unique_ptr<uint8_t[]> rgb8 =
             std::make_unique<uint8_t[]>(3 * resolution.x * resolution.y);
-        for (int y = 0; y < resolution.y; ++y)
-            for (int x = 0; x < resolution.x; ++x)
-                for (int c = 0; c < 3; ++c) {
-                    Float dither = -.5f + BlueNoise(c, x, y);
-                    Float v = GetChannel({x, y}, c);
-                    if (v < 0 || v > 1)
-                        ++nOutOfGamut;
-                    rgb8[3 * (y * resolution.x + x) + c] = LinearToSRGB8(v, dither);
-                }
+        ParallelFor(0, resolution.y, [&](int64_t y0, int64_t y1) {
+            int nClamped = 0;
+            for (int y = y0; y < y1; ++y)
+                for (int x = 0; x < resolution.x; ++x)
+                    for (int c = 0; c < 3; ++c) {
+                        Float dither = -.5f + BlueNoise(c, x, y);
+                        Float v = GetChannel({x, y}, c);
+                        if (v < 0 || v > 1)
+                            ++nClamped;
+                        rgb8[3 * (y * resolution.x + x) + c] = LinearToSRGB8(v, dither);
+                    }
+            nOutOfGamut += nClamped;
+        });
 
         error =
             lodepng_encode24_file(name.c_str(), rgb8.get(), resolution.x, resolution.y);
     } else if (NChannels() == 1) {
         std::unique_ptr<uint8_t[]> y8 =
             std::make_unique<uint8_t[]>(resolution.x * resolution.y);
-        for (int y = 0; y < resolution.y; ++y)
-            for (int x = 0; x < resolution.x; ++x) {
-                Float dither = -.5f + BlueNoise(0, x, y);
-                Float v = GetChannel({x, y}, 0);
-                if (v < 0 || v > 1)
-                    ++nOutOfGamut;
-                y8[y * resolution.x + x] = LinearToSRGB8(v, dither);
-            }
+        ParallelFor(0, resolution.y, [&](int64_t y0, int64_t y1) {
+            int nClamped = 0;
+            for (int y = y0; y < y1; ++y)
+                for (int x = 0; x < resolution.x; ++x) {
+                    Float dither = -.5f + BlueNoise(0, x, y);
+                    Float v = GetChannel({x, y}, 0);
+                    if (v < 0 || v > 1)
+                        ++nClamped;
+                    y8[y * resolution.x + x] = LinearToSRGB8(v, dither);
+                }
+            nOutOfGamut += nClamped;
+        });
 
         error = lodepng_encode_file(name.c_str(), y8.get(), resolution.x, resolution.y,
                                     LCT_GREY, 8 /* bitdepth */);
@@ -1400,7 +1449,7 @@ bool Image::WritePNG(const std::string &name, const ImageMetadata &metadata) con
 
     if (nOutOfGamut > 0)
         Warning("%s: %d out of gamut pixel channels clamped to [0,1].", name,
-                nOutOfGamut);
+                nOutOfGamut.load());
 
     if (error != 0) {
         Error("Error writing PNG \"%s\": %s", name, lodepng_error_text(error));
@@ -19,6 +19,8 @@
 #include <cstring>
 #include <functional>
 #include <map>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace pbrt {
@@ -426,6 +428,28 @@ struct ImageAndMetadata {
     ImageMetadata metadata;
 };
 
+// AsyncImageWriter Definition
+// Writes images on a background thread so that rendering can continue while
+// they are encoded. At most one image is written at a time; Write() waits for
+// the previous image to be finished before starting on the next one.
+class AsyncImageWriter {
+  public:
+    AsyncImageWriter() = default;
+    ~AsyncImageWriter() { Wait(); }
+
+    AsyncImageWriter(const AsyncImageWriter &) = delete;
+    AsyncImageWriter &operator=(const AsyncImageWriter &) = delete;
+
+    // If provided, _prepare_ is called on the background thread just before
+    // the image is written, so that it may, e.g., add to the image's metadata.
+    void Write(Image image, ImageMetadata metadata, std::string filename,
+               std::function<void(const Image &, ImageMetadata *)> prepare = {});
+    void Wait();
+
+  private:
+    std::thread thread;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_IMAGE_H
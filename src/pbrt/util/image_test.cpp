@@ -15,6 +15,8 @@
 #include <pbrt/util/rng.h>
 #include <pbrt/util/sampling.h>
 
+#include <lodepng/lodepng.h>
+
 #include <algorithm>
 #include <array>
 #include <cmath>
@@ -323,6 +325,41 @@ TEST(Image, PfmIO) {
     EXPECT_EQ(0, remove("test.pfm"));
 }
 
+TEST(Image, AsyncWrite) {
+    Point2i res(16, 49);
+    pstd::vector<float> rgbPixels = GetFloatPixels(res, 3);
+    Image image(rgbPixels, res, {"R", "G", "B"});
+
+    // Write a few images, including two to the same file, which should be
+    // written in order
+    AsyncImageWriter writer;
+    int nPrepared = 0;
+    for (int i = 0; i < 3; ++i) {
+        Image copy = image;
+        copy.SetChannel({0, 0}, 0, i);
+        writer.Write(std::move(copy), {}, i == 1 ? "test1.pfm" : "test0.pfm",
+                     [&nPrepared](const Image &image, ImageMetadata *metadata) {
+                         ++nPrepared;
+                         metadata->pixelBounds = Bounds2i({0, 0}, image.Resolution());
+                     });
+    }
+    writer.Wait();
+    EXPECT_EQ(3, nPrepared);
+
+    for (int i = 1; i < 3; ++i) {
+        ImageAndMetadata read = Image::Read(i == 1 ? "test1.pfm" : "test0.pfm");
+        EXPECT_EQ(image.Resolution(), read.image.Resolution());
+        for (int y = 0; y < res[1]; ++y)
+            for (int x = 0; x < res[0]; ++x)
+                for (int c = 0; c < 3; ++c)
+                    EXPECT_EQ(x == 0 && y == 0 && c == 0 ? i : image.GetChannel({x, y}, c),
+                              read.image.GetChannel({x, y}, c));
+    }
+
+    EXPECT_EQ(0, remove("test0.pfm"));
+    EXPECT_EQ(0, remove("test1.pfm"));
+}
+
 TEST(Image, ExrIO) {
     Point2i res(16, 49);
     pstd::vector<float> rgbPixels = GetFloatPixels(res, 3);
@@ -489,6 +526,36 @@ TEST(Image, PngRgbIO) {
     EXPECT_EQ(0, remove("test.png"));
 }
 
+TEST(Image, Png16Read) {
+    Point2i res(37, 91);
+    for (int nc : {1, 3}) {
+        // Write a 16-bit PNG; its values are stored in big-endian order
+        std::vector<unsigned char> buf;
+        for (int i = 0; i < res.x * res.y * nc; ++i) {
+            uint16_t v = (i * 7919) % 65536;
+            buf.push_back(v >> 8);
+            buf.push_back(v & 0xff);
+        }
+        ASSERT_EQ(0, lodepng::encode("test16.png", buf, res.x, res.y,
+                                     nc == 1 ? LCT_GREY : LCT_RGB, 16));
+
+        ImageAndMetadata read = Image::Read("test16.png");
+        EXPECT_EQ(res, read.image.Resolution());
+        EXPECT_EQ(PixelFormat::Half, read.image.Format());
+        ASSERT_EQ(nc, read.image.NChannels());
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x)
+                for (int c = 0; c < nc; ++c) {
+                    int i = (y * res.x + x) * nc + c;
+                    Float v = SRGBToLinear(((i * 7919) % 65536) / 65535.f);
+                    EXPECT_NEAR(v, read.image.GetChannel({x, y}, c), 1e-3f * v + 1e-6f)
+                        << " x " << x << ", y " << y << ", c " << c;
+                }
+
+        EXPECT_EQ(0, remove("test16.png"));
+    }
+}
+
 TEST(Image, SampleSimple) {
     pstd::vector<float> texels = {Float(0), Float(1), Float(0), Float(0)};
     Image zeroOne(texels, {2, 2}, {"Y"});
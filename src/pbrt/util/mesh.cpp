@@ -7,12 +7,29 @@
 #include <pbrt/util/buffercache.h>
 #include <pbrt/util/check.h>
 #include <pbrt/util/error.h>
+#include <pbrt/util/file.h>
 #include <pbrt/util/log.h>
+#include <pbrt/util/parallel.h>
 #include <pbrt/util/print.h>
 #include <pbrt/util/stats.h>
+#include <pbrt/util/string.h>
 #include <pbrt/util/transform.h>
 
 #include <rply/rply.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
 
 namespace pbrt {
 
@@ -345,8 +362,445 @@ int rply_faceindex_callback(p_ply_argument argument) {
     return 1;
 }
 
+// Binary PLY Definitions
+enum class PLYType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+struct PLYProperty {
+    std::string name;
+    PLYType type;
+    // List properties store their length, of type _countType_, before the values
+    bool isList = false;
+    PLYType countType;
+};
+
+struct PLYElement {
+    std::string name;
+    size_t count;
+    std::vector<PLYProperty> properties;
+};
+
+struct PLYHeader {
+    bool bigEndian = false;
+    std::vector<PLYElement> elements;
+    size_t dataOffset;
+};
+
+static pstd::optional<PLYType> ParsePLYType(const std::string &name) {
+    if (name == "char" || name == "int8")
+        return PLYType::Int8;
+    if (name == "uchar" || name == "uint8")
+        return PLYType::UInt8;
+    if (name == "short" || name == "int16")
+        return PLYType::Int16;
+    if (name == "ushort" || name == "uint16")
+        return PLYType::UInt16;
+    if (name == "int" || name == "int32")
+        return PLYType::Int32;
+    if (name == "uint" || name == "uint32")
+        return PLYType::UInt32;
+    if (name == "float" || name == "float32")
+        return PLYType::Float32;
+    if (name == "double" || name == "float64")
+        return PLYType::Float64;
+    return {};
+}
+
+static size_t PLYTypeSize(PLYType type) {
+    switch (type) {
+    case PLYType::Int8:
+    case PLYType::UInt8:
+        return 1;
+    case PLYType::Int16:
+    case PLYType::UInt16:
+        return 2;
+    case PLYType::Float64:
+        return 8;
+    default:
+        return 4;
+    }
+}
+
+template <typename T>
+static T ReadPLYValue(const char *ptr, PLYType type, bool swapBytes) {
+    char bytes[8];
+    size_t size = PLYTypeSize(type);
+    std::memcpy(bytes, ptr, size);
+    if (swapBytes)
+        std::reverse(bytes, bytes + size);
+    auto value = [&bytes](auto v) {
+        std::memcpy(&v, bytes, sizeof(v));
+        return T(v);
+    };
+    switch (type) {
+    case PLYType::Int8:
+        return value(int8_t());
+    case PLYType::UInt8:
+        return value(uint8_t());
+    case PLYType::Int16:
+        return value(int16_t());
+    case PLYType::UInt16:
+        return value(uint16_t());
+    case PLYType::Int32:
+        return value(int32_t());
+    case PLYType::UInt32:
+        return value(uint32_t());
+    case PLYType::Float32:
+        return value(float());
+    default:
+        return value(double());
+    }
+}
+
+// Returns the offset just past the PLY header, if the header is complete
+static size_t FindPLYHeaderEnd(std::string_view data) {
+    size_t pos = data.find("end_header");
+    if (pos == std::string_view::npos)
+        return pos;
+    pos = data.find('\n', pos);
+    return pos == std::string_view::npos ? pos : pos + 1;
+}
+
+// Parses a PLY header and returns true if the file is binary and its
+// layout is one that _ParseBinaryPLY()_ handles; otherwise RPly is used.
+static bool ReadBinaryPLYHeader(std::string_view data, PLYHeader *header) {
+    header->dataOffset = FindPLYHeaderEnd(data);
+    if (data.substr(0, 3) != "ply" || header->dataOffset == std::string_view::npos)
+        return false;
+
+    bool binary = false;
+    std::string_view headerText = data.substr(0, header->dataOffset);
+    for (const std::string &line : SplitString(headerText, '\n')) {
+        std::vector<std::string> tokens = SplitStringsFromWhitespace(line);
+        if (tokens.empty())
+            continue;
+        if (tokens[0] == "format" && tokens.size() >= 2) {
+            binary = tokens[1] == "binary_little_endian" ||
+                     tokens[1] == "binary_big_endian";
+            header->bigEndian = tokens[1] == "binary_big_endian";
+        } else if (tokens[0] == "element" && tokens.size() == 3) {
+            size_t count = std::strtoull(tokens[2].c_str(), nullptr, 10);
+            header->elements.push_back(PLYElement{tokens[1], count, {}});
+        }
+        else if (tokens[0] == "property" && !header->elements.empty()) {
+            PLYProperty prop;
+            if (tokens.size() == 3) {
+                pstd::optional<PLYType> type = ParsePLYType(tokens[1]);
+                if (!type)
+                    return false;
+                prop.type = *type;
+            } else if (tokens.size() == 5 && tokens[1] == "list") {
+                pstd::optional<PLYType> countType = ParsePLYType(tokens[2]);
+                pstd::optional<PLYType> type = ParsePLYType(tokens[3]);
+                if (!countType || !type)
+                    return false;
+                prop.isList = true;
+                prop.countType = *countType;
+                prop.type = *type;
+            } else
+                return false;
+            prop.name = tokens.back();
+            header->elements.back().properties.push_back(prop);
+        }
+    }
+    if (!binary)
+        return false;
+
+    // Only the faces' vertex indices may be variable-sized
+    bool haveVertices = false, haveFaces = false;
+    for (const PLYElement &element : header->elements) {
+        int nLists = 0;
+        for (const PLYProperty &prop : element.properties)
+            if (prop.isList) {
+                if (element.name != "face" || prop.name != "vertex_indices")
+                    return false;
+                ++nLists;
+            }
+        if (element.name == "face") {
+            if (nLists != 1)
+                return false;
+            haveFaces = element.count > 0;
+        } else if (element.name == "vertex")
+            haveVertices = element.count > 0;
+    }
+    return haveVertices && haveFaces;
+}
+
+// Reads a binary PLY file's vertices and faces directly into _mesh_, in
+// parallel except for the faces of meshes with both triangles and quads
+static void ParseBinaryPLY(const std::string &filename, const char *data, size_t size,
+                           const PLYHeader &header, TriQuadMesh *mesh) {
+    uint16_t one = 1;
+    bool hostBigEndian = *(const char *)&one == 0;
+    bool swapBytes = header.bigEndian != hostBigEndian;
+    auto checkSize = [&](size_t end) {
+        if (end > size)
+            ErrorExit("%s: premature end of PLY file", filename);
+    };
+
+    size_t offset = header.dataOffset;
+    for (const PLYElement &element : header.elements) {
+        // Find the offsets of _element_'s scalar properties, ignoring any list
+        struct Field {
+            size_t offset;
+            PLYType type;
+        };
+        size_t scalarBytes = 0;
+        for (const PLYProperty &prop : element.properties)
+            if (!prop.isList)
+                scalarBytes += PLYTypeSize(prop.type);
+        auto findField = [&](const char *name) -> pstd::optional<Field> {
+            size_t fieldOffset = 0;
+            for (const PLYProperty &prop : element.properties) {
+                if (prop.isList)
+                    continue;
+                if (prop.name == name)
+                    return Field{fieldOffset, prop.type};
+                fieldOffset += PLYTypeSize(prop.type);
+            }
+            return {};
+        };
+
+        if (element.name == "vertex") {
+            pstd::optional<Field> x = findField("x"), y = findField("y"),
+                                  z = findField("z");
+            if (!x || !y || !z)
+                ErrorExit("%s: Vertex coordinate property not found!", filename);
+            pstd::optional<Field> nx = findField("nx"), ny = findField("ny"),
+                                  nz = findField("nz");
+            // Use the first of the UV coordinate naming conventions present
+            pstd::optional<Field> u, v;
+            for (auto names : {std::make_pair("u", "v"), std::make_pair("s", "t"),
+                               std::make_pair("texture_u", "texture_v"),
+                               std::make_pair("texture_s", "texture_t")}) {
+                u = findField(names.first);
+                v = findField(names.second);
+                if (u && v)
+                    break;
+            }
+
+            checkSize(offset + element.count * scalarBytes);
+            mesh->p.resize(element.count);
+            if (nx && ny && nz)
+                mesh->n.resize(element.count);
+            if (u && v)
+                mesh->uv.resize(element.count);
+            const char *vertices = data + offset;
+            ParallelFor(0, element.count, [&](int64_t start, int64_t end) {
+                for (int64_t i = start; i < end; ++i) {
+                    const char *vp = vertices + i * scalarBytes;
+                    auto read = [&](const Field &f) {
+                        return ReadPLYValue<Float>(vp + f.offset, f.type, swapBytes);
+                    };
+                    mesh->p[i] = Point3f(read(*x), read(*y), read(*z));
+                    if (!mesh->n.empty())
+                        mesh->n[i] = Normal3f(read(*nx), read(*ny), read(*nz));
+                    if (!mesh->uv.empty())
+                        mesh->uv[i] = Point2f(read(*u), read(*v));
+                }
+            });
+            offset += element.count * scalarBytes;
+        } else if (element.name == "face") {
+            // Find the layout of a face with _n_ vertex indices
+            auto list = std::find_if(element.properties.begin(), element.properties.end(),
+                                     [](const PLYProperty &prop) { return prop.isList; });
+            size_t countOffset = 0;
+            for (auto iter = element.properties.begin(); iter != list; ++iter)
+                countOffset += PLYTypeSize(iter->type);
+            size_t countSize = PLYTypeSize(list->countType);
+            size_t indexSize = PLYTypeSize(list->type);
+            auto faceSize = [&](int n) {
+                return scalarBytes + countSize + n * indexSize;
+            };
+            pstd::optional<Field> faceIndex = findField("face_indices");
+            auto faceIndexOffset = [&](int n) {
+                return faceIndex->offset < countOffset
+                           ? faceIndex->offset
+                           : faceIndex->offset + countSize + n * indexSize;
+            };
+            auto readFace = [&](const char *fp, int n, int *indices) {
+                const char *ip = fp + countOffset + countSize;
+                int face[4];
+                for (int j = 0; j < n; ++j)
+                    face[j] =
+                        ReadPLYValue<int>(ip + j * indexSize, list->type, swapBytes);
+                if (n == 3)
+                    std::copy(face, face + 3, indices);
+                else {
+                    // Note: modify order since we're specifying it as a blp...
+                    indices[0] = face[0];
+                    indices[1] = face[1];
+                    indices[2] = face[3];
+                    indices[3] = face[2];
+                }
+            };
+
+            // Check whether all faces have the same number of vertices as the first
+            checkSize(offset + countOffset + countSize);
+            int n0 = ReadPLYValue<int>(data + offset + countOffset, list->countType,
+                                       swapBytes);
+            size_t recordSize = faceSize(n0);
+            std::atomic<bool> uniform((n0 == 3 || n0 == 4) &&
+                                      offset + element.count * recordSize <= size);
+            const char *faces = data + offset;
+            if (uniform)
+                ParallelFor(0, element.count, [&](int64_t start, int64_t end) {
+                    for (int64_t i = start; i < end && uniform; ++i)
+                        if (ReadPLYValue<int>(faces + i * recordSize + countOffset,
+                                              list->countType, swapBytes) != n0)
+                            uniform = false;
+                });
+
+            if (uniform) {
+                // Read the faces in parallel
+                std::vector<int> &indices =
+                    (n0 == 3) ? mesh->triIndices : mesh->quadIndices;
+                indices.resize(n0 * element.count);
+                if (faceIndex)
+                    mesh->faceIndices.resize(element.count);
+                ParallelFor(0, element.count, [&](int64_t start, int64_t end) {
+                    for (int64_t i = start; i < end; ++i) {
+                        const char *fp = faces + i * recordSize;
+                        readFace(fp, n0, &indices[n0 * i]);
+                        if (faceIndex)
+                            mesh->faceIndices[i] = ReadPLYValue<int>(
+                                fp + faceIndexOffset(n0), faceIndex->type, swapBytes);
+                    }
+                });
+                offset += element.count * recordSize;
+            } else {
+                // Find the faces one after another
+                int nIgnored = 0;
+                mesh->triIndices.reserve(3 * element.count);
+                for (size_t i = 0; i < element.count; ++i) {
+                    checkSize(offset + countOffset + countSize);
+                    const char *fp = data + offset;
+                    int n =
+                        ReadPLYValue<int>(fp + countOffset, list->countType, swapBytes);
+                    if (n < 0)
+                        ErrorExit("%s: invalid face with %d vertices", filename, n);
+                    checkSize(offset + faceSize(n));
+                    if (n == 3 || n == 4) {
+                        std::vector<int> &indices =
+                            (n == 3) ? mesh->triIndices : mesh->quadIndices;
+                        indices.resize(indices.size() + n);
+                        readFace(fp, n, &indices[indices.size() - n]);
+                    } else
+                        ++nIgnored;
+                    if (faceIndex)
+                        mesh->faceIndices.push_back(ReadPLYValue<int>(
+                            fp + faceIndexOffset(n), faceIndex->type, swapBytes));
+                    offset += faceSize(n);
+                }
+                if (nIgnored > 0)
+                    Warning("plymesh: Ignoring %d faces that aren't triangles or quads "
+                            "(only triangles and quads are supported!)",
+                            nIgnored);
+            }
+        } else {
+            // Skip other elements, which have only scalar properties
+            offset += element.count * scalarBytes;
+            checkSize(offset);
+        }
+    }
+}
+
+static void CheckPLYVertexIndices(const TriQuadMesh &mesh) {
+    for (const std::vector<int> *indices : {&mesh.triIndices, &mesh.quadIndices}) {
+        // Find an out-of-bounds index, if there is one
+        std::atomic<int> badIndex(0);
+        std::atomic<bool> foundBad(false);
+        ParallelFor(0, indices->size(), [&](int64_t start, int64_t end) {
+            for (int64_t i = start; i < end; ++i) {
+                int idx = (*indices)[i];
+                if (idx < 0 || idx >= mesh.p.size()) {
+                    badIndex = idx;
+                    foundBad = true;
+                    return;
+                }
+            }
+        });
+        if (foundBad)
+            ErrorExit("plymesh: Vertex index %i is out of bounds! "
+                      "Valid range is [0..%i)",
+                      int(badIndex), int(mesh.p.size()));
+    }
+}
+
+// Reads _filename_ without RPly if it's a binary PLY file, either memory
+// mapping it or decompressing it in memory if it's gzipped.
+static bool ReadBinaryPLY(const std::string &filename, TriQuadMesh *mesh) {
+    PLYHeader header;
+    if (HasExtension(filename, "gz")) {
+        gzFile gz = gzopen(filename.c_str(), "rb");
+        if (!gz)
+            return false;
+        gzbuffer(gz, 1 << 20);
+        // Decompress until the header has been read and then, for binary
+        // files, the rest of the file
+        std::string contents;
+        bool haveHeader = false;
+        while (true) {
+            size_t size = contents.size(), chunkSize = 1 << 20;
+            contents.resize(size + chunkSize);
+            int nRead = gzread(gz, &contents[size], chunkSize);
+            if (nRead < 0) {
+                int err;
+                ErrorExit("%s: %s", filename, gzerror(gz, &err));
+            }
+            contents.resize(size + nRead);
+            if (!haveHeader && FindPLYHeaderEnd(contents) != std::string::npos) {
+                if (!ReadBinaryPLYHeader(contents, &header)) {
+                    gzclose(gz);
+                    return false;
+                }
+                haveHeader = true;
+            }
+            if (nRead == 0)
+                break;
+        }
+        gzclose(gz);
+        if (!haveHeader)
+            return false;
+        ParseBinaryPLY(filename, contents.data(), contents.size(), header, mesh);
+        return true;
+    }
+
+#ifdef PBRT_HAVE_MMAP
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat stat;
+    if (fstat(fd, &stat) != 0 || stat.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    size_t size = stat.st_size;
+    void *ptr = mmap(nullptr, size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return false;
+    const char *data = (const char *)ptr;
+    auto release = [=]() { munmap(ptr, size); };
+#else
+    std::string contents = ReadFileContents(filename);
+    const char *data = contents.data();
+    size_t size = contents.size();
+    auto release = []() {};
+#endif
+
+    bool binary = ReadBinaryPLYHeader(std::string_view(data, size), &header);
+    if (binary)
+        ParseBinaryPLY(filename, data, size, header, mesh);
+    release();
+    return binary;
+}
+
 TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
     TriQuadMesh mesh;
+    if (ReadBinaryPLY(filename, &mesh)) {
+        CheckPLYVertexIndices(mesh);
+        return mesh;
+    }
 
     p_ply ply = ply_open(filename.c_str(), rply_message_callback, 0, nullptr);
     if (ply == nullptr)
@@ -434,20 +888,11 @@ TriQuadMesh TriQuadMesh::ReadPLY(const std::string &filename) {
 
     ply_close(ply);
 
-    for (int idx : mesh.triIndices)
-        if (idx < 0 || idx >= mesh.p.size())
-            ErrorExit("plymesh: Vertex index %i is out of bounds! "
-                      "Valid range is [0..%i)",
-                      idx, int(mesh.p.size()));
-    for (int idx : mesh.quadIndices)
-        if (idx < 0 || idx >= mesh.p.size())
-            ErrorExit("plymesh: Vertex index %i is out of bounds! "
-                      "Valid range is [0..%i)",
-                      idx, int(mesh.p.size()));
-
+    CheckPLYVertexIndices(mesh);
     return mesh;
 }
 
+
 void TriQuadMesh::ConvertToOnlyTriangles() {
     if (quadIndices.empty())
         return;
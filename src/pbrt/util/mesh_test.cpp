@@ -0,0 +1,121 @@
+// pbrt is Copyright(c) 1998-2020 Matt Pharr, Wenzel Jakob, and Greg Humphreys.
+// The pbrt source code is licensed under the Apache License, Version 2.0.
+// SPDX: Apache-2.0
+
+#include <gtest/gtest.h>
+
+#include <pbrt/pbrt.h>
+#include <pbrt/util/file.h>
+#include <pbrt/util/mesh.h>
+
+#include <rply/rply.h>
+#include <zlib.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace pbrt;
+
+// Writes a PLY file with a mix of property types, an extra element between
+// the vertices and faces, and face indices after the vertex index lists.
+static TriQuadMesh WriteTestPLY(const std::string &filename, e_ply_storage_mode mode,
+                                const std::vector<std::vector<int>> &faces,
+                                int nVertices) {
+    p_ply ply = ply_create(filename.c_str(), mode, nullptr, 0, nullptr);
+    EXPECT_TRUE(ply != nullptr);
+    ply_add_element(ply, "vertex", nVertices);
+    ply_add_scalar_property(ply, "x", PLY_FLOAT);
+    ply_add_scalar_property(ply, "y", PLY_DOUBLE);
+    ply_add_scalar_property(ply, "z", PLY_FLOAT);
+    ply_add_scalar_property(ply, "nx", PLY_FLOAT);
+    ply_add_scalar_property(ply, "ny", PLY_FLOAT);
+    ply_add_scalar_property(ply, "nz", PLY_FLOAT);
+    ply_add_scalar_property(ply, "s", PLY_FLOAT);
+    ply_add_scalar_property(ply, "t", PLY_FLOAT);
+    ply_add_element(ply, "extra", 2);
+    ply_add_scalar_property(ply, "value", PLY_SHORT);
+    ply_add_element(ply, "face", faces.size());
+    ply_add_list_property(ply, "vertex_indices", PLY_UCHAR, PLY_UINT);
+    ply_add_scalar_property(ply, "face_indices", PLY_INT);
+    ply_write_header(ply);
+
+    // Use values that are exactly representable in ASCII files, too
+    TriQuadMesh mesh;
+    for (int i = 0; i < nVertices; ++i) {
+        mesh.p.push_back(Point3f(i * 0.25f, -i * 0.5f, i + 0.75f));
+        mesh.n.push_back(Normal3f(i % 3, 1, -0.5f));
+        mesh.uv.push_back(Point2f(i * 0.125f, 1 - i * 0.0625f));
+        for (Float v : {mesh.p[i].x, mesh.p[i].y, mesh.p[i].z, mesh.n[i].x, mesh.n[i].y,
+                        mesh.n[i].z, mesh.uv[i].x, mesh.uv[i].y})
+            ply_write(ply, v);
+    }
+    ply_write(ply, 1);
+    ply_write(ply, -1);
+    for (size_t i = 0; i < faces.size(); ++i) {
+        ply_write(ply, faces[i].size());
+        for (int v : faces[i])
+            ply_write(ply, v);
+        ply_write(ply, 100 + i);
+
+        if (faces[i].size() == 3)
+            mesh.triIndices.insert(mesh.triIndices.end(), faces[i].begin(),
+                                   faces[i].end());
+        else if (faces[i].size() == 4)
+            for (int j : {0, 1, 3, 2})
+                mesh.quadIndices.push_back(faces[i][j]);
+        mesh.faceIndices.push_back(100 + i);
+    }
+    ply_close(ply);
+    return mesh;
+}
+
+static void ExpectMeshesEqual(const TriQuadMesh &expected, const TriQuadMesh &mesh) {
+    EXPECT_EQ(expected.p, mesh.p);
+    EXPECT_EQ(expected.n, mesh.n);
+    EXPECT_EQ(expected.uv, mesh.uv);
+    EXPECT_EQ(expected.triIndices, mesh.triIndices);
+    EXPECT_EQ(expected.quadIndices, mesh.quadIndices);
+    EXPECT_EQ(expected.faceIndices, mesh.faceIndices);
+}
+
+TEST(TriQuadMesh, ReadPLY) {
+    int nVertices = 200;
+    std::vector<std::vector<int>> triangles, quads, mixed;
+    for (int i = 0; i < 1000; ++i) {
+        int v[5] = {i % nVertices, (7 * i + 1) % nVertices, (3 * i + 2) % nVertices,
+                    (11 * i + 3) % nVertices, (5 * i + 4) % nVertices};
+        triangles.push_back({v[0], v[1], v[2]});
+        quads.push_back({v[0], v[1], v[2], v[3]});
+        // Faces with other than three or four vertices are skipped
+        mixed.push_back(std::vector<int>(v, v + ((i % 100 == 0) ? 5 : 3 + i % 2)));
+    }
+
+    std::string filename = "test.ply";
+    for (e_ply_storage_mode mode : {PLY_LITTLE_ENDIAN, PLY_BIG_ENDIAN, PLY_ASCII})
+        for (const auto &faces : {triangles, quads, mixed}) {
+            TriQuadMesh expected = WriteTestPLY(filename, mode, faces, nVertices);
+            ExpectMeshesEqual(expected, TriQuadMesh::ReadPLY(filename));
+        }
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+TEST(TriQuadMesh, ReadPLYGzip) {
+    std::vector<std::vector<int>> faces;
+    for (int i = 0; i < 100000; ++i)
+        faces.push_back({i % 300, (i + 1) % 300, (i + 2) % 300});
+    std::string filename = "test.ply";
+    TriQuadMesh expected = WriteTestPLY(filename, PLY_LITTLE_ENDIAN, faces, 300);
+
+    // Compress the file, which is large enough to take multiple reads
+    std::string contents = ReadFileContents(filename);
+    std::string gzFilename = "test.ply.gz";
+    gzFile gz = gzopen(gzFilename.c_str(), "wb");
+    ASSERT_TRUE(gz != nullptr);
+    EXPECT_EQ(contents.size(), gzwrite(gz, contents.data(), contents.size()));
+    gzclose(gz);
+
+    ExpectMeshesEqual(expected, TriQuadMesh::ReadPLY(gzFilename));
+    EXPECT_EQ(0, remove(filename.c_str()));
+    EXPECT_EQ(0, remove(gzFilename.c_str()));
+}
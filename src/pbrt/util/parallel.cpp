@@ -4,13 +4,24 @@
 
 #include <pbrt/util/parallel.h>
 
+#include <pbrt/util/bits.h>
 #include <pbrt/util/check.h>
+#include <pbrt/util/error.h>
+#include <pbrt/util/math.h>
 #include <pbrt/util/print.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <iterator>
-#include <list>
+#include <memory>
 #include <thread>
 #include <vector>
+#ifdef PBRT_IS_LINUX
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // PBRT_IS_LINUX
 
 namespace pbrt {
 
@@ -37,32 +48,154 @@ bool Barrier::Block() {
     return --numToExit == 0;
 }
 
+class ParallelJob;
+
+// ParallelTask Definition
+// A _ParallelTask_ represents the half-open range of chunks _[begin, end)_ of
+// a _ParallelJob_ that has not yet been claimed by any thread.
+struct ParallelTask {
+    ParallelJob *job;
+    int64_t begin, end;
+};
+
 // ParallelJob Definition
 class ParallelJob {
   public:
-    virtual ~ParallelJob() { DCHECK(removed); }
+    explicit ParallelJob(int64_t nChunks) : tasks(nChunks), remaining(nChunks) {}
+    virtual ~ParallelJob() { DCHECK(Finished()); }
 
-    // *lock should be locked going in and and unlocked coming out.
-    virtual void RunStep(std::unique_lock<std::mutex> *lock) = 0;
-    virtual bool HaveWork() const = 0;
+    virtual void RunChunk(int64_t chunk) = 0;
 
-    bool Finished() const { return !HaveWork() && activeWorkers == 0; }
+    bool Finished() const { return remaining.load(std::memory_order_acquire) == 0; }
 
     virtual std::string ToString() const = 0;
 
   protected:
     std::string BaseToString() const {
-        return StringPrintf("activeWorkers: %d removed: %s", activeWorkers, removed);
+        return StringPrintf("remaining: %d tasksUsed: %d", remaining.load(),
+                            nextTask.load());
     }
 
   private:
     friend class ThreadPool;
 
-    ParallelJob *prev = nullptr, *next = nullptr;
-    int activeWorkers = 0;
-    bool removed = false;
+    ParallelTask *AllocateTask(int64_t begin, int64_t end) {
+        // Each task's first chunk is distinct, so _nChunks_ tasks suffice
+        int64_t index = nextTask.fetch_add(1, std::memory_order_relaxed);
+        CHECK_LT(index, tasks.size());
+        tasks[index] = ParallelTask{this, begin, end};
+        return &tasks[index];
+    }
+
+    std::vector<ParallelTask> tasks;
+    std::atomic<int64_t> nextTask{0};
+    std::atomic<int64_t> remaining;
+};
+
+// TaskDeque Definition
+// Chase-Lev work-stealing deque: the owning thread pushes and pops at the
+// bottom without locking, while other threads steal from the top.
+class TaskDeque {
+  public:
+    TaskDeque() : buffer(new Buffer(256)) {}
+    ~TaskDeque() {
+        delete buffer.load();
+        for (Buffer *b : retired)
+            delete b;
+    }
+
+    void Push(ParallelTask *task);
+    ParallelTask *Pop();
+    ParallelTask *Steal();
+
+    int64_t Size() const {
+        return std::max<int64_t>(0, bottom.load(std::memory_order_acquire) -
+                                        top.load(std::memory_order_acquire));
+    }
+
+  private:
+    // TaskDeque::Buffer Definition
+    struct Buffer {
+        explicit Buffer(int64_t capacity)
+            : capacity(capacity), slots(new std::atomic<ParallelTask *>[capacity]) {}
+
+        ParallelTask *Get(int64_t i) const {
+            return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+        void Put(int64_t i, ParallelTask *task) {
+            slots[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+        }
+
+        int64_t capacity;
+        std::unique_ptr<std::atomic<ParallelTask *>[]> slots;
+    };
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<Buffer *> buffer;
+    // Buffers replaced by growth may still be read by thieves, so they are
+    // only freed when the deque is destroyed.
+    std::vector<Buffer *> retired;
 };
 
+// TaskDeque Method Definitions
+void TaskDeque::Push(ParallelTask *task) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Buffer *buf = buffer.load(std::memory_order_relaxed);
+    if (b - t > buf->capacity - 1) {
+        // Grow the buffer, copying the live range of tasks
+        Buffer *newBuf = new Buffer(2 * buf->capacity);
+        for (int64_t i = t; i < b; ++i)
+            newBuf->Put(i, buf->Get(i));
+        retired.push_back(buf);
+        buffer.store(newBuf, std::memory_order_release);
+        buf = newBuf;
+    }
+    buf->Put(b, task);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+ParallelTask *TaskDeque::Pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Buffer *buf = buffer.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+        // Deque was already empty
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    ParallelTask *task = buf->Get(b);
+    if (t == b) {
+        // Race against thieves for the last task
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed))
+            task = nullptr;
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+ParallelTask *TaskDeque::Steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+        return nullptr;
+
+    Buffer *buf = buffer.load(std::memory_order_acquire);
+    ParallelTask *task = buf->Get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+        // Lost the race with the owner or another thief
+        return nullptr;
+    return task;
+}
+
 // ThreadPool Definition
 class ThreadPool {
   public:
@@ -71,10 +204,7 @@ class ThreadPool {
 
     size_t size() const { return threads.size(); }
 
-    std::unique_lock<std::mutex> AddToJobList(ParallelJob *job);
-    void RemoveFromJobList(ParallelJob *job);
-
-    void WorkOrWait(std::unique_lock<std::mutex> *lock);
+    void Run(ParallelJob *job);
 
     void ForEachThread(std::function<void(void)> func);
 
@@ -83,25 +213,187 @@ class ThreadPool {
   private:
     void workerFunc(int tIndex);
 
-    ParallelJob *jobList = nullptr;
-    // Protects jobList
-    mutable std::mutex jobListMutex;
-    // Signaled both when a new job is added to the list and when a job has
-    // finished.
-    std::condition_variable jobListCondition;
+    template <typename F>
+    void WorkUntil(F done);
+    void Execute(ParallelTask *task);
+
+    void Push(ParallelTask *task);
+    ParallelTask *FindTask();
+    bool HaveWork() const;
+    void Signal();
+
+    // Per-thread deques; the last one is shared by threads that are not
+    // part of the pool and its owner operations are protected by
+    // _sharedDequeMutex_. Those threads don't steal from the pool's deques.
+    std::vector<std::unique_ptr<TaskDeque>> deques;
+    std::mutex sharedDequeMutex;
+
+    // Idle threads sleep on _sleepCondition_ until _workEpoch_ changes;
+    // it is incremented whenever tasks are pushed or a job finishes.
+    std::atomic<uint64_t> workEpoch{0};
+    std::atomic<int> nSleeping{0};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
 
     std::vector<std::thread> threads;
-    bool shutdownThreads = false;
+    std::atomic<bool> shutdownThreads{false};
 };
 
 thread_local int ThreadIndex;
 
+// Index into _ThreadPool::deques_ of the calling thread's deque, or -1 if it
+// is not one of the pool's threads.
+static thread_local int dequeIndex = -1;
+
 static std::unique_ptr<ThreadPool> threadPool;
 static bool maxThreadIndexCalled = false;
 
+// NUMA Topology Definitions
+// When threads are pinned, _threadCPUs_ and _threadNumaNodes_ give the CPUs
+// each thread may run on and its NUMA node, indexed by _ThreadIndex_. NUMA
+// nodes are numbered densely; _numaNodeIds_ maps them to the system's ids.
+static std::vector<std::vector<int>> threadCPUs;
+static std::vector<int> threadNumaNodes;
+static std::vector<int> numaNodeIds;
+static thread_local int threadNumaNode = 0;
+
+#ifdef PBRT_IS_LINUX
+static cpu_set_t initialAffinity;
+
+// Parses CPU and node lists in the kernel's format, e.g. "0-7,16-23".
+static std::vector<int> ParseCPUList(const std::string &filename) {
+    std::vector<int> values;
+    FILE *f = fopen(filename.c_str(), "r");
+    if (!f)
+        return values;
+    int start, end;
+    while (fscanf(f, "%d", &start) == 1) {
+        end = start;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &end) != 1)
+                break;
+            c = fgetc(f);
+        }
+        for (int i = start; i <= end; ++i)
+            values.push_back(i);
+        if (c != ',')
+            break;
+    }
+    fclose(f);
+    return values;
+}
+#endif  // PBRT_IS_LINUX
+
+static bool ComputeThreadPlacement(int nThreads) {
+#ifdef PBRT_IS_LINUX
+    if (sched_getaffinity(0, sizeof(initialAffinity), &initialAffinity) != 0) {
+        Warning("sched_getaffinity: %s. Not pinning threads.", ErrorString());
+        return false;
+    }
+
+    // Find the CPUs of each NUMA node that this process may run on
+    std::vector<std::vector<int>> nodeCPUs;
+    std::vector<int> onlineNodes = ParseCPUList("/sys/devices/system/node/online");
+    for (int node : onlineNodes) {
+        std::vector<int> cpus;
+        for (int cpu : ParseCPUList(
+                 StringPrintf("/sys/devices/system/node/node%d/cpulist", node)))
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &initialAffinity))
+                cpus.push_back(cpu);
+        if (!cpus.empty()) {
+            nodeCPUs.push_back(cpus);
+            numaNodeIds.push_back(node);
+        }
+    }
+    if (nodeCPUs.empty()) {
+        // No NUMA information available; treat all CPUs as a single node
+        nodeCPUs.push_back({});
+        numaNodeIds = {0};
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &initialAffinity))
+                nodeCPUs[0].push_back(cpu);
+    }
+
+    // Assign threads to CPUs, alternating between nodes so that threads are
+    // spread evenly over the sockets. If there are more threads than CPUs,
+    // CPUs are reused.
+    std::vector<std::pair<int, int>> cpuOrder;
+    for (size_t i = 0; cpuOrder.size() < size_t(nThreads); ++i)
+        for (size_t node = 0; node < nodeCPUs.size(); ++node)
+            cpuOrder.push_back({nodeCPUs[node][i % nodeCPUs[node].size()], int(node)});
+    for (int t = 0; t < nThreads; ++t) {
+        auto [cpu, node] = cpuOrder[t];
+        // The main thread may run anywhere on its node, since threads that it
+        // creates later inherit its affinity.
+        threadCPUs.push_back(t == 0 ? nodeCPUs[node] : std::vector<int>{cpu});
+        threadNumaNodes.push_back(node);
+    }
+    numaNodeIds.resize(std::min<size_t>(nThreads, numaNodeIds.size()));
+    LOG_VERBOSE("Pinning %d threads to %d NUMA nodes", nThreads, numaNodeIds.size());
+    return true;
+#else
+    Warning("Thread pinning is only supported on Linux.");
+    return false;
+#endif
+}
+
+static void PinThread(int tIndex) {
+    if (threadCPUs.empty())
+        return;
+#ifdef PBRT_IS_LINUX
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int cpu : threadCPUs[tIndex])
+        CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+        Warning("Unable to pin thread %d: %s", tIndex, ErrorString());
+#endif
+    threadNumaNode = threadNumaNodes[tIndex];
+}
+
+int NumaNodeCount() {
+    return std::max<int>(1, numaNodeIds.size());
+}
+
+int ThreadNumaNode() {
+    return threadNumaNode;
+}
+
+bool BindMemoryToNumaNode(void *ptr, size_t size, int node) {
+    if (numaNodeIds.size() <= 1 || size == 0)
+        return false;
+    CHECK(node >= 0 && node < int(numaNodeIds.size()));
+#if defined(PBRT_IS_LINUX) && defined(SYS_mbind)
+    // Round the range out to whole pages and ask the kernel to migrate them
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = uintptr_t(ptr) & ~(pageSize - 1);
+    uintptr_t end = (uintptr_t(ptr) + size + pageSize - 1) & ~(pageSize - 1);
+    int nodeId = numaNodeIds[node];
+    std::vector<unsigned long> mask(nodeId / (8 * sizeof(unsigned long)) + 1, 0);
+    mask[nodeId / (8 * sizeof(unsigned long))] |=
+        1ul << (nodeId % (8 * sizeof(unsigned long)));
+    // These match MPOL_BIND and MPOL_MF_MOVE in <numaif.h>
+    constexpr int bindPolicy = 2;
+    constexpr unsigned moveFlag = 1 << 1;
+    if (syscall(SYS_mbind, start, end - start, bindPolicy, mask.data(),
+                8 * sizeof(unsigned long) * mask.size() + 1, moveFlag) != 0) {
+        LOG_VERBOSE("mbind: %s", ErrorString());
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 // ThreadPool Method Definitions
 ThreadPool::ThreadPool(int nThreads) {
     ThreadIndex = 0;
+    dequeIndex = 0;
+
+    for (int i = 0; i < nThreads + 1; ++i)
+        deques.push_back(std::make_unique<TaskDeque>());
 
     // Launch one fewer worker thread than the total number we want doing
     // work, since the main thread helps out, too.
@@ -109,66 +401,119 @@ ThreadPool::ThreadPool(int nThreads) {
         threads.push_back(std::thread(&ThreadPool::workerFunc, this, i + 1));
 }
 
-std::unique_lock<std::mutex> ThreadPool::AddToJobList(ParallelJob *job) {
-    std::unique_lock<std::mutex> lock(jobListMutex);
-    if (jobList != nullptr)
-        jobList->prev = job;
-    job->next = jobList;
-    jobList = job;
-    jobListCondition.notify_all();
-    return lock;
-}
+void ThreadPool::workerFunc(int tIndex) {
+    LOG_VERBOSE("Started execution in worker thread %d", tIndex);
+    ThreadIndex = tIndex;
+    dequeIndex = tIndex;
+    PinThread(tIndex);
 
-void ThreadPool::RemoveFromJobList(ParallelJob *job) {
-    DCHECK(!job->removed);
+    WorkUntil([this]() { return shutdownThreads.load(); });
 
-    if (job->prev != nullptr) {
-        job->prev->next = job->next;
-    } else {
-        DCHECK(jobList == job);
-        jobList = job->next;
-    }
-    if (job->next != nullptr)
-        job->next->prev = job->prev;
+    LOG_VERBOSE("Exiting worker thread %d", tIndex);
+}
 
-    job->removed = true;
+void ThreadPool::Push(ParallelTask *task) {
+    if (dequeIndex >= 0)
+        deques[dequeIndex]->Push(task);
+    else {
+        std::lock_guard<std::mutex> lock(sharedDequeMutex);
+        deques.back()->Push(task);
+    }
+    Signal();
 }
 
-void ThreadPool::workerFunc(int tIndex) {
-    LOG_VERBOSE("Started execution in worker thread %d", tIndex);
-    ThreadIndex = tIndex;
+ParallelTask *ThreadPool::FindTask() {
+    // Threads outside the pool only run tasks from the shared deque. Tasks
+    // of the pool's loops may use per-thread state indexed by _ThreadIndex_,
+    // which these threads don't have an entry of their own in.
+    if (dequeIndex < 0) {
+        std::lock_guard<std::mutex> lock(sharedDequeMutex);
+        return deques.back()->Pop();
+    }
 
-    std::unique_lock<std::mutex> lock(jobListMutex);
-    while (!shutdownThreads)
-        WorkOrWait(&lock);
+    // Take the most recently pushed task from this thread's own deque
+    ParallelTask *task = deques[dequeIndex]->Pop();
+    if (task)
+        return task;
+
+    // Otherwise try to steal from the other deques, starting at a random one
+    static thread_local uint64_t victimSeed = MixBits(uint64_t(ThreadIndex) + 1);
+    victimSeed = MixBits(victimSeed);
+    int n = deques.size();
+    int start = victimSeed % n;
+    for (int i = 0; i < n; ++i) {
+        int victim = (start + i) % n;
+        if (victim != dequeIndex && (task = deques[victim]->Steal()))
+            return task;
+    }
+    return nullptr;
+}
 
-    LOG_VERBOSE("Exiting worker thread %d", tIndex);
+bool ThreadPool::HaveWork() const {
+    for (const auto &deque : deques)
+        if (deque->Size() > 0)
+            return true;
+    return false;
 }
 
-void ThreadPool::WorkOrWait(std::unique_lock<std::mutex> *lock) {
-    DCHECK(lock->owns_lock());
+void ThreadPool::Signal() {
+    workEpoch.fetch_add(1);
+    if (nSleeping.load() > 0) {
+        // Acquire the mutex so that a thread that is between checking the
+        // epoch and waiting can't miss the notification.
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        sleepCondition.notify_all();
+    }
+}
 
-    ParallelJob *job = jobList;
-    while ((job != nullptr) && !job->HaveWork())
-        job = job->next;
-    if (job != nullptr) {
-        // Run a chunk of loop iterations for _loop_
-        job->activeWorkers++;
+void ThreadPool::Execute(ParallelTask *task) {
+    // Split off the upper half of the task's chunks until a single chunk
+    // remains; other threads steal the largest pieces from the top.
+    ParallelJob *job = task->job;
+    int64_t begin = task->begin, end = task->end;
+    while (end - begin > 1) {
+        int64_t mid = begin + (end - begin) / 2;
+        Push(job->AllocateTask(mid, end));
+        end = mid;
+    }
 
-        job->RunStep(lock);
+    job->RunChunk(begin);
 
-        DCHECK(!lock->owns_lock());
-        lock->lock();
+    // _job_ may be destroyed by its waiting thread as soon as the last
+    // chunk is accounted for, so it must not be accessed afterward.
+    if (job->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        Signal();
+}
 
-        // Update _loop_ to reflect completion of iterations
-        job->activeWorkers--;
+template <typename F>
+void ThreadPool::WorkUntil(F done) {
+    int idleSpins = 0;
+    while (!done()) {
+        if (ParallelTask *task = FindTask()) {
+            Execute(task);
+            idleSpins = 0;
+        } else if (++idleSpins < 64)
+            std::this_thread::yield();
+        else {
+            // Sleep until new tasks are pushed or a job finishes
+            uint64_t epoch = workEpoch.load();
+            nSleeping.fetch_add(1);
+            if (!done() && !HaveWork()) {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                sleepCondition.wait(lock, [&]() { return workEpoch.load() != epoch; });
+            }
+            nSleeping.fetch_sub(1);
+            idleSpins = 0;
+        }
+    }
+}
 
-        if (job->Finished())
-            jobListCondition.notify_all();
-    } else
-        // Wait for something to change (new work, or this loop being
-        // finished).
-        jobListCondition.wait(*lock);
+void ThreadPool::Run(ParallelJob *job) {
+    // Start on the whole range in this thread and then help out with
+    // whatever work is available, which may include tasks from other jobs
+    // when _Run()_ is called from inside a parallel loop.
+    Execute(job->AllocateTask(0, job->tasks.size()));
+    WorkUntil([job]() { return job->Finished(); });
 }
 
 void ThreadPool::ForEachThread(std::function<void(void)> func) {
@@ -182,140 +527,117 @@ void ThreadPool::ForEachThread(std::function<void(void)> func) {
 }
 
 ThreadPool::~ThreadPool() {
+    if (dequeIndex == 0)
+        dequeIndex = -1;
     if (threads.empty())
         return;
 
-    {
-        std::lock_guard<std::mutex> lock(jobListMutex);
-        shutdownThreads = true;
-        jobListCondition.notify_all();
-    }
+    shutdownThreads = true;
+    Signal();
 
     for (std::thread &thread : threads)
         thread.join();
 }
 
 std::string ThreadPool::ToString() const {
-    std::string s = StringPrintf("[ ThreadPool threads.size(): %d shutdownThreads: %s ",
-                                 threads.size(), shutdownThreads);
-    if (jobListMutex.try_lock()) {
-        s += "jobList: [ ";
-        ParallelJob *job = jobList;
-        while (job) {
-            s += job->ToString() + " ";
-            job = job->next;
-        }
-        s += "] ";
-        jobListMutex.unlock();
-    } else
-        s += "(job list mutex locked) ";
-    return s + "]";
+    std::string s = StringPrintf("[ ThreadPool threads.size(): %d shutdownThreads: %s "
+                                 "nSleeping: %d deque sizes: [ ",
+                                 threads.size(), shutdownThreads.load(),
+                                 nSleeping.load());
+    for (const auto &deque : deques)
+        s += StringPrintf("%d ", deque->Size());
+    return s + "] ]";
 }
 
 // ParallelForLoop1D Definition
 class ParallelForLoop1D : public ParallelJob {
   public:
-    ParallelForLoop1D(int64_t start, int64_t end, int chunkSize,
+    ParallelForLoop1D(int64_t start, int64_t end, int64_t chunkSize,
                       std::function<void(int64_t, int64_t)> func)
-        : func(std::move(func)), nextIndex(start), maxIndex(end), chunkSize(chunkSize) {}
+        : ParallelJob((end - start + chunkSize - 1) / chunkSize),
+          func(std::move(func)),
+          start(start),
+          end(end),
+          chunkSize(chunkSize) {}
 
-    bool HaveWork() const { return nextIndex < maxIndex; }
-    void RunStep(std::unique_lock<std::mutex> *lock);
+    void RunChunk(int64_t chunk);
 
     std::string ToString() const {
-        return StringPrintf("[ ParallelForLoop1D nextIndex: %d maxIndex: %d "
-                            "chunkSize: %d ]",
-                            nextIndex, maxIndex, chunkSize);
+        return StringPrintf("[ ParallelForLoop1D start: %d end: %d chunkSize: %d %s ]",
+                            start, end, chunkSize, BaseToString());
     }
 
   private:
     std::function<void(int64_t, int64_t)> func;
-    int64_t nextIndex;
-    int64_t maxIndex;
-    int chunkSize;
+    int64_t start, end;
+    int64_t chunkSize;
 };
 
 class ParallelForLoop2D : public ParallelJob {
   public:
-    ParallelForLoop2D(const Bounds2i &extent, int chunkSize,
-                      std::function<void(Bounds2i)> func)
-        : func(std::move(func)),
-          extent(extent),
-          nextStart(extent.pMin),
-          chunkSize(chunkSize) {}
+    ParallelForLoop2D(std::vector<Bounds2i> tiles, std::function<void(Bounds2i)> func)
+        : ParallelJob(tiles.size()), func(std::move(func)), tiles(std::move(tiles)) {}
 
-    bool HaveWork() const { return nextStart.y < extent.pMax.y; }
-    void RunStep(std::unique_lock<std::mutex> *lock);
+    void RunChunk(int64_t chunk) { func(tiles[chunk]); }
 
     std::string ToString() const {
-        return StringPrintf("[ ParallelForLoop2D extent: %s nextStart: %s "
-                            "chunkSize: %d ]",
-                            extent, nextStart, chunkSize);
+        return StringPrintf("[ ParallelForLoop2D tiles: %d %s ]", tiles.size(),
+                            BaseToString());
     }
 
   private:
     std::function<void(Bounds2i)> func;
-    const Bounds2i extent;
-    Point2i nextStart;
-    int chunkSize;
+    std::vector<Bounds2i> tiles;
 };
 
-// ParallelForLoop1D Method Definitions
-void ParallelForLoop1D::RunStep(std::unique_lock<std::mutex> *lock) {
-    // Find the set of loop iterations to run next
-    int64_t indexStart = nextIndex;
-    int64_t indexEnd = std::min(indexStart + chunkSize, maxIndex);
-
-    // Update _loop_ to reflect iterations this thread will run
-    nextIndex = indexEnd;
+// OrderedParallelForLoop2D Definition
+// Runs _func_ over tiles in the order given: each of the job's chunks keeps
+// taking the next tile from a shared counter until all have been handed out,
+// so unlike with _ParallelForLoop2D_, work stealing doesn't reorder them.
+class OrderedParallelForLoop2D : public ParallelJob {
+  public:
+    OrderedParallelForLoop2D(std::vector<Bounds2i> tiles,
+                             std::function<void(Bounds2i)> func)
+        : ParallelJob(std::min<int64_t>(RunningThreads(), tiles.size())),
+          func(std::move(func)),
+          tiles(std::move(tiles)) {}
+
+    void RunChunk(int64_t) {
+        for (size_t i = nextTile++; i < tiles.size(); i = nextTile++)
+            func(tiles[i]);
+    }
 
-    if (!HaveWork())
-        threadPool->RemoveFromJobList(this);
+    std::string ToString() const {
+        return StringPrintf("[ OrderedParallelForLoop2D tiles: %d nextTile: %d %s ]",
+                            tiles.size(), nextTile.load(), BaseToString());
+    }
 
-    lock->unlock();
+  private:
+    std::function<void(Bounds2i)> func;
+    std::vector<Bounds2i> tiles;
+    std::atomic<size_t> nextTile{0};
+};
 
+// ParallelForLoop1D Method Definitions
+void ParallelForLoop1D::RunChunk(int64_t chunk) {
     // Run loop indices in _[indexStart, indexEnd)_
+    int64_t indexStart = start + chunk * chunkSize;
+    int64_t indexEnd = std::min(indexStart + chunkSize, end);
     func(indexStart, indexEnd);
 }
 
-void ParallelForLoop2D::RunStep(std::unique_lock<std::mutex> *lock) {
-    // Compute extent for this step
-    Point2i end = nextStart + Vector2i(chunkSize, chunkSize);
-    Bounds2i b = Intersect(Bounds2i(nextStart, end), extent);
-    CHECK(!b.IsEmpty());
-
-    // Advance to be ready for the next extent.
-    nextStart.x += chunkSize;
-    if (nextStart.x >= extent.pMax.x) {
-        nextStart.x = extent.pMin.x;
-        nextStart.y += chunkSize;
-    }
-
-    if (!HaveWork())
-        threadPool->RemoveFromJobList(this);
-
-    lock->unlock();
-
-    // Run the loop iteration
-    func(b);
-}
-
 // Parallel Function Defintions
 void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t)> func) {
     CHECK(threadPool);
     int64_t chunkSize = std::max<int64_t>(1, (end - start) / (8 * RunningThreads()));
-    if (end - start < chunkSize) {
+    if (end - start <= chunkSize) {
         func(start, end);
         return;
     }
 
-    // Create and enqueue _ParallelJob_ for this loop
+    // Run a _ParallelJob_ for this loop, helping out in the current thread
     ParallelForLoop1D loop(start, end, chunkSize, std::move(func));
-    std::unique_lock<std::mutex> lock = threadPool->AddToJobList(&loop);
-
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished())
-        threadPool->WorkOrWait(&lock);
+    threadPool->Run(&loop);
 }
 
 int MaxThreadIndex() {
@@ -339,13 +661,126 @@ void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func) {
     int tileSize = Clamp(int(std::sqrt(extent.Diagonal().x * extent.Diagonal().y /
                                        (8 * RunningThreads()))),
                          1, 32);
+    ParallelForLoop2D loop(OrderedTiles(extent, tileSize, TileOrder::Raster),
+                           std::move(func));
+    threadPool->Run(&loop);
+}
+
+void ParallelFor2D(const Bounds2i &extent, int tileSize, TileOrder order,
+                   std::function<void(Bounds2i)> func) {
+    CHECK(threadPool);
+
+    if (extent.IsEmpty())
+        return;
+    if (extent.Area() == 1) {
+        func(extent);
+        return;
+    }
+
+    OrderedParallelForLoop2D loop(OrderedTiles(extent, tileSize, order), std::move(func));
+    threadPool->Run(&loop);
+}
+
+// Tile Ordering Function Definitions
+pstd::optional<TileOrder> ParseTileOrder(const std::string &name) {
+    if (name == "raster")
+        return TileOrder::Raster;
+    else if (name == "morton")
+        return TileOrder::Morton;
+    else if (name == "hilbert")
+        return TileOrder::Hilbert;
+    else if (name == "spiral")
+        return TileOrder::Spiral;
+    return {};
+}
+
+std::string ToString(TileOrder order) {
+    switch (order) {
+    case TileOrder::Raster:
+        return "raster";
+    case TileOrder::Morton:
+        return "morton";
+    case TileOrder::Hilbert:
+        return "hilbert";
+    case TileOrder::Spiral:
+        return "spiral";
+    default:
+        LOG_FATAL("Unhandled TileOrder");
+        return {};
+    }
+}
 
-    ParallelForLoop2D loop(extent, tileSize, std::move(func));
-    std::unique_lock<std::mutex> lock = threadPool->AddToJobList(&loop);
+int AutoTileSize(const Bounds2i &extent) {
+    // Aim for at least 16 tiles per thread so that threads can balance the
+    // load even for small crop windows. Tiles of up to 64 pixels on a side
+    // are allowed for large images, since ordering the tiles along a
+    // space-filling curve maintains locality across neighboring tiles.
+    int64_t area = extent.Area();
+    int tileSize = int(std::sqrt(double(area) / (16 * RunningThreads())));
+    // Round down to a power of two so that tiles line up with each other
+    // across images of similar sizes
+    return tileSize < 2 ? 1 : std::min(64, 1 << Log2Int(tileSize));
+}
+
+// Returns the index of the point _(x,y)_ along a Hilbert curve that covers
+// the _n_x_n_ grid, where _n_ is a power of two.
+static uint64_t HilbertIndex(uint32_t n, uint32_t x, uint32_t y) {
+    uint64_t d = 0;
+    for (uint32_t s = n / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) ? 1 : 0, ry = (y & s) ? 1 : 0;
+        d += uint64_t(s) * uint64_t(s) * ((3 * rx) ^ ry);
+        // Rotate the quadrant so that the curve's sub-curves connect
+        if (ry == 0) {
+            if (rx == 1) {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
 
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.Finished())
-        threadPool->WorkOrWait(&lock);
+std::vector<Bounds2i> OrderedTiles(const Bounds2i &extent, int tileSize,
+                                   TileOrder order) {
+    CHECK_GT(tileSize, 0);
+    Vector2i nTiles((extent.Diagonal().x + tileSize - 1) / tileSize,
+                    (extent.Diagonal().y + tileSize - 1) / tileSize);
+
+    // Compute a sort key for each tile, _(key, tile index)_, according to _order_
+    std::vector<std::pair<double, int64_t>> keys;
+    keys.reserve(int64_t(nTiles.x) * int64_t(nTiles.y));
+    uint32_t n = RoundUpPow2(std::max(nTiles.x, nTiles.y));
+    Point2f center((nTiles.x - 1) / 2.f, (nTiles.y - 1) / 2.f);
+    for (int y = 0; y < nTiles.y; ++y)
+        for (int x = 0; x < nTiles.x; ++x) {
+            int64_t index = int64_t(y) * nTiles.x + x;
+            double key = index;
+            if (order == TileOrder::Morton)
+                key = EncodeMorton2(x, y);
+            else if (order == TileOrder::Hilbert)
+                key = HilbertIndex(n, x, y);
+            else if (order == TileOrder::Spiral) {
+                // Order tiles by the square ring around the center that they
+                // are in and then by angle within the ring
+                Float dx = x - center.x, dy = y - center.y;
+                Float ring = std::max(std::abs(dx), std::abs(dy));
+                key = 8 * double(ring) + (Pi + std::atan2(dy, dx)) / (2 * Pi);
+            }
+            keys.push_back(std::make_pair(key, index));
+        }
+    std::sort(keys.begin(), keys.end());
+
+    // Return the tiles' bounds in sorted order
+    std::vector<Bounds2i> tiles;
+    tiles.reserve(keys.size());
+    for (const auto &key : keys) {
+        Point2i pMin = extent.pMin + tileSize * Vector2i(key.second % nTiles.x,
+                                                         key.second / nTiles.x);
+        tiles.push_back(
+            Intersect(Bounds2i(pMin, pMin + Vector2i(tileSize, tileSize)), extent));
+    }
+    return tiles;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -358,7 +793,7 @@ int RunningThreads() {
     return threadPool ? (1 + threadPool->size()) : 1;
 }
 
-void ParallelInit(int nThreads) {
+void ParallelInit(int nThreads, bool pinThreads) {
     // This is risky: if the caller has allocated per-thread data
     // structures before calling ParallelInit(), then we may end up having
     // them accessed with a higher ThreadIndex than the caller expects.
@@ -367,11 +802,22 @@ void ParallelInit(int nThreads) {
     CHECK(!threadPool);
     if (nThreads <= 0)
         nThreads = AvailableCores();
+    if (pinThreads && ComputeThreadPlacement(nThreads))
+        PinThread(0);
     threadPool = std::make_unique<ThreadPool>(nThreads);
 }
 
 void ParallelCleanup() {
     threadPool.reset();
+
+#ifdef PBRT_IS_LINUX
+    if (!threadCPUs.empty())
+        sched_setaffinity(0, sizeof(initialAffinity), &initialAffinity);
+#endif
+    threadCPUs.clear();
+    threadNumaNodes.clear();
+    numaNodeIds.clear();
+    threadNumaNode = 0;
     maxThreadIndexCalled = false;
 }
 
@@ -17,6 +17,7 @@
 #include <initializer_list>
 #include <mutex>
 #include <string>
+#include <vector>
 
 namespace pbrt {
 
@@ -158,8 +159,24 @@ class Barrier {
     int numToBlock, numToExit;
 };
 
+// TileOrder Definition
+// Order in which the tiles of a 2D loop are handed out to threads, one at a
+// time. Space-filling curve orders keep the tiles being rendered at any time
+// close together; _Spiral_ starts at the center of the image, which is most
+// useful for previews.
+enum class TileOrder { Raster, Morton, Hilbert, Spiral };
+
+pstd::optional<TileOrder> ParseTileOrder(const std::string &name);
+std::string ToString(TileOrder order);
+
+int AutoTileSize(const Bounds2i &extent);
+std::vector<Bounds2i> OrderedTiles(const Bounds2i &extent, int tileSize,
+                                   TileOrder order);
+
 void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t, int64_t)> func);
 void ParallelFor2D(const Bounds2i &extent, std::function<void(Bounds2i)> func);
+void ParallelFor2D(const Bounds2i &extent, int tileSize, TileOrder order,
+                   std::function<void(Bounds2i)> func);
 
 // Parallel Inline Functions
 inline void ParallelFor(int64_t start, int64_t end, std::function<void(int64_t)> func) {
@@ -182,13 +199,19 @@ void ForEachThread(std::function<void(void)> func);
 extern thread_local int ThreadIndex;
 
 // ParallelFunction Declarations
-void ParallelInit(int nThreads = -1);
+void ParallelInit(int nThreads = -1, bool pinThreads = false);
 void ParallelCleanup();
 
 int AvailableCores();
 int RunningThreads();
 int MaxThreadIndex();
 
+// NUMA nodes that the pinned threads run on; there is a single node, 0, if
+// threads aren't pinned.
+int NumaNodeCount();
+int ThreadNumaNode();
+bool BindMemoryToNumaNode(void *ptr, size_t size, int node);
+
 }  // namespace pbrt
 
 #endif  // PBRT_UTIL_PARALLEL_H
@@ -6,6 +6,11 @@
 #include <pbrt/pbrt.h>
 #include <pbrt/util/parallel.h>
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 
 using namespace pbrt;
 
@@ -44,3 +49,141 @@ TEST(Parallel, ForEachThread) {
     ForEachThread([&count] { --count; });
     EXPECT_EQ(0, count);
 }
+
+TEST(Parallel, Nested) {
+    std::atomic<int> counter{0};
+    ParallelFor(0, 100, [&](int64_t) {
+        ParallelFor(0, 100, [&](int64_t) { ++counter; });
+    });
+    EXPECT_EQ(100 * 100, counter);
+
+    counter = 0;
+    ParallelFor2D(Bounds2i{{0, 0}, {64, 64}}, [&](Bounds2i b) {
+        ParallelFor(0, b.Area(), [&](int64_t start, int64_t end) {
+            counter += int(end - start);
+        });
+    });
+    EXPECT_EQ(64 * 64, counter);
+}
+
+TEST(Parallel, OutsideThread) {
+    // Loops started from threads that aren't part of the thread pool
+    std::atomic<int> counter{0};
+    std::thread t([&]() { ParallelFor(0, 1000, [&](int64_t) { ++counter; }); });
+    t.join();
+    EXPECT_EQ(1000, counter);
+}
+
+TEST(Parallel, OutsideThreadRunsOnlyItsOwnTasks) {
+    // Find the threads that have their own _ThreadIndex_
+    std::mutex mutex;
+    std::set<std::thread::id> poolThreads;
+    ForEachThread([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        poolThreads.insert(std::this_thread::get_id());
+    });
+
+    // Run loops from a thread outside the pool whose second iteration is
+    // left to the pool, so that the outside thread waits for it to finish
+    // while the pool is busy with another loop.
+    std::atomic<bool> done{false};
+    std::thread t([&]() {
+        while (!done) {
+            std::atomic<bool> stolen{false};
+            ParallelFor(0, 2, [&](int64_t i) {
+                if (i == 1) {
+                    stolen = true;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                } else
+                    for (int spin = 0; spin < 10000 && !stolen; ++spin)
+                        std::this_thread::yield();
+            });
+        }
+    });
+    std::atomic<bool> ranOutsidePool{false};
+    ParallelFor(0, 5000, [&](int64_t) {
+        if (poolThreads.find(std::this_thread::get_id()) == poolThreads.end())
+            ranOutsidePool = true;
+        std::this_thread::yield();
+    });
+    done = true;
+    t.join();
+    EXPECT_FALSE(ranOutsidePool);
+}
+
+TEST(Parallel, ManyLoops) {
+    // Back-to-back loops, with each iteration covered exactly once
+    std::vector<std::atomic<int>> visits(500);
+    for (int iter = 0; iter < 200; ++iter)
+        ParallelFor(0, visits.size(), [&](int64_t i) { ++visits[i]; });
+    for (const std::atomic<int> &v : visits)
+        EXPECT_EQ(200, v);
+}
+
+TEST(Parallel, TileOrders) {
+    for (TileOrder order : {TileOrder::Raster, TileOrder::Morton, TileOrder::Hilbert,
+                            TileOrder::Spiral}) {
+        EXPECT_EQ(order, *ParseTileOrder(ToString(order)));
+
+        for (int tileSize : {1, 7, 16, 64}) {
+            // Every pixel must be covered by exactly one tile
+            Bounds2i extent(Point2i(3, 5), Point2i(103, 66));
+            std::vector<int> covered(extent.Area(), 0);
+            for (Bounds2i tile : OrderedTiles(extent, tileSize, order))
+                for (Point2i p : tile)
+                    ++covered[(p.y - extent.pMin.y) * extent.Diagonal().x +
+                              (p.x - extent.pMin.x)];
+            for (int c : covered)
+                EXPECT_EQ(1, c);
+
+            std::atomic<int> counter{0};
+            ParallelFor2D(extent, tileSize, order,
+                          [&](Bounds2i b) { counter += b.Area(); });
+            EXPECT_EQ(extent.Area(), counter);
+        }
+    }
+    EXPECT_FALSE(ParseTileOrder("zigzag").has_value());
+}
+
+TEST(Parallel, OrderedTilesStartInOrder) {
+    // Tiles are handed out one at a time, so a tile can only start after an
+    // earlier one if each thread still holds at most one tile it has taken
+    // but not yet started.
+    Bounds2i extent(Point2i(0, 0), Point2i(200, 150));
+    std::vector<Bounds2i> tiles = OrderedTiles(extent, 8, TileOrder::Spiral);
+    std::vector<int> startIndex(tiles.size(), -1);
+    std::atomic<int> nStarted{0};
+    ParallelFor2D(extent, 8, TileOrder::Spiral, [&](Bounds2i b) {
+        int start = nStarted++;
+        for (size_t i = 0; i < tiles.size(); ++i)
+            if (tiles[i] == b)
+                startIndex[i] = start;
+    });
+    for (size_t i = 0; i < tiles.size(); ++i)
+        EXPECT_LT(std::abs(startIndex[i] - int(i)), RunningThreads());
+}
+
+TEST(Parallel, HilbertTilesAdjacent) {
+    // Successive tiles along a Hilbert curve over a power-of-two grid share
+    // an edge.
+    std::vector<Bounds2i> tiles =
+        OrderedTiles(Bounds2i(Point2i(0, 0), Point2i(128, 128)), 8, TileOrder::Hilbert);
+    ASSERT_EQ(16 * 16, tiles.size());
+    for (size_t i = 1; i < tiles.size(); ++i) {
+        Vector2i d = tiles[i].pMin - tiles[i - 1].pMin;
+        EXPECT_EQ(8, std::abs(d.x) + std::abs(d.y)) << tiles[i - 1] << " " << tiles[i];
+    }
+}
+
+TEST(Parallel, SpiralTilesStartAtCenter) {
+    std::vector<Bounds2i> tiles =
+        OrderedTiles(Bounds2i(Point2i(0, 0), Point2i(90, 90)), 10, TileOrder::Spiral);
+    EXPECT_EQ(Bounds2i(Point2i(40, 40), Point2i(50, 50)), tiles[0]);
+    // Tiles are in order of increasing distance from the center
+    for (size_t i = 1; i < tiles.size(); ++i) {
+        auto ring = [](const Bounds2i &b) {
+            return std::max(std::abs(b.pMin.x - 40), std::abs(b.pMin.y - 40));
+        };
+        EXPECT_LE(ring(tiles[i - 1]), ring(tiles[i]));
+    }
+}
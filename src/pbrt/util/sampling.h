@@ -575,6 +575,16 @@ class VarianceEstimator {
     Float RelativeVariance() const {
         return (n < 1 || mean == 0) ? 0 : Variance() / Mean();
     }
+    PBRT_CPU_GPU
+    Float RelativeStandardError() const {
+        // Standard error of the mean relative to the mean; infinite if there
+        // are too few values to estimate it
+        if (n < 2)
+            return Infinity;
+        if (mean == 0)
+            return Variance() == 0 ? 0 : Infinity;
+        return std::sqrt(Variance() / n) / std::abs(mean);
+    }
 
     PBRT_CPU_GPU
     void Merge(const VarianceEstimator &ve) {
@@ -961,6 +961,29 @@ TEST(VarianceEstimator, Merge) {
     EXPECT_LT(err, 1e-5);
 }
 
+TEST(VarianceEstimator, RelativeStandardError) {
+    VarianceEstimator<double> ve;
+    EXPECT_TRUE(std::isinf(ve.RelativeStandardError()));
+    ve.Add(0.);
+    ve.Add(0.);
+    EXPECT_EQ(0, ve.RelativeStandardError());
+
+    // Uniform values in [1,3]: mean 2, variance 1/3, so the relative error
+    // is sqrt(1/(3n)) / 2.
+    ve = VarianceEstimator<double>();
+    int count = 10000;
+    for (Float u : Stratified1D(count))
+        ve.Add(Lerp(u, 1, 3));
+    double expected = std::sqrt(1. / (3. * count)) / 2;
+    EXPECT_LT(std::abs(ve.RelativeStandardError() - expected), 1e-3 * expected);
+
+    // Error decreases with more samples
+    VarianceEstimator<double> veFew;
+    for (Float u : Stratified1D(100))
+        veFew.Add(Lerp(u, 1, 3));
+    EXPECT_GT(veFew.RelativeStandardError(), ve.RelativeStandardError());
+}
+
 TEST(VarianceEstimator, MergeTwo) {
     VarianceEstimator<double> ve[2], veBoth;
 